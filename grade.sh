@@ -4,25 +4,52 @@ set -u
 TESTSPEC=mempager-tests/tests.spec
 # TESTSPEC=mempager-tests/test11.spec
 
+# Set TRACE=1 to record binary traces and grade the decoded output.
+TRACE=${TRACE:-0}
+# Set TRACK=MS to run the MMU with page-state tracking (sampling
+# accesses every MS milliseconds).  Tracking changes paging decisions,
+# so only the output of the tests themselves is graded.
+TRACK=${TRACK:-0}
+# Set LEASE=NPAGES to run the MMU with extend leases of NPAGES pages.
+# Leases change the pager calls, so only the test output is graded.
+LEASE=${LEASE:-0}
+
 make
 
-while read -r num frames blocks nodiff ; do
+# Lines in $TESTSPEC are: test number, frames, blocks, whether to skip
+# diffs, and optional extra MMU flags.
+while read -r num frames blocks nodiff mmuflags ; do
     num=$((num))
     frames=$((frames))
     blocks=$((blocks))
     nodiff=$((nodiff))
     echo "running test$num"
     rm -rf mmu.sock mmu.pmem.img.*
-    ./bin/mmu $frames $blocks &> test$num.mmu.out &
+    flags="$mmuflags"
+    if [ $TRACK -gt 0 ] ; then
+        flags="$flags -s $TRACK"
+    fi
+    if [ $LEASE -gt 0 ] ; then
+        flags="$flags -l $LEASE"
+    fi
+    if [ $TRACE -eq 1 ] ; then
+        ./bin/mmu $flags -q -t test$num.trace $frames $blocks &> test$num.mmu.out &
+    else
+        ./bin/mmu $flags $frames $blocks &> test$num.mmu.out &
+    fi
     sleep 1s
     ./bin/test$num &> test$num.out
     kill -SIGINT %1
     wait
+    if [ $TRACE -eq 1 ] ; then
+        ./bin/mmudump test$num.trace >> test$num.mmu.out
+    fi
     rm -rf mmu.sock mmu.pmem.img.*
     if [ $nodiff -eq 1 ] ; then
         continue
     fi
-    if ! diff mempager-tests/test$num.mmu.out test$num.mmu.out > /dev/null ; then
+    if [ $TRACK -eq 0 ] && [ $LEASE -eq 0 ] && \
+            ! diff mempager-tests/test$num.mmu.out test$num.mmu.out > /dev/null ; then
         echo "test$num.mmu.out differs"
     fi
     if ! diff mempager-tests/test$num.out test$num.out > /dev/null ; then
@@ -0,0 +1,50 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "uvm.h"
+
+int num_threads = 4; /* run with ./mmu 4 8 */
+char *pages[4];
+
+void * worker(void *arg) {
+	int i = (int)(intptr_t)arg;
+	/* all threads fault on page0 at the same time; thread 0 may
+	 * have written it already */
+	assert(pages[0][0] == '0' || pages[0][0] == 'a');
+	pages[i][0] = 'a' + i;
+	return NULL;
+}
+
+int main(void) {
+	uvm_create();
+	uvm_request_t reqs[4];
+	for(int i = 0; i < num_threads; ++i) {
+		reqs[i] = uvm_extend_async();
+	}
+	for(int i = 0; i < num_threads; ++i) {
+		pages[i] = uvm_extend_wait(reqs[i]);
+		assert(pages[i]);
+	}
+
+	pthread_t threads[4];
+	for(int i = 0; i < num_threads; ++i) {
+		pthread_create(&threads[i], NULL, worker, (void *)(intptr_t)i);
+	}
+	for(int i = 0; i < num_threads; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+
+	for(int i = 0; i < num_threads; ++i) {
+		reqs[i] = uvm_syslog_async(pages[i], 1);
+	}
+	for(int i = 0; i < num_threads; ++i) {
+		int r = uvm_syslog_wait(reqs[i]);
+		assert(r == 0);
+		printf("%c\n", pages[i][0]);
+	}
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,24 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "uvm.h"
+
+// extend
+// read 0
+// second chance
+// soft fault on resident page
+int main(void) {
+	uvm_create();
+	char *page0 = uvm_extend();
+	char *page1 = uvm_extend();
+	char *page2 = uvm_extend();
+	printf("%c\n", page0[0]);
+	printf("%c\n", page1[0]);
+	printf("%c\n", page2[0]);
+	/* page1 is resident but lost its permissions during the sweep */
+	printf("%c\n", page1[0]);
+	printf("%c\n", page0[0]);
+	printf("%c\n", page1[0]);
+	exit(EXIT_SUCCESS);
+}
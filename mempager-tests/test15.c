@@ -0,0 +1,30 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// extend_n populate
+// read and write without faults
+// extend_n lazy
+// extend_n too large
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *a = uvm_extend_n(3, UVM_POPULATE);
+	assert(a);
+	printf("%c\n", a[0]);
+	printf("%c\n", a[2*pagesz]);
+	char *b = uvm_extend_n(2, 0);
+	assert(b == a + 3*pagesz);
+	printf("%c\n", b[pagesz]);
+	char *c = uvm_extend_n(100, UVM_POPULATE);
+	assert(c == NULL && errno == ENOSPC);
+	char *d = uvm_extend();
+	assert(d == b + 2*pagesz);
+	printf("%c\n", d[0]);
+	exit(EXIT_SUCCESS);
+}
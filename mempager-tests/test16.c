@@ -0,0 +1,51 @@
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// one page in the child, then the parent uses all other blocks
+// (blocks leased to the child in advance must be given back)
+// syslog past the last page fails
+int main(void) {
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	int up[2], down[2];
+	char c;
+	if(pipe(up) == -1 || pipe(down) == -1) exit(EXIT_FAILURE);
+	pid_t pid = fork();
+	if(pid == 0) {
+		uvm_create();
+		char *page = uvm_extend();
+		assert(page);
+		strcpy(page, "child");
+		if(write(up[1], "x", 1) != 1) exit(EXIT_FAILURE);
+		if(read(down[0], &c, 1) != 1) exit(EXIT_FAILURE);
+		uvm_syslog(page, 5);
+		exit(EXIT_SUCCESS);
+	}
+	if(read(up[0], &c, 1) != 1) exit(EXIT_FAILURE);
+	uvm_create();
+	int npages = 0;
+	char *first = NULL;
+	char *page;
+	while((page = uvm_extend()) != NULL) {
+		if(!first) first = page;
+		page[0] = 'a' + npages;
+		npages++;
+	}
+	assert(errno == ENOSPC);
+	printf("%d\n", npages);
+	uvm_syslog(first, 1);
+	uvm_syslog(first + (npages-1)*pagesz, 1);
+	int r = uvm_syslog(first + npages*pagesz, 1);
+	assert(r == -1 && errno == EINVAL);
+	if(write(down[1], "x", 1) != 1) exit(EXIT_FAILURE);
+	waitpid(pid, NULL, 0);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,38 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// write more pages than frames
+// dontneed discards contents
+// willneed reads pages back
+// sequential reads ahead on faults
+// invalid ranges and advice
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	int npages = 6;
+	char *base = uvm_extend_n(npages, 0);
+	assert(base);
+	for(int i = 0; i < npages; ++i) {
+		base[i*pagesz] = 'a' + i;
+	}
+	assert(uvm_advise(base, 2*pagesz, UVM_ADV_DONTNEED) == 0);
+	printf("%c%c\n", base[0], base[pagesz]);
+	assert(uvm_advise(base + 2*pagesz, 2*pagesz, UVM_ADV_WILLNEED) == 0);
+	printf("%c%c\n", base[2*pagesz], base[3*pagesz]);
+	assert(uvm_advise(base, npages*pagesz, UVM_ADV_SEQUENTIAL) == 0);
+	for(int i = 0; i < npages; ++i) {
+		printf("%c", base[i*pagesz]);
+	}
+	printf("\n");
+	int r = uvm_advise(base + npages*pagesz, 1, UVM_ADV_WILLNEED);
+	assert(r == -1 && errno == EINVAL);
+	r = uvm_advise(base, pagesz, 42);
+	assert(r == -1 && errno == EINVAL);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,42 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// use all blocks
+// shrink frees frames and blocks
+// pages come back zeroed
+// shrink past the end fails
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *base = uvm_extend();
+	int npages = 1;
+	while(uvm_extend()) npages++;
+	printf("%d\n", npages);
+	for(int i = 0; i < npages; ++i) {
+		base[i*pagesz] = 'a' + i;
+	}
+	assert(uvm_shrink(2) == 0);
+	int r = uvm_syslog(base + 2*pagesz, 1);
+	assert(r == -1 && errno == EINVAL);
+	char *page = uvm_extend();
+	assert(page == base + 2*pagesz);
+	int more = 1;
+	while(uvm_extend()) more++;
+	printf("%d\n", more);
+	char c0 = base[0];
+	char c1 = base[pagesz];
+	char c2 = page[0];
+	printf("%c%c%c\n", c0, c1, c2);
+	r = uvm_shrink(npages + 1);
+	assert(r == -1 && errno == EINVAL);
+	assert(uvm_shrink(0) == 0);
+	assert(uvm_extend() == base);
+	printf("%c\n", base[0]);
+	exit(EXIT_SUCCESS);
+}
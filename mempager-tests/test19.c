@@ -0,0 +1,31 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// run with ./mmu -o heuristic 4 8
+// more pages than blocks
+// write all pages, then read them twice
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *base = uvm_extend();
+	int npages = 1;
+	while(uvm_extend()) npages++;
+	assert(errno == ENOSPC);
+	printf("%d\n", npages);
+	for(int i = 0; i < npages; ++i) {
+		base[i*pagesz] = 'a' + i;
+	}
+	for(int j = 0; j < 2; ++j) {
+		for(int i = 0; i < npages; ++i) {
+			printf("%c", base[i*pagesz]);
+		}
+		printf("\n");
+	}
+	exit(EXIT_SUCCESS);
+}
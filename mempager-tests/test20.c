@@ -0,0 +1,37 @@
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// run with ./mmu -o unlimited 4 8
+// allocation does not fail
+// writing more pages than blocks and frames gets the child killed
+int main(void) {
+	pid_t pid = fork();
+	if(pid == 0) {
+		uvm_create();
+		size_t pagesz = sysconf(_SC_PAGESIZE);
+		int npages = 16;
+		char *base = uvm_extend_n(npages, 0);
+		assert(base);
+		for(int i = 0; i < npages; ++i) {
+			base[i*pagesz] = 'a' + i;
+		}
+		exit(EXIT_SUCCESS);
+	}
+	int status;
+	waitpid(pid, &status, 0);
+	if(WIFSIGNALED(status)) {
+		printf("killed by signal %d\n", WTERMSIG(status));
+	} else {
+		printf("exited with status %d\n", WEXITSTATUS(status));
+	}
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,35 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// the region holds 1024 pages (mmu -r 1024)
+// pages on both sides of a page-table leaf boundary
+// extending past the region fails
+// shrinking frees half the table, extending reuses it
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *base = uvm_extend_n(1024, 0);
+	assert(base);
+	assert(uvm_extend() == NULL && errno == ENOSPC);
+	int idx[] = { 0, 511, 512, 1023 };
+	for(int i = 0; i < 4; ++i) {
+		base[idx[i]*pagesz] = 'a' + i;
+	}
+	for(int i = 0; i < 4; ++i) {
+		uvm_syslog(base + idx[i]*pagesz, 1);
+	}
+	assert(uvm_shrink(512) == 0);
+	char *page = uvm_extend();
+	assert(page == base + 512*pagesz);
+	char c0 = base[0];
+	char c1 = base[511*pagesz];
+	char c2 = page[0];
+	printf("%c%c%c\n", c0, c1, c2);
+	exit(EXIT_SUCCESS);
+}
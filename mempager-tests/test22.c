@@ -0,0 +1,68 @@
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// run with ./mmu 5 8
+// minimums cannot reserve every frame
+// the parent replaces its own pages once it reaches its maximum
+// lowering the maximum pages the excess out
+// the child's two reserved frames are not taken from it
+int main(void) {
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	int up[2], down[2];
+	char c;
+	struct uvm_stat st;
+	if(pipe(up) == -1 || pipe(down) == -1) exit(EXIT_FAILURE);
+	pid_t pid = fork();
+	if(pid == 0) {
+		uvm_create();
+		assert(uvm_limit(2, 0) == 0);
+		char *page = uvm_extend_n(2, 0);
+		assert(page);
+		strcpy(page, "child0");
+		strcpy(page + pagesz, "child1");
+		if(write(up[1], "x", 1) != 1) exit(EXIT_FAILURE);
+		if(read(down[0], &c, 1) != 1) exit(EXIT_FAILURE);
+		uvm_syslog(page, 6);
+		uvm_syslog(page + pagesz, 6);
+		uvm_stat(&st);
+		printf("child resident %zu pageins %lu\n", st.resident, st.pageins);
+		exit(EXIT_SUCCESS);
+	}
+	if(read(up[0], &c, 1) != 1) exit(EXIT_FAILURE);
+	uvm_create();
+	int r = uvm_limit(3, 2);
+	assert(r == -1 && errno == EINVAL);
+	r = uvm_limit(3, 0);
+	assert(r == -1 && errno == EINVAL);
+	assert(uvm_limit(0, 3) == 0);
+	int npages = 4;
+	char *base = uvm_extend_n(npages, 0);
+	assert(base);
+	for(int i = 0; i < npages; ++i) {
+		base[i*pagesz] = 'a' + i;
+	}
+	uvm_stat(&st);
+	printf("parent resident %zu max %zu pageins %lu\n", st.resident,
+			st.max_frames, st.pageins);
+	assert(uvm_limit(0, 1) == 0);
+	uvm_stat(&st);
+	printf("parent resident %zu max %zu pageins %lu\n", st.resident,
+			st.max_frames, st.pageins);
+	assert(uvm_limit(0, 0) == 0);
+	printf("%c%c%c%c\n", base[0], base[pagesz], base[2*pagesz],
+			base[3*pagesz]);
+	uvm_stat(&st);
+	printf("parent resident %zu pageins %lu\n", st.resident, st.pageins);
+	if(write(down[1], "x", 1) != 1) exit(EXIT_FAILURE);
+	waitpid(pid, NULL, 0);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,53 @@
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// run with ./mmu -p 4 4 16
+// the child keeps touching its two pages, so the clock alone would
+// leave the parent two frames for the three pages it cycles over
+// PFF moves frames to whichever process faults more
+int num_rounds = 8;
+int main(void) {
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	int up[2], down[2];
+	char c;
+	if(pipe(up) == -1 || pipe(down) == -1) exit(EXIT_FAILURE);
+	pid_t pid = fork();
+	if(pid == 0) {
+		uvm_create();
+		char *page = uvm_extend_n(2, 0);
+		assert(page);
+		page[0] = 'x';
+		page[pagesz] = 'y';
+		int sum = 0;
+		for(int i = 0; i < num_rounds; ++i) {
+			if(write(up[1], "x", 1) != 1) exit(EXIT_FAILURE);
+			if(read(down[0], &c, 1) != 1) exit(EXIT_FAILURE);
+			sum += page[0] + page[pagesz];
+		}
+		printf("child %d\n", sum);
+		exit(EXIT_SUCCESS);
+	}
+	if(read(up[0], &c, 1) != 1) exit(EXIT_FAILURE);
+	uvm_create();
+	char *base = uvm_extend_n(3, 0);
+	assert(base);
+	for(int i = 0; i < num_rounds; ++i) {
+		if(i > 0 && read(up[0], &c, 1) != 1) exit(EXIT_FAILURE);
+		for(int j = 0; j < 3; ++j) {
+			base[j*pagesz] = 'a' + i;
+		}
+		if(write(down[1], "x", 1) != 1) exit(EXIT_FAILURE);
+	}
+	waitpid(pid, NULL, 0);
+	printf("%c%c%c\n", base[0], base[pagesz], base[2*pagesz]);
+	exit(EXIT_SUCCESS);
+}
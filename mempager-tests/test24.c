@@ -0,0 +1,46 @@
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// run with ./mmu -c 8 4 16
+// two processes cycling over three pages each do not fit in four
+// frames; load control suspends one while the other runs
+// contents survive the bulk eviction of the suspended process
+int num_forks = 2;
+int num_pages = 3;
+int num_loops = 64;
+int main(void) {
+	pid_t pids[num_forks];
+	for(int i = 0; i < num_forks; ++i) {
+		pids[i] = fork();
+		if(pids[i] != 0) continue;
+		uvm_create();
+		size_t pagesz = sysconf(_SC_PAGESIZE);
+		char *base = uvm_extend_n(num_pages, 0);
+		assert(base);
+		for(int j = 0; j < num_loops; ++j) {
+			for(int k = 0; k < num_pages; ++k) {
+				char *page = base + k*pagesz;
+				if(j > 0 && page[0] != 'a' + (j - 1 + k) % 26)
+					exit(EXIT_FAILURE);
+				page[0] = 'a' + (j + k) % 26;
+			}
+		}
+		exit(EXIT_SUCCESS);
+	}
+	for(int i = 0; i < num_forks; ++i) {
+		int status;
+		waitpid(pids[i], &status, 0);
+		printf("child %d: %s\n", i, WIFEXITED(status) &&
+				WEXITSTATUS(status) == EXIT_SUCCESS ? "ok" : "failed");
+	}
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,41 @@
+#include <sys/types.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// run with ./mmu 8 8
+// hibernating pages out every resident page, dirty or clean
+// the next fault brings them all back at once, the untouched page
+// included, so reading the others does not fault
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	struct uvm_stat st;
+	int npages = 5;
+	char *base = uvm_extend_n(npages, 0);
+	assert(base);
+	for(int i = 0; i < npages - 1; ++i) {
+		base[i*pagesz] = 'a' + i;
+	}
+	printf("%c\n", base[(npages - 1)*pagesz]);
+	uvm_stat(&st);
+	printf("resident %zu\n", st.resident);
+	printf("hibernated %d\n", uvm_hibernate());
+	uvm_stat(&st);
+	printf("resident %zu evictions %lu\n", st.resident, st.evictions);
+	printf("%c\n", base[pagesz]);
+	uvm_stat(&st);
+	printf("resident %zu pageins %lu\n", st.resident, st.pageins);
+	for(int i = 0; i < npages - 1; ++i) {
+		printf("%c", base[i*pagesz]);
+	}
+	printf("\n");
+	uvm_stat(&st);
+	printf("resident %zu pageins %lu\n", st.resident, st.pageins);
+	exit(EXIT_SUCCESS);
+}
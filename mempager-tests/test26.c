@@ -0,0 +1,62 @@
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// run with ./mmu 8 32
+// the processes take turns allocating pages, but each one's pages get
+// consecutive blocks in its own extent, so hibernating and waking move
+// each process's pages with a single disk request
+int num_pages = 3;
+int main(void) {
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	int up[2], down[2];
+	char c;
+	if(pipe(up) == -1 || pipe(down) == -1) exit(EXIT_FAILURE);
+	pid_t pid = fork();
+	if(pid == 0) {
+		uvm_create();
+		if(write(up[1], "x", 1) != 1) exit(EXIT_FAILURE);
+		char *page[num_pages];
+		for(int i = 0; i < num_pages; ++i) {
+			if(read(down[0], &c, 1) != 1) exit(EXIT_FAILURE);
+			page[i] = uvm_extend();
+			assert(page[i]);
+			page[i][0] = 'A' + i;
+			if(write(up[1], "x", 1) != 1) exit(EXIT_FAILURE);
+		}
+		if(read(down[0], &c, 1) != 1) exit(EXIT_FAILURE);
+		uvm_hibernate();
+		for(int i = 0; i < num_pages; ++i) {
+			assert(page[i] == page[0] + i*pagesz);
+			printf("%c", page[i][0]);
+		}
+		printf("\n");
+		exit(EXIT_SUCCESS);
+	}
+	if(read(up[0], &c, 1) != 1) exit(EXIT_FAILURE);
+	uvm_create();
+	char *page[num_pages];
+	for(int i = 0; i < num_pages; ++i) {
+		page[i] = uvm_extend();
+		assert(page[i]);
+		page[i][0] = 'a' + i;
+		if(write(down[1], "x", 1) != 1) exit(EXIT_FAILURE);
+		if(read(up[0], &c, 1) != 1) exit(EXIT_FAILURE);
+	}
+	uvm_hibernate();
+	for(int i = 0; i < num_pages; ++i) {
+		printf("%c", page[i][0]);
+	}
+	printf("\n");
+	fflush(stdout);
+	if(write(down[1], "x", 1) != 1) exit(EXIT_FAILURE);
+	waitpid(pid, NULL, 0);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,33 @@
+#include <sys/types.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// run with ./mmu 4 8
+// a dirty page holding only '0' is not written back, nor is a dirty
+// page holding what its block already has
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	struct uvm_stat st;
+	char *base = uvm_extend_n(3, 0);
+	assert(base);
+	base[0] = 'a';
+	base[pagesz] = '0';
+	uvm_hibernate();
+	uvm_stat(&st);
+	printf("writes %lu skipped %lu\n", st.writes, st.writes_skipped);
+	printf("%c%c\n", base[0], base[pagesz]);
+	base[0] = 'a';
+	base[pagesz] = 'x';
+	uvm_hibernate();
+	uvm_stat(&st);
+	printf("writes %lu skipped %lu\n", st.writes, st.writes_skipped);
+	printf("%c%c%c\n", base[0], base[pagesz], base[2*pagesz]);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,41 @@
+#include <sys/types.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// run with ./mmu -z 2 4 8
+// frames freed by evictions and discarded pages are zeroed in the
+// background; new pages that take them still read only '0', and
+// pages paged back in keep their contents
+int num_pages = 6;
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	char *base = uvm_extend_n(num_pages, 0);
+	assert(base);
+	for(int round = 0; round < 2; ++round) {
+		int zeroed = 0;
+		for(int i = 0; i < num_pages; ++i) {
+			char *page = base + i*pagesz;
+			size_t j = 0;
+			while(j < pagesz && page[j] == '0') j++;
+			zeroed += j == pagesz;
+			memset(page, 'a' + i, pagesz / 2);
+			usleep(10000);
+		}
+		int kept = 0;
+		for(int i = 0; i < num_pages; ++i) {
+			kept += base[i*pagesz] == 'a' + i &&
+					base[i*pagesz + pagesz/2] == '0';
+		}
+		printf("zeroed %d kept %d\n", zeroed, kept);
+		uvm_advise(base, num_pages*pagesz, UVM_ADV_DONTNEED);
+		usleep(10000);
+	}
+	exit(EXIT_SUCCESS);
+}
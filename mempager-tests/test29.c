@@ -0,0 +1,51 @@
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mmustat.h"
+#include "uvm.h"
+
+// run with ./mmu 4 8
+// the statistics segment counts the process's resident pages and
+// classifies its faults
+static uint64_t counter(const struct mmu_stat_seg *seg, int k) {
+	return __atomic_load_n(&seg->counters[k].value, __ATOMIC_RELAXED);
+}
+static int resident(const struct mmu_stat_seg *seg) {
+	for(int i = 0; i < MMU_STAT_MAXPROCS; ++i) {
+		if(seg->procs[i].pid == getpid()) return seg->procs[i].resident;
+	}
+	return -1;
+}
+int main(void) {
+	uvm_create();
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	int fd = open(MMU_STAT_PATH, O_RDONLY);
+	assert(fd != -1);
+	const struct mmu_stat_seg *seg = mmap(NULL, sizeof(*seg), PROT_READ,
+			MAP_SHARED, fd, 0);
+	assert(seg != MAP_FAILED);
+	assert(memcmp(seg->magic, MMU_STAT_MAGIC, sizeof(seg->magic)) == 0);
+	uint64_t zero = counter(seg, MMU_STAT_FAULT_ZERO);
+	uint64_t major = counter(seg, MMU_STAT_FAULT_MAJOR);
+	uint64_t dirty = counter(seg, MMU_STAT_EVICT_DIRTY);
+
+	char *base = uvm_extend_n(5, 0);
+	assert(base);
+	for(int i = 0; i < 3; ++i) base[i*pagesz] = 'a' + i;
+	printf("resident %d\n", resident(seg));
+	for(int i = 3; i < 5; ++i) base[i*pagesz] = 'a' + i;
+	printf("resident %d\n", resident(seg));
+	printf("%c\n", base[0]);
+	printf("zero %lu major %lu dirty %lu\n",
+			(unsigned long)(counter(seg, MMU_STAT_FAULT_ZERO) - zero),
+			(unsigned long)(counter(seg, MMU_STAT_FAULT_MAJOR) - major),
+			(unsigned long)(counter(seg, MMU_STAT_EVICT_DIRTY) - dirty));
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,55 @@
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <assert.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+// run with ./mmu 4 16
+// the child is stopped, so the MMU waits for it to acknowledge the
+// eviction of its pages while the parent faults; killing the child
+// then must not hang the MMU
+int main(void) {
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	int up[2];
+	char c;
+	if(pipe(up) == -1) exit(EXIT_FAILURE);
+	pid_t pid = fork();
+	if(pid == 0) {
+		uvm_create();
+		char *page = uvm_extend_n(2, 0);
+		assert(page);
+		page[0] = 'x';
+		page[pagesz] = 'y';
+		if(write(up[1], "x", 1) != 1) exit(EXIT_FAILURE);
+		for(;;) pause();
+	}
+	if(read(up[0], &c, 1) != 1) exit(EXIT_FAILURE);
+	kill(pid, SIGSTOP);
+	waitpid(pid, NULL, WUNTRACED);
+	pid_t killer = fork();
+	if(killer == 0) {
+		usleep(200000);
+		kill(pid, SIGKILL);
+		exit(EXIT_SUCCESS);
+	}
+	uvm_create();
+	int npages = 4;
+	char *base = uvm_extend_n(npages, 0);
+	assert(base);
+	for(int i = 0; i < npages; ++i) {
+		base[i*pagesz] = 'a' + i;
+	}
+	waitpid(killer, NULL, 0);
+	int status;
+	waitpid(pid, &status, 0);
+	printf("%c%c%c%c\n", base[0], base[pagesz], base[2*pagesz],
+			base[3*pagesz]);
+	printf("child %s\n", WIFSIGNALED(status) ? "killed" : "exited");
+	exit(EXIT_SUCCESS);
+}
@@ -10,3 +10,21 @@
 10 4 8 0
 11 2 3 1
 12 256 1024 1
+13 4 8 1
+14 2 8 0
+15 4 8 0
+16 4 8 0
+17 4 8 0
+18 4 8 0
+19 4 8 0 -o heuristic
+20 4 8 0 -o unlimited
+21 4 8 0 -o unlimited -r 1024
+22 5 8 0
+23 4 16 0 -p 4
+24 4 16 1 -c 8
+25 8 8 0
+26 8 32 0
+27 4 8 0
+28 4 8 1 -z 2
+29 4 8 0
+30 4 16 1
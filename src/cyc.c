@@ -3,6 +3,10 @@
 #include <errno.h>
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "cyc.h"
@@ -11,9 +15,21 @@
  * cyclic struct and function declarations
  ****************************************************************************/
 #define CYCLIC_LINEBUF 1024
+#define CYCLIC_TBUF (64*1024)
 #define CYC_FILESIZE (1<<0)
 #define CYC_PERIODIC (1<<1)
 
+/* Per-thread buffer for asynchronous mode.  The owner thread appends
+ * whole lines and advances `head`; the flusher thread writes them to
+ * the file and advances `tail`. */
+struct cyc_tbuf {
+	char data[CYCLIC_TBUF];
+	uint64_t head;
+	uint64_t tail;
+	int dead;                   /* owner thread exited */
+	struct cyc_tbuf *next;
+};
+
 struct cyclic {
 	int type;
 	char *prefix;
@@ -22,14 +38,29 @@ struct cyclic {
 	unsigned period;
 	time_t period_start;
 	FILE *file;
+	long fsize;                 /* bytes written to the current file */
 	pthread_mutex_t lock;
 	pthread_mutex_t mutex;
 	int flock;
+	/* asynchronous mode: */
+	int async;
+	int running;
+	unsigned flush_ms;
+	unsigned flush_bytes;
+	pthread_key_t key;
+	struct cyc_tbuf *tbufs;     /* protected by `mutex` */
+	pthread_t flusher;
+	pthread_mutex_t kick_mutex;
+	pthread_cond_t kick;
 };
 
 static int cyc_check_open_file(struct cyclic *cyc);
 static int cyc_open_periodic(struct cyclic *cyc);
 static int cyc_open_filesize(struct cyclic *cyc);
+static int cyc_async_vprintf(struct cyclic *cyc, const char *fmt, va_list ap);
+static void cyc_async_drain(struct cyclic *cyc);
+static void * cyc_async_flusher(void *vcyc);
+static void cyc_async_thread_exit(void *vtbuf);
 
 /*****************************************************************************
  * cyclic function implementations
@@ -48,6 +79,9 @@ struct cyclic * cyc_init_periodic(const char *prefix, unsigned period) /* {{{ */
 	cyc->period = period;
 	cyc->period_start = 0;
 	cyc->file = NULL;
+	cyc->fsize = 0;
+	cyc->async = 0;
+	cyc->tbufs = NULL;
 	if(pthread_mutex_init(&(cyc->lock), NULL)) goto out;
 	if(pthread_mutex_init(&(cyc->mutex), NULL)) goto out;
 	cyc->flock = 0;
@@ -75,6 +109,9 @@ struct cyclic * cyc_init_filesize(const char *prefix, /* {{{ */
 	cyc->period = -1;
 	cyc->period_start = -1;
 	cyc->file = NULL;
+	cyc->fsize = 0;
+	cyc->async = 0;
+	cyc->tbufs = NULL;
 	if(pthread_mutex_init(&(cyc->lock), NULL)) goto out;
 	if(pthread_mutex_init(&(cyc->mutex), NULL)) goto out;
 	cyc->flock = 0;
@@ -89,6 +126,24 @@ struct cyclic * cyc_init_filesize(const char *prefix, /* {{{ */
 
 void cyc_destroy(struct cyclic *cyc) /* {{{ */
 {
+	if(cyc->async) {
+		pthread_mutex_lock(&cyc->kick_mutex);
+		cyc->running = 0;
+		pthread_cond_signal(&cyc->kick);
+		pthread_mutex_unlock(&cyc->kick_mutex);
+		pthread_join(cyc->flusher, NULL);
+		pthread_mutex_lock(&cyc->mutex);
+		cyc_async_drain(cyc);
+		pthread_mutex_unlock(&cyc->mutex);
+		pthread_key_delete(cyc->key);
+		while(cyc->tbufs) {
+			struct cyc_tbuf *next = cyc->tbufs->next;
+			free(cyc->tbufs);
+			cyc->tbufs = next;
+		}
+		pthread_cond_destroy(&cyc->kick);
+		pthread_mutex_destroy(&cyc->kick_mutex);
+	}
 	if(cyc->file) {
 		int oldstate;
 		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldstate);
@@ -100,22 +155,37 @@ void cyc_destroy(struct cyclic *cyc) /* {{{ */
 	free(cyc);
 } /* }}} */
 
+int cyc_async(struct cyclic *cyc, unsigned flush_ms, /* {{{ */
+		unsigned flush_bytes)
+{
+	if(cyc->async) return 1;
+	if(flush_ms == 0) flush_ms = 1;
+	if(flush_bytes == 0 || flush_bytes > CYCLIC_TBUF / 2)
+		flush_bytes = CYCLIC_TBUF / 2;
+	cyc->flush_ms = flush_ms;
+	cyc->flush_bytes = flush_bytes;
+	cyc->running = 1;
+	if(pthread_key_create(&cyc->key, cyc_async_thread_exit)) return 0;
+	if(pthread_mutex_init(&cyc->kick_mutex, NULL)) return 0;
+	if(pthread_cond_init(&cyc->kick, NULL)) return 0;
+	pthread_mutex_lock(&cyc->mutex);
+	/* switch the current file to full buffering */
+	if(cyc->file) fflush(cyc->file);
+	cyc->async = 1;
+	pthread_mutex_unlock(&cyc->mutex);
+	if(pthread_create(&cyc->flusher, NULL, cyc_async_flusher, cyc)) {
+		cyc->async = 0;
+		return 0;
+	}
+	return 1;
+} /* }}} */
+
 int cyc_printf(struct cyclic *cyc, const char *fmt, ...) /* {{{ */
 {
-	char line[CYCLIC_LINEBUF];
 	va_list ap;
-	int oldstate;
-	int cnt = 0;
+	int cnt;
 	va_start(ap, fmt);
-	pthread_mutex_lock(&cyc->mutex);
-	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldstate);
-	if(cyc_check_open_file(cyc)) {
-		vsnprintf(line, CYCLIC_LINEBUF, fmt, ap);
-		cnt = fputs(line, cyc->file);
-		fflush(cyc->file);
-	}
-	pthread_setcancelstate(oldstate, &oldstate);
-	pthread_mutex_unlock(&cyc->mutex);
+	cnt = cyc_vprintf(cyc, fmt, ap);
 	va_end(ap);
 	return cnt;
 } /* }}} */
@@ -125,11 +195,13 @@ int cyc_vprintf(struct cyclic *cyc, const char *fmt, va_list ap) /* {{{ */
 	char line[CYCLIC_LINEBUF];
 	int oldstate;
 	int cnt = 0;
+	if(cyc->async) return cyc_async_vprintf(cyc, fmt, ap);
 	pthread_mutex_lock(&cyc->mutex);
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldstate);
 	if(cyc_check_open_file(cyc)) {
 		vsnprintf(line, CYCLIC_LINEBUF, fmt, ap);
 		cnt = fputs(line, cyc->file);
+		if(cnt >= 0) cyc->fsize += strlen(line);
 		fflush(cyc->file);
 	}
 	pthread_setcancelstate(oldstate, &oldstate);
@@ -141,6 +213,7 @@ void cyc_flush(struct cyclic *cyc) /* {{{ */
 {
 	int oldstate;
 	pthread_mutex_lock(&cyc->mutex);
+	if(cyc->async) cyc_async_drain(cyc);
 	if(!cyc->file) {
 		pthread_mutex_unlock(&cyc->mutex);
 		return;
@@ -182,7 +255,7 @@ static int cyc_check_open_file(struct cyclic *cyc) /* {{{ */
 			break;
 		}
 		case CYC_FILESIZE: {
-			if(!cyc->file || ftell(cyc->file) > cyc->maxsize) {
+			if(!cyc->file || cyc->fsize > cyc->maxsize) {
 				return cyc_open_filesize(cyc);
 			}
 			break;
@@ -212,7 +285,8 @@ static int cyc_open_periodic(struct cyclic *cyc) /* {{{ */
 	cyc->file = fopen(fname, "w");
 	free(fname);
 	if(!cyc->file) return 0;
-	setvbuf(cyc->file, NULL, _IOLBF, 0);
+	cyc->fsize = 0;
+	setvbuf(cyc->file, NULL, cyc->async ? _IOFBF : _IOLBF, BUFSIZ);
 	return 1;
 } /* }}} */
 
@@ -241,7 +315,8 @@ static int cyc_open_filesize(struct cyclic *cyc) /* {{{ */
 	cyc->file = fopen(fname, "w");
 	free(fname);
 	if(!cyc->file) return 0;
-	if(setvbuf(cyc->file, NULL, _IOLBF, 0));
+	cyc->fsize = 0;
+	if(setvbuf(cyc->file, NULL, cyc->async ? _IOFBF : _IOLBF, BUFSIZ));
 	return 1;
 
 	out_fname:
@@ -250,3 +325,112 @@ static int cyc_open_filesize(struct cyclic *cyc) /* {{{ */
 	errno = tmp; }
 	return 0;
 } /* }}} */
+
+/*****************************************************************************
+ * asynchronous mode
+ ****************************************************************************/
+static int cyc_async_vprintf(struct cyclic *cyc, const char *fmt, /* {{{ */
+		va_list ap)
+{
+	struct cyc_tbuf *tb = pthread_getspecific(cyc->key);
+	if(!tb) {
+		tb = calloc(1, sizeof(*tb));
+		if(!tb) return 0;
+		pthread_setspecific(cyc->key, tb);
+		pthread_mutex_lock(&cyc->mutex);
+		tb->next = cyc->tbufs;
+		cyc->tbufs = tb;
+		pthread_mutex_unlock(&cyc->mutex);
+	}
+
+	char line[CYCLIC_LINEBUF];
+	int cnt = vsnprintf(line, CYCLIC_LINEBUF, fmt, ap);
+	if(cnt < 0) return 0;
+	if(cnt >= CYCLIC_LINEBUF) cnt = CYCLIC_LINEBUF - 1;
+
+	uint64_t head = tb->head;
+	while(head + cnt - __atomic_load_n(&tb->tail, __ATOMIC_ACQUIRE)
+			> CYCLIC_TBUF) {
+		/* buffer full; wake the flusher and wait for space */
+		if(!__atomic_load_n(&cyc->running, __ATOMIC_ACQUIRE)) return 0;
+		pthread_cond_signal(&cyc->kick);
+		sched_yield();
+	}
+	size_t idx = head % CYCLIC_TBUF;
+	size_t first = CYCLIC_TBUF - idx;
+	if(first > (size_t)cnt) first = cnt;
+	memcpy(tb->data + idx, line, first);
+	memcpy(tb->data, line + first, cnt - first);
+	__atomic_store_n(&tb->head, head + cnt, __ATOMIC_RELEASE);
+
+	if(head + cnt - __atomic_load_n(&tb->tail, __ATOMIC_RELAXED)
+			>= cyc->flush_bytes) {
+		pthread_cond_signal(&cyc->kick);
+	}
+	return cnt ? cnt : 1;
+} /* }}} */
+
+/* Writes pending lines from all thread buffers to the file, rotating
+ * it when needed.  Called with `cyc->mutex` locked. */
+static void cyc_async_drain(struct cyclic *cyc) /* {{{ */
+{
+	int oldstate;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldstate);
+	struct cyc_tbuf **prev = &cyc->tbufs;
+	while(*prev) {
+		struct cyc_tbuf *tb = *prev;
+		int dead = __atomic_load_n(&tb->dead, __ATOMIC_ACQUIRE);
+		uint64_t head = __atomic_load_n(&tb->head, __ATOMIC_ACQUIRE);
+		uint64_t tail = tb->tail;
+		/* buffers only hold whole lines, so rotating here never
+		 * splits a line across files */
+		if(tail != head && cyc_check_open_file(cyc)) {
+			while(tail != head) {
+				size_t idx = tail % CYCLIC_TBUF;
+				size_t n = head - tail;
+				if(idx + n > CYCLIC_TBUF) n = CYCLIC_TBUF - idx;
+				fwrite(tb->data + idx, 1, n, cyc->file);
+				cyc->fsize += n;
+				tail += n;
+			}
+		}
+		__atomic_store_n(&tb->tail, head, __ATOMIC_RELEASE);
+		if(dead) {
+			*prev = tb->next;
+			free(tb);
+			continue;
+		}
+		prev = &tb->next;
+	}
+	if(cyc->file) fflush(cyc->file);
+	pthread_setcancelstate(oldstate, &oldstate);
+} /* }}} */
+
+static void * cyc_async_flusher(void *vcyc) /* {{{ */
+{
+	struct cyclic *cyc = vcyc;
+	pthread_mutex_lock(&cyc->kick_mutex);
+	while(cyc->running) {
+		struct timeval now;
+		struct timespec deadline;
+		gettimeofday(&now, NULL);
+		uint64_t ns = (uint64_t)now.tv_usec * 1000 +
+				(uint64_t)cyc->flush_ms * 1000000;
+		deadline.tv_sec = now.tv_sec + ns / 1000000000;
+		deadline.tv_nsec = ns % 1000000000;
+		pthread_cond_timedwait(&cyc->kick, &cyc->kick_mutex, &deadline);
+		pthread_mutex_unlock(&cyc->kick_mutex);
+		pthread_mutex_lock(&cyc->mutex);
+		cyc_async_drain(cyc);
+		pthread_mutex_unlock(&cyc->mutex);
+		pthread_mutex_lock(&cyc->kick_mutex);
+	}
+	pthread_mutex_unlock(&cyc->kick_mutex);
+	return NULL;
+} /* }}} */
+
+static void cyc_async_thread_exit(void *vtbuf) /* {{{ */
+{
+	struct cyc_tbuf *tb = vtbuf;
+	__atomic_store_n(&tb->dead, 1, __ATOMIC_RELEASE);
+} /* }}} */
@@ -29,6 +29,15 @@ struct cyclic * cyc_init_periodic(const char *prefix, unsigned period);
 struct cyclic * cyc_init_filesize(const char *prefix, unsigned nbackups,
 		unsigned maxsize);
 
+/* This function switches the handle to asynchronous mode.  In asynchronous
+ * mode, cyc_printf and cyc_vprintf format messages into a per-thread buffer
+ * without taking locks, and a background thread writes buffered messages to
+ * the file every =flush_ms= milliseconds or as soon as a thread buffers
+ * =flush_bytes= bytes.  File rotation is done by the background thread.
+ * cyc_flush writes all buffered messages before returning.  Returns zero if
+ * the background thread cannot be started. */
+int cyc_async(struct cyclic *cyc, unsigned flush_ms, unsigned flush_bytes);
+
 /* This function closes the cyclic file handle and frees used memory. */
 void cyc_destroy(struct cyclic *cyc);
 
@@ -36,7 +45,7 @@ void cyc_destroy(struct cyclic *cyc);
  * of bytes written.  File age and file size, depending on the type of cyclic
  * handle, are checked before printing the message.  This guarantees that that
  * the whole message will be in one file.  These functions flush the output
- * files to disk. */
+ * files to disk, unless the handle is in asynchronous mode. */
 int cyc_printf(struct cyclic *cyc, const char *fmt, ...);
 int cyc_vprintf(struct cyclic *cyc, const char *fmt, va_list ap);
 
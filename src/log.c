@@ -42,7 +42,13 @@ void log_flush(void)
 	cyc_flush(cyc);
 }
 
-void logd(unsigned int verbosity, const char *fmt, ...)
+void log_async(unsigned flush_ms, unsigned flush_bytes)
+{
+	if(!cyc) return;
+	if(!cyc_async(cyc, flush_ms, flush_bytes)) log_error(__FILE__, __LINE__);
+}
+
+void (logd)(unsigned int verbosity, const char *fmt, ...)
 {
 	if(!cyc) return;
 	va_list ap;
@@ -52,7 +58,7 @@ void logd(unsigned int verbosity, const char *fmt, ...)
 	va_end(ap);
 }
 
-void loge(unsigned verbosity, const char *file, int lineno)
+void (loge)(unsigned verbosity, const char *file, int lineno)
 {
 	if(!cyc) return;
 	if(verbosity > log_verbosity) return;
@@ -77,6 +83,7 @@ void logea(const char *file, int lineno, const char *msg)
 	}
 	errno = myerrno;
 	loge(0, file, lineno);
+	cyc_flush(cyc);
 	exit(EXIT_FAILURE);
 }
 
@@ -22,6 +22,13 @@
 #define LOG_DEBUG 500
 #define LOG_EXTRA 1000
 
+/* Calls to =logd= and =loge= with verbosity above =LOG_MAX_VERBOSITY= are
+ * removed at compile time.  Define it (e.g., -DLOG_MAX_VERBOSITY=LOG_INFO) to
+ * drop debug messages from hot paths. */
+#ifndef LOG_MAX_VERBOSITY
+#define LOG_MAX_VERBOSITY LOG_EXTRA
+#endif
+
 /* This function initializes the global logger.  The parameter =verbosity=
  * specifies what gets printed; calls to =logd=, =loge=, and =logea= with lower
  * =verbosity= values will print messages.  The variable =prefix= controls the
@@ -34,15 +41,31 @@ void log_init(unsigned verbosity, const char *prefix, unsigned nbackups,
 void log_destroy(void);
 void log_flush(void);
 
+/* This function switches the logger to asynchronous mode: messages are
+ * buffered per thread and written by a background thread every =flush_ms=
+ * milliseconds or whenever a thread buffers =flush_bytes= bytes.  See
+ * cyc_async.  Call log_flush or log_destroy to write pending messages. */
+void log_async(unsigned flush_ms, unsigned flush_bytes);
+#define LOG_ASYNC_FLUSH_MS 100
+#define LOG_ASYNC_FLUSH_BYTES (16*1024)
+
 /* This function functions like printf and logs a message if its =verbosity= is
  * lower than that passed to =log_init=. */
-void logd(unsigned verbosity, const char *fmt, ...);
+void (logd)(unsigned verbosity, const char *fmt, ...);
+#define logd(verbosity, ...) do { \
+	if((verbosity) <= LOG_MAX_VERBOSITY) \
+		(logd)((verbosity), __VA_ARGS__); \
+} while(0)
 
 /* This functions prints an error message (built with strerror) if =ernno= is
  * set and =verbosity= is lower than that passed to =log_init=.  It should be
  * called with the file name and line number where the error occurred (use the
  * __FILE__ and __LINE__ macros). */
-void loge(unsigned verbosity, const char *file, int lineno);
+void (loge)(unsigned verbosity, const char *file, int lineno);
+#define loge(verbosity, file, lineno) do { \
+	if((verbosity) <= LOG_MAX_VERBOSITY) \
+		(loge)((verbosity), (file), (lineno)); \
+} while(0)
 
 /* Like loge, except it always prints the error message if =errno= is set.
  * This function also prints =msg= and calls =exit= to end the program. */
@@ -1,3 +1,6 @@
+#define _GNU_SOURCE
+
+#include <sys/eventfd.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -7,24 +10,36 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "log.h"
 
+#include "mmu.h"
+#include "mmuio.h"
+#include "mmupage.h"
+#include "mmustat.h"
+#include "mmutrace.h"
 #include "pager.h"
 #include "mmuproto.h"
 
 #define MMU_MAX_EVENTS 32
-#define MMU_MAX_SOCK 1024
-
-
-pid_t id2pid[UINT8_MAX];
-uint8_t nextid = 0;
+#define MMU_INIT_SOCK 64
+#define MMU_INIT_BUCKETS 64
+#define MMU_MAX_FRAMES (1 << 24)
+#define MMU_MAX_BLOCKS (1 << 28)
+#define MMU_HUGE_FRAME ((size_t)2 << 20)
+/* <sys/mman.h> only has the hugetlb size flags with newer glibc */
+#ifndef MFD_HUGE_2MB
+#define MFD_HUGE_2MB (21 << 26)
+#endif
 
 /****************************************************************************
  * structure definitions and static variables
@@ -34,20 +49,86 @@ struct mmu_data {/*{{{*/
 	int npages;
 	char *pmem;
 	char *disk;
+	int disk_fd;
+	int nblocks;
+	struct mmu_io *io;
 	char *pmem_fn;
 	int pmem_fd;
+	int huge;                   /* pmem backed by huge frames */
 	int sock;
-	struct mmu_client * sock2client[MMU_MAX_SOCK];
+	int track_ms;               /* access sampling period, 0 if off */
+	int lease;                  /* pages per extend lease, 0 if off */
+	int region;                 /* pages in each client's UVM region */
+	int idle_ms;                /* hibernate idle clients, 0 if off */
+	struct mmu_stat_seg *stats; /* statistics segment (see mmustat.h) */
+	struct mmu_registry *reg;
 };/*}}}*/
 struct mmu_client {/*{{{*/
 	int running;
 	int sock;
 	pid_t pid;
+	int id;
+	int track;                  /* client tracks page state */
+	int killed;                 /* killed by `mmu_oom_kill` or found dead
+	                             * from pager context */
+	int idle;                   /* hibernated for being idle */
 	pthread_t thread;
+	struct mmu_client *hnext;   /* next client in `pid2client` bucket */
+	/* Requests received while waiting for a REMAP or CHPROT
+	 * acknowledgement are stashed (whole messages, in order) and
+	 * serviced later by the client thread.  `rxlock` serializes
+	 * reads from `sock` and access to the stash; `wakefd` wakes
+	 * the client thread when requests are stashed. */
+	pthread_mutex_t rxlock;
+	char *stash;
+	size_t stashlen;
+	size_t stashcap;
+	int wakefd;
+	/* page-state table shared with the client */
+	int state_fd;
+	struct mmu_proto_page_state *state;
+	size_t nstate;
+	/* Extend lease at the end of the page-state table.  The client
+	 * only increments `used`; `lease_mutex` serializes grants and
+	 * revocations, which move `end` and allocate or free the pages
+	 * after it with the pager. */
+	uint64_t *lease;
+	pthread_mutex_t lease_mutex;
+};/*}}}*/
+union mmu_proto_req {/*{{{*/
+	uint32_t type;
+	struct mmu_proto_create_req create;
+	struct mmu_proto_extend_req extend;
+	struct mmu_proto_extend_n_req extend_n;
+	struct mmu_proto_syslog_req syslog;
+	struct mmu_proto_advise_req advise;
+	struct mmu_proto_shrink_req shrink;
+	struct mmu_proto_limit_req limit;
+	struct mmu_proto_stat_req stat;
+	struct mmu_proto_hibernate_req hibernate;
+	struct mmu_proto_segv_req segv;
+	struct mmu_proto_remap_req remap;
+	struct mmu_proto_chprot_req chprot;
+	struct mmu_proto_exit_req exit;
+};/*}}}*/
+/* The registry maps sockets and PIDs to clients.  `sock2client` is
+ * indexed by file descriptor and grows as needed.  `pid2client` is
+ * a chained hash table keyed by PID.  Clients get the lowest unused
+ * id when they send CREATE_REQ; ids are released when the client is
+ * destroyed or exits and are what the MMU prints as "pid". */
+struct mmu_registry {/*{{{*/
+	pthread_mutex_t mutex;
+	struct mmu_client **sock2client;
+	int nsock;
+	struct mmu_client **pid2client;
+	size_t nbuckets;
+	size_t nclients;
+	unsigned char *idused;
+	int nids;
+	int idhint;                 /* no id below `idhint` is free */
 };/*}}}*/
 static struct mmu_data *mmu = NULL;
 const char *pmem = NULL;
-static size_t PAGESIZE = 0;
 
 /****************************************************************************
  * static function declarations
@@ -58,47 +139,217 @@ static void mmu_shutdown_action(int signum, siginfo_t *si, void *context);
 static void mmu_accept_loop(void);
 static void * mmu_client_thread(void *vclient);
 
-int get_pid_id(pid_t pid) {
-	int i = 0;
-	for(; id2pid[i] != pid; i++);
-	return i;
-}
+/****************************************************************************
+ * client registry {{{
+ ***************************************************************************/
+static struct mmu_registry * mmu_registry_init(void);
+static void mmu_registry_destroy(struct mmu_registry *reg);
+static void mmu_registry_add_sock(struct mmu_client *c);
+static void mmu_registry_add_pid(struct mmu_client *c);
+static void mmu_registry_remove(struct mmu_client *c);
+static struct mmu_stat_proc * mmu_stat_proc(int id);
+
+static size_t mmu_registry_bucket(size_t nbuckets, pid_t pid)/*{{{*/
+{
+	/* Fibonacci hashing; nbuckets is a power of two */
+	uint32_t h = (uint32_t)pid * 2654435769u;
+	return (size_t)h & (nbuckets - 1);
+}/*}}}*/
+
+struct mmu_registry * mmu_registry_init(void)/*{{{*/
+{
+	struct mmu_registry *reg = malloc(sizeof(*reg));
+	if(!reg) logea(__FILE__, __LINE__, NULL);
+	pthread_mutex_init(&reg->mutex, NULL);
+	reg->nsock = MMU_INIT_SOCK;
+	reg->sock2client = calloc(reg->nsock, sizeof(reg->sock2client[0]));
+	reg->nbuckets = MMU_INIT_BUCKETS;
+	reg->pid2client = calloc(reg->nbuckets, sizeof(reg->pid2client[0]));
+	reg->nclients = 0;
+	reg->nids = MMU_INIT_SOCK;
+	reg->idused = calloc(reg->nids, sizeof(reg->idused[0]));
+	reg->idhint = 0;
+	if(!reg->sock2client || !reg->pid2client || !reg->idused)
+		logea(__FILE__, __LINE__, NULL);
+	return reg;
+}/*}}}*/
+
+void mmu_registry_destroy(struct mmu_registry *reg)/*{{{*/
+{
+	pthread_mutex_destroy(&reg->mutex);
+	free(reg->sock2client);
+	free(reg->pid2client);
+	free(reg->idused);
+	free(reg);
+}/*}}}*/
+
+void mmu_registry_add_sock(struct mmu_client *c)/*{{{*/
+{
+	struct mmu_registry *reg = mmu->reg;
+	pthread_mutex_lock(&reg->mutex);
+	if(c->sock >= reg->nsock) {
+		int nsock = reg->nsock;
+		while(nsock <= c->sock) nsock *= 2;
+		struct mmu_client **s2c = realloc(reg->sock2client,
+				nsock * sizeof(s2c[0]));
+		if(!s2c) logea(__FILE__, __LINE__, NULL);
+		memset(s2c + reg->nsock, 0,
+				(nsock - reg->nsock) * sizeof(s2c[0]));
+		reg->sock2client = s2c;
+		reg->nsock = nsock;
+	}
+	reg->sock2client[c->sock] = c;
+	pthread_mutex_unlock(&reg->mutex);
+}/*}}}*/
+
+/* Called with `reg->mutex` locked. */
+static void mmu_registry_rehash(struct mmu_registry *reg)/*{{{*/
+{
+	size_t nbuckets = reg->nbuckets * 2;
+	struct mmu_client **p2c = calloc(nbuckets, sizeof(p2c[0]));
+	if(!p2c) logea(__FILE__, __LINE__, NULL);
+	for(size_t i = 0; i < reg->nbuckets; ++i) {
+		struct mmu_client *c = reg->pid2client[i];
+		while(c) {
+			struct mmu_client *next = c->hnext;
+			size_t b = mmu_registry_bucket(nbuckets, c->pid);
+			c->hnext = p2c[b];
+			p2c[b] = c;
+			c = next;
+		}
+	}
+	free(reg->pid2client);
+	reg->pid2client = p2c;
+	reg->nbuckets = nbuckets;
+}/*}}}*/
+
+/* Called with `reg->mutex` locked. */
+static int mmu_registry_alloc_id(struct mmu_registry *reg)/*{{{*/
+{
+	int id = reg->idhint;
+	while(id < reg->nids && reg->idused[id]) id++;
+	if(id == reg->nids) {
+		unsigned char *used = realloc(reg->idused, 2 * reg->nids);
+		if(!used) logea(__FILE__, __LINE__, NULL);
+		memset(used + reg->nids, 0, reg->nids);
+		reg->idused = used;
+		reg->nids *= 2;
+	}
+	reg->idused[id] = 1;
+	reg->idhint = id + 1;
+	return id;
+}/*}}}*/
+
+void mmu_registry_add_pid(struct mmu_client *c)/*{{{*/
+{
+	struct mmu_registry *reg = mmu->reg;
+	pthread_mutex_lock(&reg->mutex);
+	c->id = mmu_registry_alloc_id(reg);
+	if(reg->nclients >= reg->nbuckets) mmu_registry_rehash(reg);
+	size_t b = mmu_registry_bucket(reg->nbuckets, c->pid);
+	c->hnext = reg->pid2client[b];
+	reg->pid2client[b] = c;
+	reg->nclients++;
+	pthread_mutex_unlock(&reg->mutex);
+}/*}}}*/
+
+void mmu_registry_remove(struct mmu_client *c)/*{{{*/
+{
+	struct mmu_registry *reg = mmu->reg;
+	pthread_mutex_lock(&reg->mutex);
+	if(c->sock < reg->nsock && reg->sock2client[c->sock] == c)
+		reg->sock2client[c->sock] = NULL;
+	if(c->id >= 0) {
+		size_t b = mmu_registry_bucket(reg->nbuckets, c->pid);
+		struct mmu_client **prev = &reg->pid2client[b];
+		while(*prev && *prev != c) prev = &(*prev)->hnext;
+		if(*prev) {
+			*prev = c->hnext;
+			reg->nclients--;
+		}
+		struct mmu_stat_proc *sp = mmu_stat_proc(c->id);
+		if(sp) __atomic_store_n(&sp->pid, 0, __ATOMIC_RELEASE);
+		reg->idused[c->id] = 0;
+		if(c->id < reg->idhint) reg->idhint = c->id;
+		c->id = -1;
+	}
+	pthread_mutex_unlock(&reg->mutex);
+}/*}}}*/
+
+/* Returns NULL if `pid` is not registered. */
+static struct mmu_client * mmu_registry_find(pid_t pid)/*{{{*/
+{
+	struct mmu_registry *reg = mmu->reg;
+	pthread_mutex_lock(&reg->mutex);
+	struct mmu_client *c = reg->pid2client[
+			mmu_registry_bucket(reg->nbuckets, pid)];
+	while(c && c->pid != pid) c = c->hnext;
+	pthread_mutex_unlock(&reg->mutex);
+	return c;
+}/*}}}*/
+/*}}}*/
 
 /****************************************************************************
  * initialization functions {{{
  ***************************************************************************/
-static void mmu_init(int npages, int nblocks);
+static void mmu_init(int npages, int nblocks, int region, int track_ms,
+		int lease, int idle_ms, int huge);
 static void mmu_init_disk(int nblocks);
-static void mmu_init_pmem(int npages);
+static void mmu_init_pmem(int npages, int huge);
+static void mmu_init_pmem_huge(int npages);
+static void mmu_init_stats(int npages, int nblocks);
 static void mmu_init_sock(void);
 static void mmu_init_sigs(void);
 
-void mmu_init(int npages, int nblocks)/*{{{*/
+void mmu_init(int npages, int nblocks, int region, int track_ms,/*{{{*/
+		int lease, int idle_ms, int huge)
 {
-	PAGESIZE = sysconf(_SC_PAGESIZE);
 	assert(mmu == NULL);
 	mmu = malloc(sizeof(*mmu));
 	if(!mmu) logea(__FILE__, __LINE__, NULL);
 	mmu->running = 1;
 	mmu->npages = npages;
+	mmu->track_ms = track_ms;
+	mmu->lease = lease;
+	mmu->region = region;
+	mmu->idle_ms = idle_ms;
 
+	mmu_page_init();
+	logd(LOG_INFO, "%s: %s page kernels\n", __func__, mmu_page_impl());
 	mmu_init_disk(nblocks);
-	mmu_init_pmem(npages);
+	mmu_init_pmem(npages, huge);
+	mmu_init_stats(npages, nblocks);
 	mmu_init_sock();
 	mmu_init_sigs();
-	memset(mmu->sock2client, 0, MMU_MAX_SOCK*sizeof(mmu->sock2client[0]));
+	mmu->reg = mmu_registry_init();
 }/*}}}*/
 
 void mmu_init_disk(int nblocks)/*{{{*/
 {
-	size_t disksz = PAGESIZE * nblocks;
-	mmu->disk = malloc(disksz);
-	if(!mmu->disk) logea(__FILE__, __LINE__, NULL);
-	logd(LOG_INFO, "%s: %zu bytes in %d blocks\n", __func__, disksz, nblocks);
+	/* The disk is an anonymous file so it can be the target of
+	 * asynchronous reads and writes; we also map it to service
+	 * synchronous requests with plain memory copies. */
+	size_t disksz = UVM_PAGESIZE * nblocks;
+	mmu->nblocks = nblocks;
+	mmu->disk_fd = memfd_create("mmu.disk", 0);
+	if(mmu->disk_fd == -1) logea(__FILE__, __LINE__, NULL);
+	if(ftruncate(mmu->disk_fd, disksz) == -1)
+		logea(__FILE__, __LINE__, NULL);
+	int prot = PROT_READ | PROT_WRITE;
+	mmu->disk = mmap(NULL, disksz, prot, MAP_SHARED, mmu->disk_fd, 0);
+	if(mmu->disk == MAP_FAILED) logea(__FILE__, __LINE__, NULL);
+	mmu->io = mmu_io_init(mmu->disk_fd, mmu->disk, UVM_PAGESIZE);
+	logd(LOG_INFO, "%s: %zu bytes in %d blocks, %s I/O\n", __func__,
+			disksz, nblocks, mmu_io_backend(mmu->io));
 }/*}}}*/
 
-void mmu_init_pmem(int npages)/*{{{*/
+void mmu_init_pmem(int npages, int huge)/*{{{*/
 {
+	mmu->huge = huge;
+	if(huge) {
+		mmu_init_pmem_huge(npages);
+		return;
+	}
 	mmu->pmem_fn = strdup("mmu.pmem.img.XXXXXX");
 	if(mmu->pmem_fn == NULL) logea(__FILE__, __LINE__, NULL);
 	mmu->pmem_fd = mkstemp(mmu->pmem_fn);
@@ -106,10 +357,15 @@ void mmu_init_pmem(int npages)/*{{{*/
 	logd(LOG_INFO, "%s: mmap fd %d path %s\n", __func__, mmu->pmem_fd,
 			mmu->pmem_fn);
 
-	size_t memsz = PAGESIZE * npages;
-	for(size_t i = 0; i < npages*PAGESIZE; ++i) {
-		write(mmu->pmem_fd, "z", 1);
+	size_t memsz = UVM_PAGESIZE * npages;
+	char *fill = malloc(UVM_PAGESIZE);
+	if(!fill) logea(__FILE__, __LINE__, NULL);
+	memset(fill, 'z', UVM_PAGESIZE);
+	for(int i = 0; i < npages; ++i) {
+		if(write(mmu->pmem_fd, fill, UVM_PAGESIZE) != (ssize_t)UVM_PAGESIZE)
+			logea(__FILE__, __LINE__, mmu->pmem_fn);
 	}
+	free(fill);
 
 	int prot = PROT_READ | PROT_WRITE;
 	mmu->pmem = mmap(NULL, memsz, prot, MAP_SHARED, mmu->pmem_fd, 0);
@@ -118,6 +374,48 @@ void mmu_init_pmem(int npages)/*{{{*/
 	logd(LOG_INFO, "%s: %zu bytes in %d pages\n", __func__, memsz, npages);
 }/*}}}*/
 
+/* Huge frames live in hugetlbfs, which has no files we can create in
+ * the working directory; clients open the memfd through /proc. */
+void mmu_init_pmem_huge(int npages)/*{{{*/
+{
+	mmu->pmem_fd = memfd_create("mmu.pmem", MFD_HUGETLB | MFD_HUGE_2MB);
+	if(mmu->pmem_fd == -1) logea(__FILE__, __LINE__, "huge frames");
+	size_t memsz = UVM_PAGESIZE * npages;
+	if(ftruncate(mmu->pmem_fd, memsz) == -1)
+		logea(__FILE__, __LINE__, "huge frames");
+	int prot = PROT_READ | PROT_WRITE;
+	mmu->pmem = mmap(NULL, memsz, prot, MAP_SHARED, mmu->pmem_fd, 0);
+	if(mmu->pmem == MAP_FAILED) logea(__FILE__, __LINE__, "huge frames");
+	memset(mmu->pmem, 'z', memsz);
+	pmem = mmu->pmem;
+	if(asprintf(&mmu->pmem_fn, "/proc/%d/fd/%d", (int)getpid(),
+			mmu->pmem_fd) == -1)
+		logea(__FILE__, __LINE__, NULL);
+	logd(LOG_INFO, "%s: %zu bytes in %d huge frames at %s\n", __func__,
+			memsz, npages, mmu->pmem_fn);
+}/*}}}*/
+
+void mmu_init_stats(int npages, int nblocks)/*{{{*/
+{
+	int fd = open(MMU_STAT_PATH, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd == -1) logea(__FILE__, __LINE__, MMU_STAT_PATH);
+	if(ftruncate(fd, sizeof(*mmu->stats)) == -1)
+		logea(__FILE__, __LINE__, MMU_STAT_PATH);
+	int prot = PROT_READ | PROT_WRITE;
+	mmu->stats = mmap(NULL, sizeof(*mmu->stats), prot, MAP_SHARED, fd, 0);
+	if(mmu->stats == MAP_FAILED) logea(__FILE__, __LINE__, MMU_STAT_PATH);
+	close(fd);
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	mmu->stats->nframes = npages;
+	mmu->stats->nblocks = nblocks;
+	mmu->stats->start_ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(mmu->stats->magic, MMU_STAT_MAGIC, sizeof(mmu->stats->magic));
+	logd(LOG_INFO, "%s: statistics at %s\n", __func__, MMU_STAT_PATH);
+}/*}}}*/
+
 void mmu_init_sock(void)/*{{{*/
 {
 	mmu->sock = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -129,7 +427,7 @@ void mmu_init_sock(void)/*{{{*/
 	strcat(addr.sun_path, MMU_PROTO_UNIX_PATH);
 	if(bind(mmu->sock, (struct sockaddr *)&addr, sizeof(addr)) == -1)
 		logea(__FILE__, __LINE__, NULL);
-	if(listen(mmu->sock, 32) == -1)
+	if(listen(mmu->sock, SOMAXCONN) == -1)
 		logea(__FILE__, __LINE__, NULL);
 	logd(LOG_INFO, "%s: unix socket %d at %s\n", __func__, mmu->sock,
 			MMU_PROTO_UNIX_PATH);
@@ -143,6 +441,10 @@ void mmu_init_sigs(void)/*{{{*/
 	new.sa_sigaction = mmu_shutdown_action;
 	sigaction(SIGINT, &new, NULL);
 	logd(LOG_INFO, "%s: SIGINT triggers shutdown\n", __func__);
+	/* clients may die at any time, e.g., killed by `mmu_oom_kill`;
+	 * failed sends destroy the client (or mark it dead, from pager
+	 * context) instead */
+	signal(SIGPIPE, SIG_IGN);
 }
 /*}}}*/
 /*}}}*/
@@ -154,14 +456,19 @@ void mmu_destroy(void)/*{{{*/
 {
 	logd(LOG_DEBUG, "%s: starting\n", __func__);
 	assert(mmu);
-	unlink(mmu->pmem_fn);
+	if(!mmu->huge) unlink(mmu->pmem_fn);
 	free(mmu->pmem_fn);
-	for(int i = 3; i < MMU_MAX_SOCK; ++i) {
-		if(!mmu->sock2client[i]) continue;
-		mmu_client_destroy(mmu->sock2client[i]);
+	for(int i = 3; i < mmu->reg->nsock; ++i) {
+		if(!mmu->reg->sock2client[i]) continue;
+		mmu_client_destroy(mmu->reg->sock2client[i]);
 	}
-	munmap(mmu->pmem, mmu->npages * PAGESIZE);
-	free(mmu->disk);
+	mmu_registry_destroy(mmu->reg);
+	munmap(mmu->pmem, mmu->npages * UVM_PAGESIZE);
+	munmap(mmu->stats, sizeof(*mmu->stats));
+	unlink(MMU_STAT_PATH);
+	mmu_io_destroy(mmu->io);
+	munmap(mmu->disk, mmu->nblocks * UVM_PAGESIZE);
+	close(mmu->disk_fd);
 	close(mmu->sock);
 	unlink(MMU_PROTO_UNIX_PATH);
 	free(mmu);
@@ -192,10 +499,26 @@ void mmu_accept_loop(void)/*{{{*/
 		logd(LOG_DEBUG, "%s: creating thread\n", __func__);
 		struct mmu_client *c = malloc(sizeof(*c));
 		if(!c) logea(__FILE__, __LINE__, NULL);
-		mmu->sock2client[nsock] = c;
 		c->running = 1;
 		c->sock = nsock;
 		c->pid = 0;
+		c->id = -1;
+		c->track = 0;
+		c->killed = 0;
+		c->idle = 0;
+		c->hnext = NULL;
+		pthread_mutex_init(&c->rxlock, NULL);
+		c->stash = NULL;
+		c->stashlen = 0;
+		c->stashcap = 0;
+		c->wakefd = eventfd(0, EFD_NONBLOCK);
+		if(c->wakefd == -1) logea(__FILE__, __LINE__, NULL);
+		c->state_fd = -1;
+		c->state = NULL;
+		c->nstate = 0;
+		c->lease = NULL;
+		pthread_mutex_init(&c->lease_mutex, NULL);
+		mmu_registry_add_sock(c);
 		pthread_create(&c->thread, NULL, mmu_client_thread, c);
 		pthread_detach(c->thread);
 	}
@@ -203,43 +526,93 @@ void mmu_accept_loop(void)/*{{{*/
 }/*}}}*/
 
 static void mmu_client_log(const struct mmu_client *c, const char *fname, const char *msg);
-static void mmu_client_create(struct mmu_client *c);
-static void mmu_client_extend(struct mmu_client *c);
-static void mmu_client_syslog(struct mmu_client *c);
-static void mmu_client_segv(struct mmu_client *c);
-static void mmu_client_exit(struct mmu_client *c);
+static int mmu_client_next(struct mmu_client *c, union mmu_proto_req *req);
+static int mmu_client_wait_ack(struct mmu_client *c, uint32_t type);
+static void mmu_client_notify(struct mmu_client *c, const void *rep,
+		size_t len, uint32_t ack);
+static void mmu_client_free(struct mmu_client *c);
+static int mmu_client_state_init(struct mmu_client *c);
+static struct mmu_proto_page_state * mmu_client_state(
+		struct mmu_client *c, void *vaddr);
+static size_t mmu_client_state_size(const struct mmu_client *c);
+static int mmu_lease_grant(struct mmu_client *c);
+static void * mmu_lease_take(struct mmu_client *c);
+static void mmu_lease_revoke(struct mmu_client *c);
+static void mmu_lease_reclaim(struct mmu_client *self);
+static void mmu_client_create(struct mmu_client *c,
+		const struct mmu_proto_create_req *req);
+static void mmu_client_extend(struct mmu_client *c,
+		const struct mmu_proto_extend_req *req);
+static void mmu_client_extend_n(struct mmu_client *c,
+		const struct mmu_proto_extend_n_req *req);
+static void mmu_client_syslog(struct mmu_client *c,
+		const struct mmu_proto_syslog_req *req);
+static void mmu_client_advise(struct mmu_client *c,
+		const struct mmu_proto_advise_req *req);
+static void mmu_client_shrink(struct mmu_client *c,
+		const struct mmu_proto_shrink_req *req);
+static void mmu_client_limit(struct mmu_client *c,
+		const struct mmu_proto_limit_req *req);
+static void mmu_client_stat(struct mmu_client *c,
+		const struct mmu_proto_stat_req *req);
+static void mmu_client_hibernate(struct mmu_client *c,
+		const struct mmu_proto_hibernate_req *req);
+static void mmu_client_idle(struct mmu_client *c);
+static void mmu_client_segv(struct mmu_client *c,
+		const struct mmu_proto_segv_req *req);
+static void mmu_client_exit(struct mmu_client *c,
+		const struct mmu_proto_exit_req *req);
 
 void * mmu_client_thread(void *vclient)/*{{{*/
 {
 	struct mmu_client *c = vclient;
 	while(mmu->running && c->running) {
 		mmu_client_log(c, __func__, "recv");
-		uint32_t type;
-		ssize_t cnt = recv(c->sock, &type, sizeof(type), MSG_PEEK);
+		union mmu_proto_req req;
+		int r = mmu_client_next(c, &req);
 		if(!mmu->running || !c->running) {
 			mmu_client_log(c, __func__, "breaking loop");
 			break;
 		}
-		if(cnt != sizeof(type)) goto out_client;
-		switch(type) {
+		if(r == -1) goto out_client;
+		if(r == 1) {
+			mmu_client_idle(c);
+			continue;
+		}
+		c->idle = 0;
+		switch(req.type) {
 		case MMU_PROTO_CREATE_REQ:
-			mmu_client_create(c);
+			mmu_client_create(c, &req.create);
 			break;
 		case MMU_PROTO_EXTEND_REQ:
-			mmu_client_extend(c);
+			mmu_client_extend(c, &req.extend);
+			break;
+		case MMU_PROTO_EXTEND_N_REQ:
+			mmu_client_extend_n(c, &req.extend_n);
 			break;
 		case MMU_PROTO_SYSLOG_REQ:
-			mmu_client_syslog(c);
+			mmu_client_syslog(c, &req.syslog);
 			break;
-		case MMU_PROTO_SEGV_REQ:
-			mmu_client_segv(c);
+		case MMU_PROTO_ADVISE_REQ:
+			mmu_client_advise(c, &req.advise);
 			break;
-		case MMU_PROTO_REMAP_REQ:
-		case MMU_PROTO_CHPROT_REQ:
-			/* these messages are handled by the pager thread */
+		case MMU_PROTO_SHRINK_REQ:
+			mmu_client_shrink(c, &req.shrink);
+			break;
+		case MMU_PROTO_LIMIT_REQ:
+			mmu_client_limit(c, &req.limit);
+			break;
+		case MMU_PROTO_STAT_REQ:
+			mmu_client_stat(c, &req.stat);
+			break;
+		case MMU_PROTO_HIBERNATE_REQ:
+			mmu_client_hibernate(c, &req.hibernate);
+			break;
+		case MMU_PROTO_SEGV_REQ:
+			mmu_client_segv(c, &req.segv);
 			break;
 		case MMU_PROTO_EXIT_REQ:
-			mmu_client_exit(c);
+			mmu_client_exit(c, &req.exit);
 			break;
 		default:
 			mmu_client_log(c, __func__, "invalid message type");
@@ -248,7 +621,7 @@ void * mmu_client_thread(void *vclient)/*{{{*/
 		}
 	}
 	mmu_client_log(c, __func__, "finished");
-	free(c);
+	mmu_client_free(c);
 	pthread_exit(NULL);
 
 	out_client:
@@ -262,27 +635,253 @@ void mmu_client_log(const struct mmu_client *c, const char *fname, const char *m
 			(int)c->pid, msg);
 }/*}}}*/
 
-void mmu_client_create(struct mmu_client *c)/*{{{*/
+/* Returns the size of request messages of type `type`, or zero if
+ * `type` is not a request. */
+static size_t mmu_proto_req_size(uint32_t type)/*{{{*/
+{
+	switch(type) {
+	case MMU_PROTO_CREATE_REQ: return sizeof(struct mmu_proto_create_req);
+	case MMU_PROTO_EXTEND_REQ: return sizeof(struct mmu_proto_extend_req);
+	case MMU_PROTO_EXTEND_N_REQ:
+		return sizeof(struct mmu_proto_extend_n_req);
+	case MMU_PROTO_SYSLOG_REQ: return sizeof(struct mmu_proto_syslog_req);
+	case MMU_PROTO_ADVISE_REQ: return sizeof(struct mmu_proto_advise_req);
+	case MMU_PROTO_SHRINK_REQ: return sizeof(struct mmu_proto_shrink_req);
+	case MMU_PROTO_LIMIT_REQ: return sizeof(struct mmu_proto_limit_req);
+	case MMU_PROTO_STAT_REQ: return sizeof(struct mmu_proto_stat_req);
+	case MMU_PROTO_HIBERNATE_REQ:
+		return sizeof(struct mmu_proto_hibernate_req);
+	case MMU_PROTO_SEGV_REQ: return sizeof(struct mmu_proto_segv_req);
+	case MMU_PROTO_REMAP_REQ: return sizeof(struct mmu_proto_remap_req);
+	case MMU_PROTO_CHPROT_REQ: return sizeof(struct mmu_proto_chprot_req);
+	case MMU_PROTO_EXIT_REQ: return sizeof(struct mmu_proto_exit_req);
+	default: return 0;
+	}
+}/*}}}*/
+
+/* Receives the next request for the client thread, taking stashed
+ * requests first.  Acknowledgements (REMAP_REQ and CHPROT_REQ) are
+ * left in the socket for the thread waiting on them.  Returns 0 on
+ * success, 1 if the client sent nothing for `mmu->idle_ms`
+ * milliseconds, and -1 if the connection is broken. */
+int mmu_client_next(struct mmu_client *c, union mmu_proto_req *req)/*{{{*/
+{
+	while(mmu->running && c->running) {
+		pthread_mutex_lock(&c->rxlock);
+		if(c->stashlen > 0) {
+			uint32_t type;
+			memcpy(&type, c->stash, sizeof(type));
+			size_t sz = mmu_proto_req_size(type);
+			memcpy(req, c->stash, sz);
+			c->stashlen -= sz;
+			memmove(c->stash, c->stash + sz, c->stashlen);
+			pthread_mutex_unlock(&c->rxlock);
+			return 0;
+		}
+		uint32_t type;
+		ssize_t cnt = recv(c->sock, &type, sizeof(type),
+				MSG_PEEK | MSG_DONTWAIT);
+		if(cnt == sizeof(type) && type != MMU_PROTO_REMAP_REQ &&
+				type != MMU_PROTO_CHPROT_REQ) {
+			size_t sz = mmu_proto_req_size(type);
+			if(sz == 0 || recv(c->sock, req, sz, MSG_WAITALL) != sz) {
+				pthread_mutex_unlock(&c->rxlock);
+				return -1;
+			}
+			pthread_mutex_unlock(&c->rxlock);
+			return 0;
+		}
+		pthread_mutex_unlock(&c->rxlock);
+		if(cnt == 0) return -1;
+		if(cnt == -1 && errno != EAGAIN && errno != EWOULDBLOCK &&
+				errno != EINTR) {
+			return -1;
+		}
+		if(cnt == sizeof(type)) {
+			/* acknowledgement for another thread */
+			sched_yield();
+			continue;
+		}
+		struct pollfd fds[2];
+		fds[0].fd = c->sock;
+		fds[0].events = POLLIN;
+		fds[1].fd = c->wakefd;
+		fds[1].events = POLLIN;
+		/* created clients are hibernated once per idle period */
+		int timeout = mmu->idle_ms && c->id != -1 && !c->idle ?
+				mmu->idle_ms : -1;
+		if(poll(fds, 2, timeout) == 0) return 1;
+		if(fds[1].revents & POLLIN) {
+			uint64_t v;
+			if(read(c->wakefd, &v, sizeof(v)) != sizeof(v)) { }
+		}
+	}
+	return 0;
+}/*}}}*/
+
+/* Waits for acknowledgement `type` from the client.  Other requests
+ * received in the meantime are stashed for the client thread.
+ * Returns 0 on success and -1 if the connection is broken. */
+int mmu_client_wait_ack(struct mmu_client *c, uint32_t type)/*{{{*/
+{
+	pthread_mutex_lock(&c->rxlock);
+	while(1) {
+		uint32_t t;
+		if(recv(c->sock, &t, sizeof(t), MSG_PEEK | MSG_WAITALL)
+				!= sizeof(t)) {
+			break;
+		}
+		size_t sz = mmu_proto_req_size(t);
+		if(sz == 0) break;
+		if(t == type) {
+			union mmu_proto_req ack;
+			if(recv(c->sock, &ack, sz, MSG_WAITALL) != sz) break;
+			pthread_mutex_unlock(&c->rxlock);
+			return 0;
+		}
+		if(c->stashlen + sz > c->stashcap) {
+			size_t cap = c->stashcap ? 2 * c->stashcap : 256;
+			char *stash = realloc(c->stash, cap);
+			if(!stash) logea(__FILE__, __LINE__, NULL);
+			c->stash = stash;
+			c->stashcap = cap;
+		}
+		if(recv(c->sock, c->stash + c->stashlen, sz, MSG_WAITALL) != sz)
+			break;
+		c->stashlen += sz;
+		uint64_t one = 1;
+		if(write(c->wakefd, &one, sizeof(one)) != sizeof(one)) { }
+	}
+	pthread_mutex_unlock(&c->rxlock);
+	return -1;
+}/*}}}*/
+
+/* Sends `len` bytes of `rep` to the client and waits for
+ * acknowledgement `ack`.  Called from pager callbacks, with the
+ * pager's lock held: if the connection is broken, the client is only
+ * marked dead, as `pager_destroy` would take the lock again.  The
+ * client's own thread destroys it after the pager returns (see
+ * `mmu_client_segv`) or when it next reads from the socket.  Dead
+ * clients are not sent anything. */
+void mmu_client_notify(struct mmu_client *c, const void *rep, size_t len,/*{{{*/
+		uint32_t ack)
+{
+	if(c->killed) return;
+	if(send(c->sock, rep, len, 0) != (ssize_t)len ||
+			mmu_client_wait_ack(c, ack) == -1) {
+		mmu_client_log(c, __func__, "connection broken");
+		c->killed = 1;
+	}
+}/*}}}*/
+
+/* Creates the page-state table shared with the client.  Returns -1 on
+ * failure. */
+int mmu_client_state_init(struct mmu_client *c)/*{{{*/
+{
+	c->nstate = (size_t)mmu->region;
+	size_t sz = mmu_client_state_size(c);
+	c->state_fd = memfd_create("mmu.pages", MFD_CLOEXEC);
+	if(c->state_fd == -1) goto out_err;
+	if(ftruncate(c->state_fd, (off_t)sz) == -1) goto out_err;
+	c->state = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED,
+			c->state_fd, 0);
+	if(c->state == MAP_FAILED) {
+		c->state = NULL;
+		goto out_err;
+	}
+	for(size_t i = 0; i < c->nstate; i++) {
+		c->state[i].frame = -1;
+		c->state[i].prot = PROT_NONE;
+	}
+	c->lease = (uint64_t *)(c->state + c->nstate);
+	*c->lease = MMU_PROTO_LEASE(0, 0);
+	return 0;
+
+	out_err:
+	loge(LOG_ERROR, __FILE__, __LINE__);
+	return -1;
+}/*}}}*/
+
+struct mmu_proto_page_state * mmu_client_state(struct mmu_client *c,/*{{{*/
+		void *vaddr)
+{
+	size_t idx = (size_t)((intptr_t)vaddr - UVM_BASEADDR) / UVM_PAGESIZE;
+	assert((intptr_t)vaddr >= UVM_BASEADDR && idx < c->nstate);
+	return &c->state[idx];
+}/*}}}*/
+
+size_t mmu_client_state_size(const struct mmu_client *c)/*{{{*/
+{
+	return c->nstate * sizeof(c->state[0]) + sizeof(*c->lease);
+}/*}}}*/
+
+void mmu_client_free(struct mmu_client *c)/*{{{*/
+{
+	/* wait for other clients' threads revoking our lease */
+	pthread_mutex_lock(&c->lease_mutex);
+	pthread_mutex_unlock(&c->lease_mutex);
+	pthread_mutex_destroy(&c->lease_mutex);
+	pthread_mutex_destroy(&c->rxlock);
+	close(c->wakefd);
+	if(c->state) munmap(c->state, mmu_client_state_size(c));
+	if(c->state_fd != -1) close(c->state_fd);
+	free(c->stash);
+	free(c);
+}/*}}}*/
+
+void mmu_client_create(struct mmu_client *c,/*{{{*/
+		const struct mmu_proto_create_req *req)
 {
 	char msg[96];
-	struct mmu_proto_create_req req;
-	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
-		goto out_client;
-	assert(req.type == MMU_PROTO_CREATE_REQ);
+	assert(req->type == MMU_PROTO_CREATE_REQ);
 
-	c->pid = (pid_t)req.pid;
-	int id = nextid;
-	id2pid[nextid++] = c->pid;
-	printf("pager_create pid %d\n", id);
+	if(mmu_client_state_init(c) == -1)
+		goto out_client;
+	c->pid = (pid_t)req->pid;
+	c->track = req->track && mmu->track_ms > 0;
+	mmu_registry_add_pid(c);
+	struct mmu_stat_proc *sp = mmu_stat_proc(c->id);
+	if(sp) {
+		sp->resident = 0;
+		__atomic_store_n(&sp->pid, (int32_t)c->pid, __ATOMIC_RELEASE);
+	}
+	int id = c->id;
+	mmu_trace(MMU_TRACE_PAGER_CREATE, id, 0, 0, 0);
 	pager_create(c->pid);
-	snprintf(msg, 96, "create pid %d", id);
+	if(mmu->lease > 0) {
+		pthread_mutex_lock(&c->lease_mutex);
+		int npages = mmu_lease_grant(c);
+		*c->lease = MMU_PROTO_LEASE(npages, 0);
+		pthread_mutex_unlock(&c->lease_mutex);
+	}
+	snprintf(msg, 96, "create pid %d track %d", id, c->track);
 	mmu_client_log(c, __func__, msg);
 
 	struct mmu_proto_create_rep rep;
 	rep.type = MMU_PROTO_CREATE_REP;
 	memset(rep.pmem_fn, '\0', MMU_PROTO_PATH_MAX);
 	strncat(rep.pmem_fn, mmu->pmem_fn, MMU_PROTO_PATH_MAX-1);
-	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+	rep.track_ms = c->track ? (uint32_t)mmu->track_ms : 0;
+	rep.npages = (uint32_t)mmu->region;
+	rep.pageshift = UVM_PAGESHIFT;
+
+	struct iovec iov = { .iov_base = &rep, .iov_len = sizeof(rep) };
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} ctl;
+	struct msghdr mh;
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = ctl.buf;
+	mh.msg_controllen = sizeof(ctl.buf);
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cm), &c->state_fd, sizeof(int));
+	if(sendmsg(c->sock, &mh, 0) != sizeof(rep))
 		goto out_client;
 	return;
 
@@ -290,22 +889,31 @@ void mmu_client_create(struct mmu_client *c)/*{{{*/
 	mmu_client_destroy(c);
 }/*}}}*/
 
-void mmu_client_extend(struct mmu_client *c)/*{{{*/
+void mmu_client_extend(struct mmu_client *c,/*{{{*/
+		const struct mmu_proto_extend_req *req)
 {
 	char msg[96];
-	struct mmu_proto_extend_req req;
-	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
-		goto out_client;
-	assert(req.type == MMU_PROTO_EXTEND_REQ);
+	assert(req->type == MMU_PROTO_EXTEND_REQ);
 
-	int id = get_pid_id(c->pid);
-	void *vaddr = pager_extend(c->pid);
-	printf("pager_extend pid %d vaddr %p\n", id, vaddr);
-	snprintf(msg, 96, "extend vaddr %p", vaddr);
+	int id = c->id;
+	void *vaddr;
+	if(mmu->lease > 0) {
+		/* the client's lease is used up; grant a new one */
+		vaddr = mmu_lease_take(c);
+		if(!vaddr) {
+			mmu_lease_reclaim(c);
+			vaddr = mmu_lease_take(c);
+		}
+	} else {
+		vaddr = pager_extend(c->pid);
+		mmu_trace(MMU_TRACE_PAGER_EXTEND, id, 0, 0, (uintptr_t)vaddr);
+	}
+	snprintf(msg, 96, "extend vaddr %p reqid %u", vaddr, req->reqid);
 	mmu_client_log(c, __func__, msg);
 
 	struct mmu_proto_extend_rep rep;
 	rep.type = MMU_PROTO_EXTEND_REP;
+	rep.reqid = req->reqid;
 	rep.vaddr = (intptr_t)vaddr;
 	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
 		goto out_client;
@@ -315,25 +923,98 @@ void mmu_client_extend(struct mmu_client *c)/*{{{*/
 	mmu_client_destroy(c);
 }/*}}}*/
 
-void mmu_client_syslog(struct mmu_client *c)/*{{{*/
+void mmu_client_extend_n(struct mmu_client *c,/*{{{*/
+		const struct mmu_proto_extend_n_req *req)
 {
 	char msg[96];
-	struct mmu_proto_syslog_req req;
-	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
+	assert(req->type == MMU_PROTO_EXTEND_N_REQ);
+
+	int id = c->id;
+	int npages = (int)req->npages;
+	int populate = (req->flags & MMU_PROTO_EXTEND_POPULATE) != 0;
+	if(mmu->lease > 0) {
+		/* the new pages must follow those handed out */
+		pthread_mutex_lock(&c->lease_mutex);
+		mmu_lease_revoke(c);
+	}
+	/* traced first, as populating generates MMU events */
+	mmu_trace(MMU_TRACE_PAGER_EXTEND_N, id, npages, populate, 0);
+	void *vaddr = NULL;
+	if(npages > 0) vaddr = pager_extend_n(c->pid, npages, populate);
+	if(mmu->lease > 0) {
+		uint32_t end = MMU_PROTO_LEASE_END(*c->lease);
+		if(vaddr) end += (uint32_t)npages;
+		__atomic_store_n(c->lease, MMU_PROTO_LEASE(end, end),
+				__ATOMIC_RELEASE);
+		pthread_mutex_unlock(&c->lease_mutex);
+	}
+	snprintf(msg, 96, "extend_n vaddr %p npages %d populate %d reqid %u",
+			vaddr, npages, populate, req->reqid);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_extend_n_rep rep;
+	rep.type = MMU_PROTO_EXTEND_N_REP;
+	rep.reqid = req->reqid;
+	rep.npages = vaddr ? req->npages : 0;
+	rep.vaddr = (intptr_t)vaddr;
+	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
 		goto out_client;
-	assert(req.type == MMU_PROTO_SYSLOG_REQ);
+	return;
 
-	assert(req.addr < UINTPTR_MAX);
-	void *vaddr = (void *)(uintptr_t)req.addr;
-	size_t len = (size_t)req.len;
-	int id = get_pid_id(c->pid);
-	printf("pager_syslog pid %d %p\n", id, vaddr);
+	out_client:
+	mmu_client_destroy(c);
+}/*}}}*/
+
+void mmu_client_syslog(struct mmu_client *c,/*{{{*/
+		const struct mmu_proto_syslog_req *req)
+{
+	char msg[96];
+	assert(req->type == MMU_PROTO_SYSLOG_REQ);
+
+	assert(req->addr < UINTPTR_MAX);
+	void *vaddr = (void *)(uintptr_t)req->addr;
+	size_t len = (size_t)req->len;
+	int id = c->id;
+	mmu_trace(MMU_TRACE_PAGER_SYSLOG, id, 0, 0, (uintptr_t)vaddr);
 	int status = pager_syslog(c->pid, vaddr, len);
 	snprintf(msg, 96, "vaddr %p len %zu retcode %d", vaddr, len, status);
 	mmu_client_log(c, __func__, msg);
 
 	struct mmu_proto_syslog_rep rep;
 	rep.type = MMU_PROTO_SYSLOG_REP;
+	rep.reqid = req->reqid;
+	rep.retcode = (uint32_t)status;
+	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_destroy(c);
+}/*}}}*/
+
+void mmu_client_advise(struct mmu_client *c,/*{{{*/
+		const struct mmu_proto_advise_req *req)
+{
+	char msg[96];
+	assert(req->type == MMU_PROTO_ADVISE_REQ);
+
+	assert(req->addr < UINTPTR_MAX);
+	void *vaddr = (void *)(uintptr_t)req->addr;
+	size_t len = req->len > SIZE_MAX ? SIZE_MAX : (size_t)req->len;
+	int advice = (int)req->advice;
+	int id = c->id;
+	/* traced first, as prefetching generates MMU events */
+	mmu_trace(MMU_TRACE_PAGER_ADVISE, id,
+			len > INT32_MAX ? INT32_MAX : (int32_t)len, advice,
+			(uintptr_t)vaddr);
+	int status = pager_advise(c->pid, vaddr, len, advice);
+	snprintf(msg, 96, "vaddr %p len %zu advice %d retcode %d", vaddr, len,
+			advice, status);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_advise_rep rep;
+	rep.type = MMU_PROTO_ADVISE_REP;
+	rep.reqid = req->reqid;
 	rep.retcode = (uint32_t)status;
 	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
 		goto out_client;
@@ -343,26 +1024,159 @@ void mmu_client_syslog(struct mmu_client *c)/*{{{*/
 	mmu_client_destroy(c);
 }/*}}}*/
 
-void mmu_client_segv(struct mmu_client *c)/*{{{*/
+void mmu_client_shrink(struct mmu_client *c,/*{{{*/
+		const struct mmu_proto_shrink_req *req)
+{
+	char msg[96];
+	assert(req->type == MMU_PROTO_SHRINK_REQ);
+
+	int id = c->id;
+	int npages = req->npages > INT32_MAX ? INT32_MAX : (int)req->npages;
+	if(mmu->lease > 0) {
+		/* leased pages past `npages` go back too */
+		pthread_mutex_lock(&c->lease_mutex);
+		mmu_lease_revoke(c);
+	}
+	/* traced first, as unmapping generates MMU events */
+	mmu_trace(MMU_TRACE_PAGER_SHRINK, id, npages, 0, 0);
+	pager_shrink(c->pid, npages);
+	if(mmu->lease > 0) {
+		uint32_t end = MMU_PROTO_LEASE_END(*c->lease);
+		if(end > (uint32_t)npages) end = (uint32_t)npages;
+		__atomic_store_n(c->lease, MMU_PROTO_LEASE(end, end),
+				__ATOMIC_RELEASE);
+		pthread_mutex_unlock(&c->lease_mutex);
+	}
+	snprintf(msg, 96, "shrink npages %d reqid %u", npages, req->reqid);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_shrink_rep rep;
+	rep.type = MMU_PROTO_SHRINK_REP;
+	rep.reqid = req->reqid;
+	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_destroy(c);
+}/*}}}*/
+
+void mmu_client_limit(struct mmu_client *c,/*{{{*/
+		const struct mmu_proto_limit_req *req)
 {
 	char msg[96];
-	struct mmu_proto_segv_req req;
-	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
+	assert(req->type == MMU_PROTO_LIMIT_REQ);
+
+	int min = req->min_frames > INT32_MAX ? INT32_MAX : (int)req->min_frames;
+	int max = req->max_frames > INT32_MAX ? INT32_MAX : (int)req->max_frames;
+	/* traced first, as trimming the process generates MMU events */
+	mmu_trace(MMU_TRACE_PAGER_LIMIT, c->id, min, max, 0);
+	int status = pager_limit(c->pid, min, max);
+	snprintf(msg, 96, "min %d max %d retcode %d", min, max, status);
+	mmu_client_log(c, __func__, msg);
+
+	struct mmu_proto_limit_rep rep;
+	rep.type = MMU_PROTO_LIMIT_REP;
+	rep.reqid = req->reqid;
+	rep.retcode = (uint32_t)status;
+	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_destroy(c);
+}/*}}}*/
+
+void mmu_client_stat(struct mmu_client *c,/*{{{*/
+		const struct mmu_proto_stat_req *req)
+{
+	assert(req->type == MMU_PROTO_STAT_REQ);
+
+	mmu_trace(MMU_TRACE_PAGER_STAT, c->id, 0, 0, 0);
+	struct pager_stat st;
+	memset(&st, 0, sizeof(st));
+	pager_stat(c->pid, &st);
+	mmu_client_log(c, __func__, "stat");
+
+	struct mmu_proto_stat_rep rep;
+	rep.type = MMU_PROTO_STAT_REP;
+	rep.reqid = req->reqid;
+	rep.resident = (uint32_t)st.resident;
+	rep.min_frames = (uint32_t)st.min_frames;
+	rep.max_frames = (uint32_t)st.max_frames;
+	rep.faults = (uint64_t)st.faults;
+	rep.pageins = (uint64_t)st.pageins;
+	rep.evictions = (uint64_t)st.evictions;
+	rep.writes = (uint64_t)st.writes;
+	rep.writes_skipped = (uint64_t)st.writes_skipped;
+	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
 		goto out_client;
-	assert(req.type == MMU_PROTO_SEGV_REQ);
+	return;
+
+	out_client:
+	mmu_client_destroy(c);
+}/*}}}*/
+
+void mmu_client_hibernate(struct mmu_client *c,/*{{{*/
+		const struct mmu_proto_hibernate_req *req)
+{
+	char msg[64];
+	assert(req->type == MMU_PROTO_HIBERNATE_REQ);
 
-	assert(req.addr < UINTPTR_MAX);
-	void *vaddr = (void *)(uintptr_t)req.addr;
-	int code = (int)req.code;
-	snprintf(msg, 96, "vaddr %p code %d", vaddr, code);
+	/* traced first, as paging out generates MMU events */
+	mmu_trace(MMU_TRACE_PAGER_HIBERNATE, c->id, 0, 0, 0);
+	int npages = pager_hibernate(c->pid);
+	snprintf(msg, 64, "npages %d", npages);
 	mmu_client_log(c, __func__, msg);
 
-	int id = get_pid_id(c->pid);
-	printf("pager_fault pid %d vaddr %p\n", id, vaddr);
+	struct mmu_proto_hibernate_rep rep;
+	rep.type = MMU_PROTO_HIBERNATE_REP;
+	rep.reqid = req->reqid;
+	rep.npages = (uint32_t)npages;
+	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		goto out_client;
+	return;
+
+	out_client:
+	mmu_client_destroy(c);
+}/*}}}*/
+
+void mmu_client_idle(struct mmu_client *c)/*{{{*/
+{
+	mmu_client_log(c, __func__, "idle");
+	mmu_trace(MMU_TRACE_PAGER_HIBERNATE, c->id, 0, 0, 0);
+	pager_hibernate(c->pid);
+	c->idle = 1;
+	if(c->killed) mmu_client_destroy(c);
+}/*}}}*/
+
+void mmu_client_segv(struct mmu_client *c,/*{{{*/
+		const struct mmu_proto_segv_req *req)
+{
+	char msg[96];
+	assert(req->type == MMU_PROTO_SEGV_REQ);
+
+	assert(req->addr < UINTPTR_MAX);
+	void *vaddr = (void *)(uintptr_t)req->addr;
+	int code = (int)req->code;
+	snprintf(msg, 96, "vaddr %p code %d reqid %u", vaddr, code,
+			req->reqid);
+	mmu_client_log(c, __func__, msg);
+
+	int id = c->id;
+	mmu_trace(MMU_TRACE_PAGER_FAULT, id, 0, 0, (uintptr_t)vaddr);
+	mmu_stat_count(MMU_STAT_FAULTS, 1);
 	pager_fault(c->pid, vaddr);
+	if(c->killed) {
+		/* killed, or died while the pager paged its memory: free
+		 * the process's memory now; do not let it retry */
+		mmu_trace(MMU_TRACE_PAGER_DESTROY, id, 0, 0, 0);
+		goto out_client;
+	}
 
 	struct mmu_proto_segv_rep rep;
 	rep.type = MMU_PROTO_SEGV_REP;
+	rep.reqid = req->reqid;
 	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
 		goto out_client;
 	return;
@@ -371,41 +1185,139 @@ void mmu_client_segv(struct mmu_client *c)/*{{{*/
 	mmu_client_destroy(c);
 }/*}}}*/
 
-void mmu_client_exit(struct mmu_client *c)/*{{{*/
+void mmu_client_exit(struct mmu_client *c,/*{{{*/
+		const struct mmu_proto_exit_req *req)
 {
-	struct mmu_proto_exit_req req;
-	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
-		goto out_client;
 	mmu_client_log(c, __func__, "exiting cleanly");
-	assert(req.type == MMU_PROTO_EXIT_REQ);
+	assert(req->type == MMU_PROTO_EXIT_REQ);
 	assert(c->pid);
-	int id = get_pid_id(c->pid);
-	printf("pager_destroy pid %d\n", id);
+	int id = c->id;
+	mmu_trace(MMU_TRACE_PAGER_DESTROY, id, 0, 0, 0);
 	pager_destroy(c->pid);
 
-	struct mmu_proto_segv_rep rep;
+	struct mmu_proto_exit_rep rep;
 	rep.type = MMU_PROTO_EXIT_REP;
 	send(c->sock, &rep, sizeof(rep), 0); /* ignoring return value */
 
-	mmu->sock2client[c->sock] = NULL;
+	mmu_registry_remove(c);
 	c->running = 0;
 	close(c->sock);
-	return;
+}/*}}}*/
 
-	out_client:
-	mmu_client_destroy(c);
+/* Allocates pages after the end of `c`'s lease: `mmu->lease` pages
+ * or, if disk blocks are short, a single page.  Returns the number of
+ * pages allocated.  Called with `c->lease_mutex` locked. */
+int mmu_lease_grant(struct mmu_client *c)/*{{{*/
+{
+	int npages = mmu->lease;
+	if(!pager_extend_n(c->pid, npages, 0)) {
+		npages = 1;
+		if(!pager_extend_n(c->pid, npages, 0)) return 0;
+	}
+	/* traced after the fact so failed attempts do not show */
+	mmu_trace(MMU_TRACE_PAGER_EXTEND_N, c->id, npages, 0, 0);
+	return npages;
+}/*}}}*/
+
+/* Hands out the next page of `c`'s lease on the client's behalf,
+ * granting a new lease if it is used up.  Returns the page's address,
+ * or NULL if no disk blocks are left. */
+void * mmu_lease_take(struct mmu_client *c)/*{{{*/
+{
+	void *vaddr = NULL;
+	pthread_mutex_lock(&c->lease_mutex);
+	uint64_t lease = __atomic_load_n(c->lease, __ATOMIC_ACQUIRE);
+	for(;;) {
+		uint32_t end = MMU_PROTO_LEASE_END(lease);
+		uint32_t used = MMU_PROTO_LEASE_USED(lease);
+		uint64_t next;
+		if(used < end) {
+			next = MMU_PROTO_LEASE(end, used + 1);
+		} else {
+			/* the client cannot change a used-up lease, so the
+			 * exchange below will not fail */
+			int npages = mmu_lease_grant(c);
+			if(npages == 0) break;
+			next = MMU_PROTO_LEASE(end + (uint32_t)npages, used + 1);
+		}
+		if(__atomic_compare_exchange_n(c->lease, &lease, next, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			vaddr = (void *)(UVM_BASEADDR + (intptr_t)used * UVM_PAGESIZE);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&c->lease_mutex);
+	return vaddr;
+}/*}}}*/
+
+/* Gives the pages of `c`'s lease that were not handed out back to the
+ * pager.  Called with `c->lease_mutex` locked. */
+void mmu_lease_revoke(struct mmu_client *c)/*{{{*/
+{
+	uint64_t lease = __atomic_load_n(c->lease, __ATOMIC_ACQUIRE);
+	uint32_t used;
+	do {
+		used = MMU_PROTO_LEASE_USED(lease);
+		if(used == MMU_PROTO_LEASE_END(lease)) return;
+	} while(!__atomic_compare_exchange_n(c->lease, &lease,
+			MMU_PROTO_LEASE(used, used), 0,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+	mmu_trace(MMU_TRACE_PAGER_SHRINK, c->id, (int32_t)used, 0, 0);
+	pager_shrink(c->pid, (int)used);
+}/*}}}*/
+
+/* Revokes the leases of all clients other than `self` to free disk
+ * blocks.  Clients whose lease is being granted or revoked by another
+ * thread are skipped. */
+void mmu_lease_reclaim(struct mmu_client *self)/*{{{*/
+{
+	struct mmu_registry *reg = mmu->reg;
+	/* The pager calls back into the registry, so we collect clients
+	 * and revoke their leases after unlocking it.  Holding a
+	 * client's `lease_mutex` keeps `mmu_client_free` from
+	 * releasing it meanwhile. */
+	pthread_mutex_lock(&reg->mutex);
+	size_t cnt = 0;
+	struct mmu_client **clients = malloc(
+			(reg->nclients + 1) * sizeof(clients[0]));
+	if(!clients) {
+		pthread_mutex_unlock(&reg->mutex);
+		loge(LOG_ERROR, __FILE__, __LINE__);
+		return;
+	}
+	for(size_t b = 0; b < reg->nbuckets; ++b) {
+		for(struct mmu_client *c = reg->pid2client[b]; c; c = c->hnext) {
+			if(c == self || !c->lease) continue;
+			uint64_t lease = __atomic_load_n(c->lease, __ATOMIC_ACQUIRE);
+			if(MMU_PROTO_LEASE_USED(lease) == MMU_PROTO_LEASE_END(lease))
+				continue;
+			if(pthread_mutex_trylock(&c->lease_mutex)) continue;
+			clients[cnt++] = c;
+		}
+	}
+	pthread_mutex_unlock(&reg->mutex);
+	logd(LOG_DEBUG, "%s: revoking %zu leases\n", __func__, cnt);
+	for(size_t i = 0; i < cnt; ++i) {
+		mmu_lease_revoke(clients[i]);
+		pthread_mutex_unlock(&clients[i]->lease_mutex);
+	}
+	free(clients);
 }/*}}}*/
 
 void mmu_client_destroy(struct mmu_client *c)/*{{{*/
 {
 	loge(LOG_WARN, __FILE__, __LINE__);
 	mmu_client_log(c, __func__, "running");
-	mmu->sock2client[c->sock] = NULL;
-	c->running = 0;
-	close(c->sock);
+	/* Until `pager_destroy` gets the pager's lock, the pager may
+	 * still be paging the client's memory: its callbacks must find
+	 * the client, but not send it anything. */
+	c->killed = 1;
 	if(c->pid) { /* may get here before CREATE_REQ happens */
 		pager_destroy(c->pid);
 	}
+	mmu_registry_remove(c);
+	c->running = 0;
+	close(c->sock);
 }/*}}}*/
 /*}}}*/
 
@@ -414,11 +1326,9 @@ void mmu_client_destroy(struct mmu_client *c)/*{{{*/
  ***************************************************************************/
 struct mmu_client * mmu_client_search(pid_t pid)/*{{{*/
 {
-	for(int i = 3; i < MMU_MAX_SOCK; ++i) {
-		if(!mmu->sock2client[i]) continue;
-		if(mmu->sock2client[i]->pid == pid) return mmu->sock2client[i];
-	}
-	printf("error: pid %d not found.  aborting.\n", (int)pid);
+	struct mmu_client *c = mmu_registry_find(pid);
+	if(c) return c;
+	mmu_trace(MMU_TRACE_NOTFOUND, -1, (int32_t)pid, 0, 0);
 	logd(LOG_FATAL, "pid %d not found.  aborting.\n", (int)pid);
 	mmu_destroy();
 	exit(EXIT_FAILURE);
@@ -426,126 +1336,289 @@ struct mmu_client * mmu_client_search(pid_t pid)/*{{{*/
 
 void mmu_zero_fill(int frame)/*{{{*/
 {
-	printf("%s frame %u\n", __func__, frame);
+	mmu_trace(MMU_TRACE_ZERO_FILL, -1, frame, 0, 0);
+	mmu_stat_count(MMU_STAT_ZERO_FILLS, 1);
 	logd(LOG_DEBUG, "%s frame %u\n", __func__, frame);
-	memset(mmu->pmem + (PAGESIZE*frame), '0', PAGESIZE);
+	mmu_page_fill(mmu->pmem + (UVM_PAGESIZE*frame), '0', UVM_PAGESIZE);
 }/*}}}*/
 
 void mmu_resident(pid_t pid, void *vaddr, int frame, int prot)/*{{{*/
 {
-	int id = get_pid_id(pid);
-	printf("%s pid %d vaddr %p prot %d frame %u\n", __func__,
-			id, vaddr, prot, frame);
-	logd(LOG_DEBUG, "%s pid %d vaddr %p prot %d frame %u\n", __func__,
-			id, vaddr, prot, frame);
+	mmu_resident_range(pid, vaddr, frame, 1, prot);
+}/*}}}*/
+
+void mmu_resident_range(pid_t pid, void *vaddr, int frame, int npages,/*{{{*/
+		int prot)
+{
 	struct mmu_client *c = mmu_client_search(pid);
+	int id = c->id;
+	assert(npages > 0 && frame + npages <= mmu->npages);
+	for(int i = 0; i < npages; i++) {
+		mmu_trace(MMU_TRACE_RESIDENT, id, frame + i, prot,
+				(uintptr_t)vaddr + i * UVM_PAGESIZE);
+	}
+	logd(LOG_DEBUG, "%s pid %d vaddr %p prot %d frame %u npages %d\n",
+			__func__, id, vaddr, prot, frame, npages);
+	struct mmu_stat_proc *sp = mmu_stat_proc(id);
+	if(sp) __atomic_fetch_add(&sp->resident, npages, __ATOMIC_RELAXED);
 	struct mmu_proto_remap_rep rep;
 	rep.type = MMU_PROTO_REMAP_REP;
 	rep.prot = (int32_t)prot;
-	rep.offset = (uint64_t)(PAGESIZE * frame);
+	rep.offset = (uint64_t)(UVM_PAGESIZE * frame);
 	rep.vaddr = (intptr_t)vaddr;
-	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
-		goto out_client;
-
+	rep.npages = (uint32_t)npages;
+	for(int i = 0; i < npages; i++) {
+		struct mmu_proto_page_state *st = mmu_client_state(c,
+				(char *)vaddr + i * UVM_PAGESIZE);
+		st->frame = frame + i;
+		st->prot = (uint8_t)prot;
+		__atomic_store_n(&st->dirty, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&st->referenced, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&st->soft, 0, __ATOMIC_RELEASE);
+	}
 	/* We need these functions to wait for the application to
 	 * effect the protection change before we return to the
-	 * pager.  This loop is necessary because mmu_client_thread
-	 * is already in the pager and blocked here (so we cannot
-	 * wait on a condition variable to be signaled forward as
-	 * there is no one else to recv the REMAP_REQ message).  An
-	 * alternative approach would be to use two sockets or
-	 * threads. */
-	uint32_t t;
-	do {
-		 if(recv(c->sock, &t, sizeof(t), MSG_PEEK) != sizeof(t))
-			goto out_client;
-	} while(t != MMU_PROTO_REMAP_REQ);
-	struct mmu_proto_remap_req req;
-	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
-		goto out_client;
-	assert(req.type == MMU_PROTO_REMAP_REQ);
-	return;
-
-	out_client:
-	mmu_client_destroy(c);
+	 * pager.  The wait happens here because the client thread
+	 * may be the one blocked in the pager; requests that arrive
+	 * before the acknowledgement are stashed for later. */
+	mmu_client_notify(c, &rep, sizeof(rep), MMU_PROTO_REMAP_REQ);
 }/*}}}*/
 
 
+void mmu_oom_kill(pid_t pid)/*{{{*/
+{
+	struct mmu_client *c = mmu_client_search(pid);
+	int id = c->id;
+	mmu_trace(MMU_TRACE_OOM_KILL, id, 0, 0, 0);
+	logd(LOG_WARN, "%s pid %d: out of disk blocks\n", __func__, id);
+	if(kill(pid, SIGKILL) == -1) loge(LOG_WARN, __FILE__, __LINE__);
+	/* `mmu_client_segv` destroys the client after `pager_fault` */
+	c->killed = 1;
+}/*}}}*/
+
 void mmu_nonresident(pid_t pid, void *vaddr)/*{{{*/
 {
-	int id = get_pid_id(pid);
-	printf("%s pid %d vaddr %p\n", __func__, id, vaddr);
-	logd(LOG_DEBUG, "%s pid %d vaddr %p\n", __func__, id, vaddr);
+	mmu_nonresident_range(pid, vaddr, 1);
+}/*}}}*/
+
+void mmu_nonresident_range(pid_t pid, void *vaddr, int npages)/*{{{*/
+{
 	struct mmu_client *c = mmu_client_search(pid);
+	int id = c->id;
+	assert(npages > 0);
+	for(int i = 0; i < npages; i++) {
+		mmu_trace(MMU_TRACE_NONRESIDENT, id, 0, 0,
+				(uintptr_t)vaddr + i * UVM_PAGESIZE);
+	}
+	logd(LOG_DEBUG, "%s pid %d vaddr %p npages %d\n", __func__, id,
+			vaddr, npages);
+	struct mmu_stat_proc *sp = mmu_stat_proc(id);
+	if(sp) __atomic_fetch_sub(&sp->resident, npages, __ATOMIC_RELAXED);
+	for(int i = 0; i < npages; i++) {
+		struct mmu_proto_page_state *st = mmu_client_state(c,
+				(char *)vaddr + i * UVM_PAGESIZE);
+		st->frame = -1;
+		st->prot = PROT_NONE;
+		__atomic_store_n(&st->referenced, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&st->soft, 0, __ATOMIC_RELEASE);
+	}
 	struct mmu_proto_chprot_rep rep;
 	rep.type = MMU_PROTO_CHPROT_REP;
 	rep.prot = PROT_NONE;
 	rep.vaddr = (intptr_t)vaddr;
-	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
-		goto out_client;
-
-	uint32_t t;
-	do {
-		if(recv(c->sock, &t, sizeof(t), MSG_PEEK) != sizeof(t))
-			goto out_client;
-	} while(t != MMU_PROTO_CHPROT_REQ);
-	struct mmu_proto_chprot_req req;
-	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
-		goto out_client;
-	assert(req.type == MMU_PROTO_CHPROT_REQ);
-	return;
-
-	out_client:
-	mmu_client_destroy(c);
+	rep.npages = (uint32_t)npages;
+	mmu_client_notify(c, &rep, sizeof(rep), MMU_PROTO_CHPROT_REQ);
 }/*}}}*/
 
 void mmu_chprot(pid_t pid, void *vaddr, int prot)/*{{{*/
 {
-	int id = get_pid_id(pid);
-	printf("%s pid %d vaddr %p prot %d\n", __func__, id, vaddr, prot);
+	struct mmu_client *c = mmu_client_search(pid);
+	int id = c->id;
+	mmu_trace(MMU_TRACE_CHPROT, id, 0, prot, (uintptr_t)vaddr);
 	logd(LOG_DEBUG, "%s pid %d vaddr %p prot %d\n", __func__,
 			id, vaddr,prot);
-	struct mmu_client *c = mmu_client_search(pid);
+	/* revoking access to a resident page allows a soft fault */
+	struct mmu_proto_page_state *st = mmu_client_state(c, vaddr);
+	st->prot = (uint8_t)prot;
+	__atomic_store_n(&st->referenced, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&st->soft, prot == PROT_NONE && st->frame != -1,
+			__ATOMIC_RELEASE);
 	struct mmu_proto_chprot_rep rep;
 	rep.type = MMU_PROTO_CHPROT_REP;
 	rep.prot = (int32_t)prot;
 	rep.vaddr = (intptr_t)vaddr;
-	if(send(c->sock, &rep, sizeof(rep), 0) != sizeof(rep))
-		goto out_client;
+	rep.npages = 1;
+	mmu_client_notify(c, &rep, sizeof(rep), MMU_PROTO_CHPROT_REQ);
+}/*}}}*/
 
-	uint32_t t;
-	do {
-		if(recv(c->sock, &t, sizeof(t), MSG_PEEK) != sizeof(t))
-			goto out_client;
-	} while(t != MMU_PROTO_CHPROT_REQ);
-	struct mmu_proto_chprot_req req;
-	if(recv(c->sock, &req, sizeof(req), 0) != sizeof(req))
-		goto out_client;
-	assert(req.type == MMU_PROTO_CHPROT_REQ);
-	return;
+int mmu_referenced(pid_t pid, void *vaddr)/*{{{*/
+{
+	struct mmu_client *c = mmu_client_search(pid);
+	struct mmu_proto_page_state *st = mmu_client_state(c, vaddr);
+	int ref = __atomic_exchange_n(&st->referenced, 0, __ATOMIC_ACQ_REL);
+	logd(LOG_DEBUG, "%s pid %d vaddr %p referenced %d\n", __func__,
+			c->id, vaddr, ref);
+	return ref;
+}/*}}}*/
 
-	out_client:
-	mmu_client_destroy(c);
+int mmu_region_pages(void)/*{{{*/
+{
+	return mmu->region;
+}/*}}}*/
+
+int mmu_tracking(pid_t pid)/*{{{*/
+{
+	return mmu_client_search(pid)->track;
+}/*}}}*/
+
+int mmu_dirty(pid_t pid, void *vaddr)/*{{{*/
+{
+	struct mmu_client *c = mmu_client_search(pid);
+	struct mmu_proto_page_state *st = mmu_client_state(c, vaddr);
+	int dirty = __atomic_exchange_n(&st->dirty, 0, __ATOMIC_ACQ_REL);
+	logd(LOG_DEBUG, "%s pid %d vaddr %p dirty %d\n", __func__,
+			c->id, vaddr, dirty);
+	return dirty;
 }/*}}}*/
 
 void mmu_disk_read(int block_from, int frame_to)/*{{{*/
 {
-	printf("%s from block %d to frame %d\n", __func__,
-			block_from, frame_to);
+	mmu_trace(MMU_TRACE_DISK_READ, -1, block_from, frame_to, 0);
+	mmu_stat_count(MMU_STAT_DISK_READS, 1);
 	logd(LOG_DEBUG, "%s from block %d to frame %d\n", __func__,
 			block_from, frame_to);
-	memcpy(mmu->pmem + frame_to*PAGESIZE, mmu->disk + block_from*PAGESIZE,
-			PAGESIZE);
+	mmu_page_copy(mmu->pmem + frame_to*UVM_PAGESIZE,
+			mmu->disk + block_from*UVM_PAGESIZE, UVM_PAGESIZE);
 }/*}}}*/
 
 void mmu_disk_write(int frame_from, int block_to)/*{{{*/
 {
-	printf("%s from frame %d to block %d\n", __func__,
+	mmu_trace(MMU_TRACE_DISK_WRITE, -1, frame_from, block_to, 0);
+	mmu_stat_count(MMU_STAT_DISK_WRITES, 1);
+	logd(LOG_DEBUG, "%s from frame %d to block %d\n", __func__,
 			frame_from, block_to);
+	mmu_page_copy(mmu->disk + block_to*UVM_PAGESIZE,
+			mmu->pmem + frame_from*UVM_PAGESIZE, UVM_PAGESIZE);
+}/*}}}*/
+
+mmu_io_token_t mmu_disk_read_async(int block_from, int frame_to)/*{{{*/
+{
+	mmu_trace(MMU_TRACE_DISK_READ, -1, block_from, frame_to, 0);
+	mmu_stat_count(MMU_STAT_DISK_READS, 1);
+	logd(LOG_DEBUG, "%s from block %d to frame %d\n", __func__,
+			block_from, frame_to);
+	return mmu_io_submit(mmu->io, MMU_IO_READ, block_from,
+			mmu->pmem + frame_to*UVM_PAGESIZE);
+}/*}}}*/
+
+mmu_io_token_t mmu_disk_write_async(int frame_from, int block_to)/*{{{*/
+{
+	mmu_trace(MMU_TRACE_DISK_WRITE, -1, frame_from, block_to, 0);
+	mmu_stat_count(MMU_STAT_DISK_WRITES, 1);
 	logd(LOG_DEBUG, "%s from frame %d to block %d\n", __func__,
 			frame_from, block_to);
-	memcpy(mmu->disk + block_to*PAGESIZE, mmu->pmem + frame_from*PAGESIZE,
-			PAGESIZE);
+	return mmu_io_submit(mmu->io, MMU_IO_WRITE, block_to,
+			mmu->pmem + frame_from*UVM_PAGESIZE);
+}/*}}}*/
+
+void mmu_disk_readv(int block_from, const int *frames_to, int n)/*{{{*/
+{
+	assert(n > 0 && n <= MMU_DISK_MAXVEC);
+	for(int i = 0; i < n; i++) {
+		mmu_trace(MMU_TRACE_DISK_READ, -1, block_from + i, frames_to[i], 0);
+		mmu_page_copy(mmu->pmem + frames_to[i]*UVM_PAGESIZE,
+				mmu->disk + (block_from + i)*UVM_PAGESIZE, UVM_PAGESIZE);
+	}
+	mmu_stat_count(MMU_STAT_DISK_READS, n);
+	logd(LOG_DEBUG, "%s from block %d nblocks %d\n", __func__,
+			block_from, n);
+}/*}}}*/
+
+void mmu_disk_writev(const int *frames_from, int block_to, int n)/*{{{*/
+{
+	assert(n > 0 && n <= MMU_DISK_MAXVEC);
+	for(int i = 0; i < n; i++) {
+		mmu_trace(MMU_TRACE_DISK_WRITE, -1, frames_from[i], block_to + i, 0);
+		mmu_page_copy(mmu->disk + (block_to + i)*UVM_PAGESIZE,
+				mmu->pmem + frames_from[i]*UVM_PAGESIZE, UVM_PAGESIZE);
+	}
+	mmu_stat_count(MMU_STAT_DISK_WRITES, n);
+	logd(LOG_DEBUG, "%s to block %d nblocks %d\n", __func__,
+			block_to, n);
+}/*}}}*/
+
+/* Submits a vectored copy between frames `frames` and the `n` blocks
+ * starting at `block`. */
+static mmu_io_token_t mmu_disk_submitv(int op, const int *frames,/*{{{*/
+		int block, int n)
+{
+	char *bufs[MMU_IO_MAXVEC];
+	assert(n > 0 && n <= MMU_DISK_MAXVEC && n <= MMU_IO_MAXVEC);
+	for(int i = 0; i < n; i++) {
+		if(op == MMU_IO_READ) {
+			mmu_trace(MMU_TRACE_DISK_READ, -1, block + i, frames[i], 0);
+		} else {
+			mmu_trace(MMU_TRACE_DISK_WRITE, -1, frames[i], block + i, 0);
+		}
+		bufs[i] = mmu->pmem + frames[i]*UVM_PAGESIZE;
+	}
+	mmu_stat_count(op == MMU_IO_READ ? MMU_STAT_DISK_READS :
+			MMU_STAT_DISK_WRITES, n);
+	return mmu_io_submitv(mmu->io, op, block, bufs, n);
+}/*}}}*/
+
+mmu_io_token_t mmu_disk_readv_async(int block_from, const int *frames_to,/*{{{*/
+		int n)
+{
+	logd(LOG_DEBUG, "%s from block %d nblocks %d\n", __func__,
+			block_from, n);
+	return mmu_disk_submitv(MMU_IO_READ, frames_to, block_from, n);
+}/*}}}*/
+
+mmu_io_token_t mmu_disk_writev_async(const int *frames_from, int block_to,/*{{{*/
+		int n)
+{
+	logd(LOG_DEBUG, "%s to block %d nblocks %d\n", __func__,
+			block_to, n);
+	return mmu_disk_submitv(MMU_IO_WRITE, frames_from, block_to, n);
+}/*}}}*/
+
+int mmu_disk_poll(mmu_io_token_t token)/*{{{*/
+{
+	return mmu_io_poll(mmu->io, token);
+}/*}}}*/
+
+void mmu_disk_wait(mmu_io_token_t token)/*{{{*/
+{
+	mmu_io_wait(mmu->io, token);
+}/*}}}*/
+
+int mmu_disk_equal(int frame, int block)/*{{{*/
+{
+	int equal = mmu_page_equal(mmu->pmem + frame*UVM_PAGESIZE,
+			mmu->disk + block*UVM_PAGESIZE, UVM_PAGESIZE);
+	logd(LOG_DEBUG, "%s frame %d block %d equal %d\n", __func__,
+			frame, block, equal);
+	return equal;
+}/*}}}*/
+
+void mmu_print(const char *buf, size_t len)/*{{{*/
+{
+	mmu_trace_text(buf, len);
+}/*}}}*/
+
+void mmu_stat_count(int counter, uint64_t n)/*{{{*/
+{
+	assert(counter >= 0 && counter < MMU_STAT_NCOUNTERS);
+	__atomic_fetch_add(&mmu->stats->counters[counter].value, n,
+			__ATOMIC_RELAXED);
+}/*}}}*/
+
+/* Returns the statistics slot of client `id`, or NULL if it has none. */
+struct mmu_stat_proc * mmu_stat_proc(int id)/*{{{*/
+{
+	if(id < 0 || id >= MMU_STAT_MAXPROCS) return NULL;
+	return &mmu->stats->procs[id];
 }/*}}}*/
 /*}}}*/
 
@@ -556,30 +1629,134 @@ void mmu_disk_write(int frame_from, int block_to)/*{{{*/
 void pager_free(void);
 #endif
 void usage(int argc, char **argv) {/*{{{*/
-	printf("usage: %s NFRAMES NBLOCKS\n", argv[0]);
+	printf("usage: %s [-Hq] [-c WINDOW] [-i MS] [-l NPAGES] [-o MODE] "
+			"[-p WINDOW] [-r NPAGES] [-s MS] [-t TRACEFILE] [-z NFRAMES] "
+			"NFRAMES NBLOCKS\n", argv[0]);
+	printf("\n");
+	printf("  -H            back frames with 2MiB huge pages; needs a\n");
+	printf("                build with UVM_PAGESHIFT >= 21\n");
+	printf("  -c WINDOW     suspend processes while paging thrashes,\n");
+	printf("                measuring faults every WINDOW faults\n");
+	printf("  -i MS         page out all pages of clients that send no\n");
+	printf("                request for MS milliseconds\n");
+	printf("  -l NPAGES     lease NPAGES pages to clients at a time so\n");
+	printf("                they can extend without messaging the MMU\n");
+	printf("  -o MODE       disk block overcommit: strict (default),\n");
+	printf("                heuristic, or unlimited\n");
+	printf("  -p WINDOW     move frames to processes that fault more,\n");
+	printf("                measuring faults every WINDOW faults\n");
+	printf("  -q            do not print events to stdout\n");
+	printf("  -r NPAGES     let each client allocate up to NPAGES pages\n");
+	printf("                (default %d, at most %d)\n", UVM_DEFPAGES,
+			UVM_MAXPAGES);
+	printf("  -s MS         track page state with the kernel, sampling\n");
+	printf("                accesses every MS milliseconds\n");
+	printf("  -t TRACEFILE  record a binary trace (decode with mmudump)\n");
+	printf("  -z NFRAMES    keep NFRAMES free frames zeroed in advance\n");
 	printf("\n");
-	printf("valid ranges: 2 <= NFRAMES <= 256\n");
-	printf("              4 <= NBLOCKS <= 1024\n");
+	printf("page size: %zu bytes\n", UVM_PAGESIZE);
+	printf("valid ranges: 2 <= NFRAMES <= %d\n", MMU_MAX_FRAMES);
+	printf("              4 <= NBLOCKS <= %d\n", MMU_MAX_BLOCKS);
 	exit(EXIT_FAILURE);
 }/*}}}*/
 
 int main(int argc, char **argv) {/*{{{*/
-	if(argc != 3) usage(argc, argv);
-	int npages = atoi(argv[1]);
-	if(npages < 1 || npages > 256) usage(argc, argv);
-	int nblocks = atoi(argv[2]);
-	if(nblocks < 2 || nblocks > 1024) usage(argc, argv);
+	int live = 1;
+	int track_ms = 0;
+	int lease = 0;
+	int region = UVM_DEFPAGES;
+	int huge = 0;
+	int overcommit = PAGER_OVERCOMMIT_STRICT;
+	int pff = 0;
+	int loadctl = 0;
+	int idle_ms = 0;
+	int zero_pool = 0;
+	const char *tracefn = NULL;
+	int opt;
+	while((opt = getopt(argc, argv, "Hc:i:l:o:p:qr:s:t:z:")) != -1) {
+		switch(opt) {
+		case 'H':
+			if(UVM_PAGESIZE % MMU_HUGE_FRAME != 0) usage(argc, argv);
+			huge = 1;
+			break;
+		case 'c':
+			loadctl = atoi(optarg);
+			if(loadctl < 1) usage(argc, argv);
+			break;
+		case 'i':
+			idle_ms = atoi(optarg);
+			if(idle_ms < 1) usage(argc, argv);
+			break;
+		case 'l':
+			lease = atoi(optarg);
+			if(lease < 1) usage(argc, argv);
+			break;
+		case 'o':
+			if(strcmp(optarg, "strict") == 0) {
+				overcommit = PAGER_OVERCOMMIT_STRICT;
+			} else if(strcmp(optarg, "heuristic") == 0) {
+				overcommit = PAGER_OVERCOMMIT_HEURISTIC;
+			} else if(strcmp(optarg, "unlimited") == 0) {
+				overcommit = PAGER_OVERCOMMIT_UNLIMITED;
+			} else {
+				usage(argc, argv);
+			}
+			break;
+		case 'p':
+			pff = atoi(optarg);
+			if(pff < 1) usage(argc, argv);
+			break;
+		case 'q':
+			live = 0;
+			break;
+		case 'r':
+			region = atoi(optarg);
+			if(region < 1 || region > UVM_MAXPAGES) usage(argc, argv);
+			break;
+		case 's':
+			track_ms = atoi(optarg);
+			if(track_ms < 1) usage(argc, argv);
+			break;
+		case 't':
+			tracefn = optarg;
+			break;
+		case 'z':
+			zero_pool = atoi(optarg);
+			if(zero_pool < 1) usage(argc, argv);
+			break;
+		default:
+			usage(argc, argv);
+		}
+	}
+	if(argc - optind != 2) usage(argc, argv);
+	int npages = atoi(argv[optind]);
+	if(npages < 1 || npages > MMU_MAX_FRAMES) usage(argc, argv);
+	int nblocks = atoi(argv[optind+1]);
+	if(nblocks < 2 || nblocks > MMU_MAX_BLOCKS) usage(argc, argv);
+	if(UVM_PAGESIZE % (size_t)sysconf(_SC_PAGESIZE) != 0) {
+		printf("page size %zu is not a multiple of the system's\n",
+				UVM_PAGESIZE);
+		exit(EXIT_FAILURE);
+	}
 	#ifdef MMULOG
 	log_init(LOG_EXTRA, "mmu.log", 1, 1<<20);
+	#ifdef LOGASYNC
+	log_async(LOG_ASYNC_FLUSH_MS, LOG_ASYNC_FLUSH_BYTES);
+	#endif
 	#endif
-	memset(id2pid, 255, UINT8_MAX * sizeof(pid_t));
-	mmu_init(npages, nblocks);
+	mmu_trace_init(tracefn, live);
+	mmu_init(npages, nblocks, region, track_ms, lease, idle_ms, huge);
 	pager_init(npages, nblocks);
+	pager_overcommit(overcommit);
+	if(pff) pager_pff(pff);
+	if(loadctl) pager_load_control(loadctl);
+	if(zero_pool) pager_zero_pool(zero_pool);
 	mmu_accept_loop();
 	#ifdef MMUFREE
 	pager_free();
 	#endif
 	mmu_destroy();
+	mmu_trace_destroy();
 	#ifdef MMULOG
 	log_destroy();
 	#endif
@@ -5,19 +5,27 @@
 #ifndef __MMU_HEADER__
 #define __MMU_HEADER__
 
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "mmustat.h"
+#include "uvm.h"
+
 /* `UVM_BASEADDR` is where virtual pages will be mapped in process
  * virtual address spaces.  This address is not normally used by the
- * Linux kernel.  The page size for the architecture can be obtained
- * using `sysconf(_SC_PAGESIZE)`.  For usual 4KiB pages, a process
- * first page would have addresses ranging from `UVM_BASEADDR` to
+ * Linux kernel.  Pages and frames are `UVM_PAGESIZE` bytes long (see
+ * uvm.h), a compile-time constant.  For the default 4KiB pages, a
+ * process first page would have addresses ranging from `UVM_BASEADDR` to
  * `UVM_BASEADDR + 0xFFF`. */
 #define UVM_BASEADDR ((intptr_t)0x60000000)
 
-/* Programs can allocate a maximum of 1MiB (256 4KiB pages) in the
- * infrastructure; the maximum address managed by the MMU is
- * `UVM_MAXADDR`.  Only faults for addresses between `UVM_BASEADDR`
- * and `UVM_MAXADDR` are sent to the pager. */
-#define UVM_MAXADDR ((intptr_t)0x600FFFFF)
+/* Programs can allocate a maximum of `mmu_region_pages()` pages in
+ * the infrastructure: 256 by default (1MiB with 4KiB pages), up to
+ * `UVM_MAXPAGES` if the MMU is started with `-r NPAGES`.  Only faults
+ * for addresses in the first `mmu_region_pages()` pages after
+ * `UVM_BASEADDR` are sent to the pager. */
+#define UVM_DEFPAGES 256
+#define UVM_MAXPAGES (1 << 24)
 
 /* `pmem` points to the physical memory maintained by the MMU.  Your
  * pager should never write to `pmem`.  */
@@ -25,7 +33,7 @@ extern const char *pmem;
 
 /* All functions in this module are blocking, i.e., they only return after
  * changes to physical memory, disk, and program virtual addresses are
- * complete.  */
+ * complete.  The only exceptions are the `_async` disk functions.  */
 
 /* `mmu_zero_fill` will fill `frame` with zeroes (character '0').
  * Your page should use this function to initialize memory before
@@ -39,16 +47,64 @@ void mmu_zero_fill(int frame);
  * | PROT_WRITE`; these constants are defined in <sys/mman.h>.  */
 void mmu_resident(pid_t pid, void *vaddr, int frame, int prot);
 
+/* `mmu_resident_range` maps `npages` consecutive pages starting at
+ * `vaddr` to frames `frame` to `frame + npages - 1`.  It is
+ * equivalent to calling `mmu_resident` for each page, but the process
+ * maps the whole range at once.  */
+void mmu_resident_range(pid_t pid, void *vaddr, int frame, int npages,
+		int prot);
+
 /* `mmu_nonresident` will mark the page starting at `vaddr` as
  * inacessible by process `pid`.  See `mmu_resident` above for the
  * semantics on `vaddr` and `prot`.  */
 void mmu_nonresident(pid_t pid, void *vaddr);
 
+/* `mmu_nonresident_range` marks `npages` consecutive pages starting
+ * at `vaddr` as inaccessible.  It is equivalent to calling
+ * `mmu_nonresident` for each page, but the process unmaps the whole
+ * range at once.  */
+void mmu_nonresident_range(pid_t pid, void *vaddr, int npages);
+
 /* `mmu_chprot` will change access permissions for the page starting
  * at `vaddr` to `prot`.  See `mmu_resident` above for the semantics
  * on `vaddr` and `prot`.  */
 void mmu_chprot(pid_t pid, void *vaddr, int prot);
 
+/* `mmu_referenced` returns nonzero if process `pid` accessed the page
+ * at `vaddr` after `mmu_chprot` set it to `PROT_NONE` while resident.
+ * Processes handle these faults without calling `pager_fault`: they
+ * restore `PROT_READ` by themselves and record the access.  A nonzero
+ * return thus also means the page is now mapped with `PROT_READ`.
+ * For processes with page-state tracking (see `mmu_tracking`), a
+ * nonzero return also means the page was accessed since the previous
+ * call, as sampled by the process.  The indication is cleared on
+ * return.  */
+int mmu_referenced(pid_t pid, void *vaddr);
+
+/* `mmu_region_pages` returns the maximum number of pages a process
+ * can allocate.  It does not change while the MMU runs.  */
+int mmu_region_pages(void);
+
+/* `mmu_tracking` returns nonzero if the MMU was started with `-s`
+ * and process `pid` tracks page state with the kernel.  Such
+ * processes report accesses through `mmu_referenced` and writes
+ * through `mmu_dirty`, so your pager may map pages with `PROT_READ |
+ * PROT_WRITE` right away instead of trapping the first write.  */
+int mmu_tracking(pid_t pid);
+
+/* `mmu_dirty` returns nonzero if process `pid` wrote to the page at
+ * `vaddr` after `mmu_resident` mapped it.  It is only meaningful for
+ * processes with tracking, after `mmu_nonresident` (or `mmu_chprot`
+ * to `PROT_NONE`) revoked access to the page.  The indication is
+ * cleared on return.  */
+int mmu_dirty(pid_t pid, void *vaddr);
+
+/* `mmu_oom_kill` kills process `pid` with SIGKILL.  Your pager may
+ * call it from `pager_fault` when it cannot service the fault because
+ * no page can be paged out.  The MMU calls `pager_destroy` for the
+ * process after `pager_fault` returns.  */
+void mmu_oom_kill(pid_t pid);
+
 /* `mmu_disk_read` copies content from disk block `block_from` into
  * physical frame `frame_to`.  `mmu_disk_write` copies content from
  * frame `frame_from` to disk block `block_to`.  Your pager shoudl
@@ -56,4 +112,54 @@ void mmu_chprot(pid_t pid, void *vaddr, int prot);
 void mmu_disk_read(int block_from, int frame_to);
 void mmu_disk_write(int frame_from, int block_to);
 
+/* `mmu_disk_read_async` and `mmu_disk_write_async` behave like
+ * `mmu_disk_read` and `mmu_disk_write`, but return as soon as the
+ * copy is submitted.  They return a nonzero token that identifies
+ * the I/O.  `mmu_disk_poll` returns nonzero if the I/O identified by
+ * `token` has completed; `mmu_disk_wait` blocks until it completes.
+ * A zero token is always complete.  Your pager must wait for an I/O
+ * before reusing (or mapping) the frame involved in it.  */
+typedef uint64_t mmu_io_token_t;
+mmu_io_token_t mmu_disk_read_async(int block_from, int frame_to);
+mmu_io_token_t mmu_disk_write_async(int frame_from, int block_to);
+int mmu_disk_poll(mmu_io_token_t token);
+void mmu_disk_wait(mmu_io_token_t token);
+
+/* `mmu_disk_equal` returns nonzero if frame `frame` holds the same
+ * content as disk block `block`.  Your pager may use it to skip
+ * writing a page that did not change since it was last saved.  A
+ * write to `block` that is still pending may make it return zero.  */
+int mmu_disk_equal(int frame, int block);
+
+/* `mmu_disk_readv` copies `n` consecutive disk blocks, starting at
+ * `block_from`, into frames `frames_to[0]` to `frames_to[n-1]`;
+ * `mmu_disk_writev` copies frames `frames_from[0]` to
+ * `frames_from[n-1]` into `n` consecutive blocks starting at
+ * `block_to`.  They are equivalent to one `mmu_disk_read` or
+ * `mmu_disk_write` per block, but move all blocks in a single
+ * sequential disk I/O.  The `_async` variants return one token for
+ * the whole I/O.  `n` must be between 1 and `MMU_DISK_MAXVEC`.  */
+#define MMU_DISK_MAXVEC 32
+void mmu_disk_readv(int block_from, const int *frames_to, int n);
+void mmu_disk_writev(const int *frames_from, int block_to, int n);
+mmu_io_token_t mmu_disk_readv_async(int block_from, const int *frames_to,
+		int n);
+mmu_io_token_t mmu_disk_writev_async(const int *frames_from, int block_to,
+		int n);
+
+/* `mmu_print` writes `len` bytes from `buf` to the MMU output.  Your
+ * pager should use this function instead of `printf` so its output
+ * stays in order with MMU events when the MMU records a binary
+ * trace or runs with live output disabled.  */
+void mmu_print(const char *buf, size_t len);
+
+/* `mmu_stat_count` adds `n` to `counter` in the statistics segment
+ * (see mmustat.h).  Your pager should count the faults it services
+ * by kind (`MMU_STAT_FAULT_*`), the pages it evicts
+ * (`MMU_STAT_EVICT_CLEAN` or `MMU_STAT_EVICT_DIRTY`), and, for each
+ * victim its clock chooses, one `MMU_STAT_CLOCK_VICTIMS` and the
+ * pages the hand passed in `MMU_STAT_CLOCK_STEPS`.  It is cheap and
+ * takes no locks.  */
+void mmu_stat_count(int counter, uint64_t n);
+
 #endif
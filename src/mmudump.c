@@ -0,0 +1,67 @@
+/* UNIVERSIDADE FEDERAL DE MINAS GERAIS     *
+ * DEPARTAMENTO DE CIENCIA DA COMPUTACAO    *
+ * Copyright (c) Italo Fernando Scota Cunha */
+
+/* `mmudump` decodes a binary trace recorded with `mmu -t TRACEFILE`
+ * and prints it in the same format as the MMU's live output, so it
+ * can be diffed against `.mmu.out` files. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mmutrace.h"
+
+static int rec_cmp(const void *va, const void *vb)/*{{{*/
+{
+	const struct mmu_trace_rec *a = va;
+	const struct mmu_trace_rec *b = vb;
+	if(a->seq < b->seq) return -1;
+	return a->seq > b->seq;
+}/*}}}*/
+
+int main(int argc, char **argv) {/*{{{*/
+	if(argc != 2) {
+		printf("usage: %s TRACEFILE\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	FILE *in = fopen(argv[1], "r");
+	if(!in) {
+		perror(argv[1]);
+		exit(EXIT_FAILURE);
+	}
+	char magic[sizeof(MMU_TRACE_MAGIC)];
+	size_t mlen = strlen(MMU_TRACE_MAGIC);
+	if(fread(magic, 1, mlen, in) != mlen ||
+			memcmp(magic, MMU_TRACE_MAGIC, mlen) != 0) {
+		fprintf(stderr, "%s: not an MMU trace\n", argv[1]);
+		exit(EXIT_FAILURE);
+	}
+
+	size_t nrecs = 0;
+	size_t cap = 1024;
+	struct mmu_trace_rec *recs = malloc(cap * sizeof(recs[0]));
+	while(recs) {
+		if(nrecs == cap) {
+			cap *= 2;
+			recs = realloc(recs, cap * sizeof(recs[0]));
+			if(!recs) break;
+		}
+		size_t n = fread(recs + nrecs, sizeof(recs[0]), cap - nrecs, in);
+		if(n == 0) break;
+		nrecs += n;
+	}
+	if(!recs) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	fclose(in);
+
+	/* records are saved per thread; restore global order */
+	qsort(recs, nrecs, sizeof(recs[0]), rec_cmp);
+	for(size_t i = 0; i < nrecs; ++i) {
+		mmu_trace_format(stdout, &recs[i]);
+	}
+	free(recs);
+	exit(EXIT_SUCCESS);
+}/*}}}*/
@@ -0,0 +1,397 @@
+/* UNIVERSIDADE FEDERAL DE MINAS GERAIS     *
+ * DEPARTAMENTO DE CIENCIA DA COMPUTACAO    *
+ * Copyright (c) Italo Fernando Scota Cunha */
+
+#include "mmuio.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef MMUIOURING
+#include <linux/io_uring.h>
+#endif
+
+#include "log.h"
+#include "mmupage.h"
+
+#define MMU_IO_DEPTH 64
+#define MMU_IO_NTHREADS 4
+
+#define MMU_IO_THREADPOOL 1
+#define MMU_IO_URING 2
+
+/****************************************************************************
+ * structure definitions
+ ***************************************************************************/
+struct mmu_io_req {/*{{{*/
+	uint64_t token;
+	int op;
+	int done;
+	off_t off;
+	int niov;
+	struct iovec iov[MMU_IO_MAXVEC];
+};/*}}}*/
+
+#ifdef MMUIOURING
+struct mmu_io_uring {/*{{{*/
+	int fd;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+	struct io_uring_sqe *sqes;
+	void *sq_ptr;
+	size_t sq_sz;
+	void *cq_ptr;
+	size_t cq_sz;
+	size_t sqes_sz;
+};/*}}}*/
+#endif
+
+struct mmu_io {/*{{{*/
+	int backend;
+	int running;
+	int disk_fd;
+	char *disk;
+	size_t blksz;
+	uint64_t next;     /* token of the next submitted request */
+	uint64_t head;     /* token of the next request for a worker */
+	struct mmu_io_req reqs[MMU_IO_DEPTH];
+	pthread_mutex_t mutex;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	pthread_t threads[MMU_IO_NTHREADS];
+	#ifdef MMUIOURING
+	struct mmu_io_uring ring;
+	#endif
+};/*}}}*/
+
+/****************************************************************************
+ * static function declarations
+ ***************************************************************************/
+static void * mmu_io_thread(void *vio);
+static void mmu_io_copy(struct mmu_io *io, const struct mmu_io_req *r);
+static void mmu_io_complete(struct mmu_io *io, uint64_t token, int res);
+#ifdef MMUIOURING
+static int mmu_io_uring_init(struct mmu_io *io);
+static void mmu_io_uring_destroy(struct mmu_io *io);
+static void mmu_io_uring_submit(struct mmu_io *io, struct mmu_io_req *r);
+static void mmu_io_uring_reap(struct mmu_io *io, int wait);
+#endif
+
+/****************************************************************************
+ * external functions {{{
+ ***************************************************************************/
+struct mmu_io * mmu_io_init(int disk_fd, char *disk, size_t blksz)/*{{{*/
+{
+	struct mmu_io *io = calloc(1, sizeof(*io));
+	if(!io) logea(__FILE__, __LINE__, NULL);
+	io->running = 1;
+	io->disk_fd = disk_fd;
+	io->disk = disk;
+	io->blksz = blksz;
+	io->next = 1;
+	io->head = 1;
+	pthread_mutex_init(&io->mutex, NULL);
+	pthread_cond_init(&io->work, NULL);
+	pthread_cond_init(&io->done, NULL);
+
+	#ifdef MMUIOURING
+	if(mmu_io_uring_init(io) == 0) {
+		io->backend = MMU_IO_URING;
+		logd(LOG_INFO, "%s: io_uring fd %d depth %d\n", __func__,
+				io->ring.fd, MMU_IO_DEPTH);
+		return io;
+	}
+	loge(LOG_WARN, __FILE__, __LINE__);
+	logd(LOG_WARN, "%s: io_uring unavailable, using threads\n", __func__);
+	#endif
+
+	io->backend = MMU_IO_THREADPOOL;
+	for(int i = 0; i < MMU_IO_NTHREADS; ++i) {
+		if(pthread_create(&io->threads[i], NULL, mmu_io_thread, io))
+			logea(__FILE__, __LINE__, NULL);
+	}
+	logd(LOG_INFO, "%s: %d threads depth %d\n", __func__,
+			MMU_IO_NTHREADS, MMU_IO_DEPTH);
+	return io;
+}/*}}}*/
+
+void mmu_io_destroy(struct mmu_io *io)/*{{{*/
+{
+	uint64_t first = io->next > MMU_IO_DEPTH ? io->next - MMU_IO_DEPTH : 1;
+	for(uint64_t token = first; token < io->next; ++token)
+		mmu_io_wait(io, token);
+	pthread_mutex_lock(&io->mutex);
+	io->running = 0;
+	pthread_cond_broadcast(&io->work);
+	pthread_mutex_unlock(&io->mutex);
+	if(io->backend == MMU_IO_THREADPOOL) {
+		for(int i = 0; i < MMU_IO_NTHREADS; ++i)
+			pthread_join(io->threads[i], NULL);
+	}
+	#ifdef MMUIOURING
+	if(io->backend == MMU_IO_URING) mmu_io_uring_destroy(io);
+	#endif
+	pthread_cond_destroy(&io->done);
+	pthread_cond_destroy(&io->work);
+	pthread_mutex_destroy(&io->mutex);
+	free(io);
+}/*}}}*/
+
+uint64_t mmu_io_submit(struct mmu_io *io, int op, int block, char *buf)/*{{{*/
+{
+	return mmu_io_submitv(io, op, block, &buf, 1);
+}/*}}}*/
+
+uint64_t mmu_io_submitv(struct mmu_io *io, int op, int block,/*{{{*/
+		char * const *bufs, int n)
+{
+	assert(op == MMU_IO_READ || op == MMU_IO_WRITE);
+	assert(n > 0 && n <= MMU_IO_MAXVEC);
+	pthread_mutex_lock(&io->mutex);
+	uint64_t token = io->next;
+	struct mmu_io_req *r = &io->reqs[token % MMU_IO_DEPTH];
+	/* the slot is still in use by a request MMU_IO_DEPTH tokens
+	 * old; wait for it to complete before reusing it. */
+	while(r->token && !r->done) {
+		#ifdef MMUIOURING
+		if(io->backend == MMU_IO_URING) {
+			mmu_io_uring_reap(io, 1);
+			continue;
+		}
+		#endif
+		pthread_cond_wait(&io->done, &io->mutex);
+	}
+	r->token = token;
+	r->op = op;
+	r->done = 0;
+	r->off = (off_t)block * (off_t)io->blksz;
+	r->niov = n;
+	for(int i = 0; i < n; ++i) {
+		r->iov[i].iov_base = bufs[i];
+		r->iov[i].iov_len = io->blksz;
+	}
+	io->next++;
+	#ifdef MMUIOURING
+	if(io->backend == MMU_IO_URING) {
+		mmu_io_uring_submit(io, r);
+		pthread_mutex_unlock(&io->mutex);
+		return token;
+	}
+	#endif
+	pthread_cond_signal(&io->work);
+	pthread_mutex_unlock(&io->mutex);
+	return token;
+}/*}}}*/
+
+int mmu_io_poll(struct mmu_io *io, uint64_t token)/*{{{*/
+{
+	if(token == 0) return 1;
+	pthread_mutex_lock(&io->mutex);
+	assert(token < io->next);
+	#ifdef MMUIOURING
+	if(io->backend == MMU_IO_URING) mmu_io_uring_reap(io, 0);
+	#endif
+	const struct mmu_io_req *r = &io->reqs[token % MMU_IO_DEPTH];
+	/* a slot holding a newer token means `token` completed long ago */
+	int done = (r->token != token) || r->done;
+	pthread_mutex_unlock(&io->mutex);
+	return done;
+}/*}}}*/
+
+void mmu_io_wait(struct mmu_io *io, uint64_t token)/*{{{*/
+{
+	if(token == 0) return;
+	pthread_mutex_lock(&io->mutex);
+	assert(token < io->next);
+	const struct mmu_io_req *r = &io->reqs[token % MMU_IO_DEPTH];
+	while(r->token == token && !r->done) {
+		#ifdef MMUIOURING
+		if(io->backend == MMU_IO_URING) {
+			mmu_io_uring_reap(io, 1);
+			continue;
+		}
+		#endif
+		pthread_cond_wait(&io->done, &io->mutex);
+	}
+	pthread_mutex_unlock(&io->mutex);
+}/*}}}*/
+
+const char * mmu_io_backend(const struct mmu_io *io)/*{{{*/
+{
+	return io->backend == MMU_IO_URING ? "io_uring" : "threads";
+}/*}}}*/
+/*}}}*/
+
+/****************************************************************************
+ * thread pool backend {{{
+ ***************************************************************************/
+void * mmu_io_thread(void *vio)/*{{{*/
+{
+	struct mmu_io *io = vio;
+	pthread_mutex_lock(&io->mutex);
+	while(io->running) {
+		if(io->head == io->next) {
+			pthread_cond_wait(&io->work, &io->mutex);
+			continue;
+		}
+		struct mmu_io_req r = io->reqs[io->head % MMU_IO_DEPTH];
+		io->head++;
+		pthread_mutex_unlock(&io->mutex);
+		mmu_io_copy(io, &r);
+		pthread_mutex_lock(&io->mutex);
+		mmu_io_complete(io, r.token, (int)io->blksz * r.niov);
+	}
+	pthread_mutex_unlock(&io->mutex);
+	return NULL;
+}/*}}}*/
+
+void mmu_io_copy(struct mmu_io *io, const struct mmu_io_req *r)/*{{{*/
+{
+	char *disk = io->disk + r->off;
+	for(int i = 0; i < r->niov; ++i) {
+		if(r->op == MMU_IO_READ) {
+			mmu_page_copy(r->iov[i].iov_base, disk, io->blksz);
+		} else {
+			mmu_page_copy(disk, r->iov[i].iov_base, io->blksz);
+		}
+		disk += io->blksz;
+	}
+}/*}}}*/
+
+/* Called with `io->mutex` locked. */
+void mmu_io_complete(struct mmu_io *io, uint64_t token, int res)/*{{{*/
+{
+	struct mmu_io_req *r = &io->reqs[token % MMU_IO_DEPTH];
+	assert(r->token == token);
+	if(res != (int)io->blksz * r->niov) {
+		errno = res < 0 ? -res : EIO;
+		loge(LOG_ERROR, __FILE__, __LINE__);
+		logd(LOG_ERROR, "%s: token %llu short I/O %d\n", __func__,
+				(unsigned long long)token, res);
+	}
+	r->done = 1;
+	pthread_cond_broadcast(&io->done);
+}/*}}}*/
+/*}}}*/
+
+/****************************************************************************
+ * io_uring backend {{{
+ ***************************************************************************/
+#ifdef MMUIOURING
+int mmu_io_uring_init(struct mmu_io *io)/*{{{*/
+{
+	struct mmu_io_uring *ring = &io->ring;
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	ring->fd = (int)syscall(__NR_io_uring_setup, MMU_IO_DEPTH, &p);
+	if(ring->fd < 0) return -1;
+
+	int prot = PROT_READ | PROT_WRITE;
+	int flags = MAP_SHARED | MAP_POPULATE;
+	ring->sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->sq_ptr = mmap(NULL, ring->sq_sz, prot, flags, ring->fd,
+			IORING_OFF_SQ_RING);
+	if(ring->sq_ptr == MAP_FAILED) goto out_fd;
+	ring->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	ring->cq_ptr = mmap(NULL, ring->cq_sz, prot, flags, ring->fd,
+			IORING_OFF_CQ_RING);
+	if(ring->cq_ptr == MAP_FAILED) goto out_sq;
+	ring->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_sz, prot, flags, ring->fd,
+			IORING_OFF_SQES);
+	if(ring->sqes == MAP_FAILED) goto out_cq;
+
+	char *sq = ring->sq_ptr;
+	char *cq = ring->cq_ptr;
+	ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+	ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+	ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+	ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+
+	out_cq:
+	munmap(ring->cq_ptr, ring->cq_sz);
+	out_sq:
+	munmap(ring->sq_ptr, ring->sq_sz);
+	out_fd:
+	close(ring->fd);
+	return -1;
+}/*}}}*/
+
+void mmu_io_uring_destroy(struct mmu_io *io)/*{{{*/
+{
+	struct mmu_io_uring *ring = &io->ring;
+	munmap(ring->sqes, ring->sqes_sz);
+	munmap(ring->cq_ptr, ring->cq_sz);
+	munmap(ring->sq_ptr, ring->sq_sz);
+	close(ring->fd);
+}/*}}}*/
+
+/* Called with `io->mutex` locked. */
+void mmu_io_uring_submit(struct mmu_io *io, struct mmu_io_req *r)/*{{{*/
+{
+	struct mmu_io_uring *ring = &io->ring;
+	unsigned tail = *ring->sq_tail;
+	unsigned idx = tail & *ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	/* the iovecs live in the request slot until it completes */
+	sqe->opcode = r->op == MMU_IO_READ ? IORING_OP_READV : IORING_OP_WRITEV;
+	sqe->fd = io->disk_fd;
+	sqe->off = (uint64_t)r->off;
+	sqe->addr = (uint64_t)(uintptr_t)r->iov;
+	sqe->len = (uint32_t)r->niov;
+	sqe->user_data = r->token;
+	ring->sq_array[idx] = idx;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	while(syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0) < 0) {
+		if(errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+			mmu_io_uring_reap(io, 0);
+			continue;
+		}
+		logea(__FILE__, __LINE__, "io_uring_enter");
+	}
+}/*}}}*/
+
+/* Called with `io->mutex` locked.  If `wait` is set, blocks until at
+ * least one completion is available. */
+void mmu_io_uring_reap(struct mmu_io *io, int wait)/*{{{*/
+{
+	struct mmu_io_uring *ring = &io->ring;
+	unsigned head = *ring->cq_head;
+	if(wait && head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		if(syscall(__NR_io_uring_enter, ring->fd, 0, 1,
+				IORING_ENTER_GETEVENTS, NULL, 0) < 0
+				&& errno != EINTR) {
+			logea(__FILE__, __LINE__, "io_uring_enter");
+		}
+	}
+	while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+		mmu_io_complete(io, cqe->user_data, cqe->res);
+		head++;
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}/*}}}*/
+#endif
+/*}}}*/
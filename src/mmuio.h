@@ -0,0 +1,58 @@
+/* UNIVERSIDADE FEDERAL DE MINAS GERAIS     *
+ * DEPARTAMENTO DE CIENCIA DA COMPUTACAO    *
+ * Copyright (c) Italo Fernando Scota Cunha */
+
+/* Asynchronous disk I/O engine used by the MMU.
+ *
+ * The disk is a file descriptor (`disk_fd`) that is also mapped in
+ * memory (`disk`).  Requests copy one block, or up to
+ * `MMU_IO_MAXVEC` consecutive blocks, between the disk and buffers
+ * in physical memory.  Each request is identified by
+ * a token; tokens are never reused and zero is never a valid token,
+ * so callers can use zero to mean "no pending I/O".
+ *
+ * When compiled with `MMUIOURING`, requests are submitted to an
+ * io_uring instance.  If io_uring is not available at runtime (or
+ * the module is compiled without it), requests are serviced by
+ * a small pool of worker threads. */
+
+#ifndef __MMUIO_HEADER__
+#define __MMUIO_HEADER__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MMU_IO_READ 1
+#define MMU_IO_WRITE 2
+#define MMU_IO_MAXVEC 32
+
+struct mmu_io;
+
+/* `mmu_io_init` creates an engine for `disk` (mapped from `disk_fd`)
+ * with blocks of `blksz` bytes.  Up to `MMU_IO_DEPTH` requests can
+ * be in flight; further submissions block until a slot completes. */
+struct mmu_io * mmu_io_init(int disk_fd, char *disk, size_t blksz);
+
+/* `mmu_io_destroy` waits for pending requests and frees the engine. */
+void mmu_io_destroy(struct mmu_io *io);
+
+/* `mmu_io_submit` queues a copy of block `block` from disk into `buf`
+ * (`MMU_IO_READ`) or from `buf` into disk (`MMU_IO_WRITE`) and returns
+ * the request's token. */
+uint64_t mmu_io_submit(struct mmu_io *io, int op, int block, char *buf);
+
+/* `mmu_io_submitv` queues a single request copying `n` consecutive
+ * blocks starting at `block`, the i-th from or into `bufs[i]`.  `n`
+ * must be between 1 and `MMU_IO_MAXVEC`. */
+uint64_t mmu_io_submitv(struct mmu_io *io, int op, int block,
+		char * const *bufs, int n);
+
+/* `mmu_io_poll` returns nonzero if request `token` has completed.
+ * `mmu_io_wait` blocks until request `token` completes. */
+int mmu_io_poll(struct mmu_io *io, uint64_t token);
+void mmu_io_wait(struct mmu_io *io, uint64_t token);
+
+/* `mmu_io_backend` returns a string describing the backend in use. */
+const char * mmu_io_backend(const struct mmu_io *io);
+
+#endif
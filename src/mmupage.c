@@ -0,0 +1,288 @@
+/* UNIVERSIDADE FEDERAL DE MINAS GERAIS     *
+ * DEPARTAMENTO DE CIENCIA DA COMPUTACAO    *
+ * Copyright (c) Italo Fernando Scota Cunha */
+
+#include "mmupage.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MMU_PAGE_X86
+#include <immintrin.h>
+#endif
+
+/* Bytes handled per loop iteration by the vector kernels. */
+#define MMU_PAGE_CHUNK 64
+
+struct mmu_page_ops {
+	const char *name;
+	void (*fill)(void *dst, int c, size_t len);
+	void (*copy)(void *dst, const void *src, size_t len);
+	int (*equal)(const void *a, const void *b, size_t len);
+	int (*filled)(const void *p, int c, size_t len);
+};
+
+/****************************************************************************
+ * libc kernels
+ ***************************************************************************/
+static void libc_fill(void *dst, int c, size_t len)/*{{{*/
+{
+	memset(dst, c, len);
+}/*}}}*/
+
+static void libc_copy(void *dst, const void *src, size_t len)/*{{{*/
+{
+	memcpy(dst, src, len);
+}/*}}}*/
+
+static int libc_equal(const void *a, const void *b, size_t len)/*{{{*/
+{
+	return memcmp(a, b, len) == 0;
+}/*}}}*/
+
+static int libc_filled(const void *p, int c, size_t len)/*{{{*/
+{
+	/* the buffer is all `c` if its first byte is and it equals
+	 * itself shifted by one byte */
+	const unsigned char *s = p;
+	if(len == 0) return 1;
+	return s[0] == (unsigned char)c && memcmp(s, s + 1, len - 1) == 0;
+}/*}}}*/
+
+static const struct mmu_page_ops libc_ops = {
+	"libc", libc_fill, libc_copy, libc_equal, libc_filled
+};
+
+#ifdef MMU_PAGE_X86
+/****************************************************************************
+ * SSE2 kernels
+ ***************************************************************************/
+__attribute__((target("sse2")))
+static void sse2_fill(void *dst, int c, size_t len)/*{{{*/
+{
+	__m128i v = _mm_set1_epi8((char)c);
+	char *d = dst;
+	for(size_t i = 0; i < len; i += MMU_PAGE_CHUNK) {
+		_mm_stream_si128((__m128i *)(d + i), v);
+		_mm_stream_si128((__m128i *)(d + i + 16), v);
+		_mm_stream_si128((__m128i *)(d + i + 32), v);
+		_mm_stream_si128((__m128i *)(d + i + 48), v);
+	}
+	_mm_sfence();
+}/*}}}*/
+
+__attribute__((target("sse2")))
+static void sse2_copy(void *dst, const void *src, size_t len)/*{{{*/
+{
+	char *d = dst;
+	const char *s = src;
+	for(size_t i = 0; i < len; i += MMU_PAGE_CHUNK) {
+		__m128i a = _mm_load_si128((const __m128i *)(s + i));
+		__m128i b = _mm_load_si128((const __m128i *)(s + i + 16));
+		__m128i e = _mm_load_si128((const __m128i *)(s + i + 32));
+		__m128i f = _mm_load_si128((const __m128i *)(s + i + 48));
+		_mm_stream_si128((__m128i *)(d + i), a);
+		_mm_stream_si128((__m128i *)(d + i + 16), b);
+		_mm_stream_si128((__m128i *)(d + i + 32), e);
+		_mm_stream_si128((__m128i *)(d + i + 48), f);
+	}
+	_mm_sfence();
+}/*}}}*/
+
+/* Returns 1 if the 64 bytes at `a` equal those at `b`. */
+__attribute__((target("sse2")))
+static inline int sse2_chunk_equal(const char *a, __m128i b0, __m128i b1,/*{{{*/
+		__m128i b2, __m128i b3)
+{
+	__m128i eq = _mm_and_si128(
+			_mm_and_si128(
+				_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)a), b0),
+				_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)(a + 16)), b1)),
+			_mm_and_si128(
+				_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)(a + 32)), b2),
+				_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)(a + 48)), b3)));
+	return _mm_movemask_epi8(eq) == 0xFFFF;
+}/*}}}*/
+
+__attribute__((target("sse2")))
+static int sse2_equal(const void *a, const void *b, size_t len)/*{{{*/
+{
+	const char *x = a;
+	const char *y = b;
+	for(size_t i = 0; i < len; i += MMU_PAGE_CHUNK) {
+		const __m128i *v = (const __m128i *)(y + i);
+		if(!sse2_chunk_equal(x + i, _mm_load_si128(v),
+				_mm_load_si128(v + 1), _mm_load_si128(v + 2),
+				_mm_load_si128(v + 3))) {
+			return 0;
+		}
+	}
+	return 1;
+}/*}}}*/
+
+__attribute__((target("sse2")))
+static int sse2_filled(const void *p, int c, size_t len)/*{{{*/
+{
+	__m128i v = _mm_set1_epi8((char)c);
+	const char *s = p;
+	for(size_t i = 0; i < len; i += MMU_PAGE_CHUNK) {
+		if(!sse2_chunk_equal(s + i, v, v, v, v)) return 0;
+	}
+	return 1;
+}/*}}}*/
+
+static const struct mmu_page_ops sse2_ops = {
+	"sse2", sse2_fill, sse2_copy, sse2_equal, sse2_filled
+};
+
+/****************************************************************************
+ * AVX2 kernels
+ ***************************************************************************/
+__attribute__((target("avx2")))
+static void avx2_fill(void *dst, int c, size_t len)/*{{{*/
+{
+	__m256i v = _mm256_set1_epi8((char)c);
+	char *d = dst;
+	for(size_t i = 0; i < len; i += MMU_PAGE_CHUNK) {
+		_mm256_stream_si256((__m256i *)(d + i), v);
+		_mm256_stream_si256((__m256i *)(d + i + 32), v);
+	}
+	_mm_sfence();
+}/*}}}*/
+
+__attribute__((target("avx2")))
+static void avx2_copy(void *dst, const void *src, size_t len)/*{{{*/
+{
+	char *d = dst;
+	const char *s = src;
+	for(size_t i = 0; i < len; i += MMU_PAGE_CHUNK) {
+		__m256i a = _mm256_load_si256((const __m256i *)(s + i));
+		__m256i b = _mm256_load_si256((const __m256i *)(s + i + 32));
+		_mm256_stream_si256((__m256i *)(d + i), a);
+		_mm256_stream_si256((__m256i *)(d + i + 32), b);
+	}
+	_mm_sfence();
+}/*}}}*/
+
+__attribute__((target("avx2")))
+static int avx2_equal(const void *a, const void *b, size_t len)/*{{{*/
+{
+	const char *x = a;
+	const char *y = b;
+	for(size_t i = 0; i < len; i += MMU_PAGE_CHUNK) {
+		__m256i eq = _mm256_and_si256(
+				_mm256_cmpeq_epi8(
+					_mm256_load_si256((const __m256i *)(x + i)),
+					_mm256_load_si256((const __m256i *)(y + i))),
+				_mm256_cmpeq_epi8(
+					_mm256_load_si256((const __m256i *)(x + i + 32)),
+					_mm256_load_si256((const __m256i *)(y + i + 32))));
+		if(_mm256_movemask_epi8(eq) != -1) return 0;
+	}
+	return 1;
+}/*}}}*/
+
+__attribute__((target("avx2")))
+static int avx2_filled(const void *p, int c, size_t len)/*{{{*/
+{
+	__m256i v = _mm256_set1_epi8((char)c);
+	const char *s = p;
+	for(size_t i = 0; i < len; i += MMU_PAGE_CHUNK) {
+		__m256i eq = _mm256_and_si256(
+				_mm256_cmpeq_epi8(
+					_mm256_load_si256((const __m256i *)(s + i)), v),
+				_mm256_cmpeq_epi8(
+					_mm256_load_si256((const __m256i *)(s + i + 32)), v));
+		if(_mm256_movemask_epi8(eq) != -1) return 0;
+	}
+	return 1;
+}/*}}}*/
+
+static const struct mmu_page_ops avx2_ops = {
+	"avx2", avx2_fill, avx2_copy, avx2_equal, avx2_filled
+};
+#endif
+
+/****************************************************************************
+ * dispatch
+ ***************************************************************************/
+static const struct mmu_page_ops *ops = &libc_ops;
+static pthread_once_t ops_once = PTHREAD_ONCE_INIT;
+
+static void mmu_page_detect(void)/*{{{*/
+{
+	#ifdef MMU_PAGE_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) {
+		ops = &avx2_ops;
+	} else if(__builtin_cpu_supports("sse2")) {
+		ops = &sse2_ops;
+	}
+	#endif
+}/*}}}*/
+
+void mmu_page_init(void)/*{{{*/
+{
+	pthread_once(&ops_once, mmu_page_detect);
+}/*}}}*/
+
+int mmu_page_select(int impl)/*{{{*/
+{
+	mmu_page_init();
+	switch(impl) {
+	case MMU_PAGE_LIBC:
+		ops = &libc_ops;
+		return 0;
+	#ifdef MMU_PAGE_X86
+	case MMU_PAGE_SSE2:
+		if(!__builtin_cpu_supports("sse2")) return -1;
+		ops = &sse2_ops;
+		return 0;
+	case MMU_PAGE_AVX2:
+		if(!__builtin_cpu_supports("avx2")) return -1;
+		ops = &avx2_ops;
+		return 0;
+	#endif
+	default:
+		return -1;
+	}
+}/*}}}*/
+
+const char * mmu_page_impl(void)/*{{{*/
+{
+	return ops->name;
+}/*}}}*/
+
+/* The vector kernels use aligned loads and stores of whole chunks. */
+static inline int mmu_page_fast(const void *a, const void *b, size_t len)/*{{{*/
+{
+	return ((uintptr_t)a % MMU_PAGE_CHUNK) == 0 &&
+			((uintptr_t)b % MMU_PAGE_CHUNK) == 0 &&
+			len % MMU_PAGE_CHUNK == 0;
+}/*}}}*/
+
+void mmu_page_fill(void *dst, int c, size_t len)/*{{{*/
+{
+	if(mmu_page_fast(dst, dst, len)) ops->fill(dst, c, len);
+	else memset(dst, c, len);
+}/*}}}*/
+
+void mmu_page_copy(void *dst, const void *src, size_t len)/*{{{*/
+{
+	if(mmu_page_fast(dst, src, len)) ops->copy(dst, src, len);
+	else memcpy(dst, src, len);
+}/*}}}*/
+
+int mmu_page_equal(const void *a, const void *b, size_t len)/*{{{*/
+{
+	if(mmu_page_fast(a, b, len)) return ops->equal(a, b, len);
+	return libc_equal(a, b, len);
+}/*}}}*/
+
+int mmu_page_is_filled(const void *p, int c, size_t len)/*{{{*/
+{
+	if(mmu_page_fast(p, p, len)) return ops->filled(p, c, len);
+	return libc_filled(p, c, len);
+}/*}}}*/
@@ -0,0 +1,53 @@
+/* UNIVERSIDADE FEDERAL DE MINAS GERAIS     *
+ * DEPARTAMENTO DE CIENCIA DA COMPUTACAO    *
+ * Copyright (c) Italo Fernando Scota Cunha */
+
+/* Page kernels used by the MMU to fill, copy, and compare frames and
+ * disk blocks.
+ *
+ * Pages the MMU copies or fills are usually cold: victims written to
+ * disk, blocks read into frames the pager just reclaimed.  On x86,
+ * the kernels use non-temporal (streaming) stores so that these
+ * copies do not evict the working set from the cache.  The AVX2 or
+ * SSE2 version is chosen at runtime from CPUID; other machines, and
+ * buffers that are not 64-byte aligned or a multiple of 64 bytes
+ * long, use libc.  Frames and blocks are page-aligned, so the MMU's
+ * calls always take the fast path. */
+
+#ifndef __MMUPAGE_HEADER__
+#define __MMUPAGE_HEADER__
+
+#include <stdlib.h>
+
+#define MMU_PAGE_LIBC 0
+#define MMU_PAGE_SSE2 1
+#define MMU_PAGE_AVX2 2
+
+/* `mmu_page_init` picks the best kernels the CPU supports.  It is
+ * called by `mmu_init`; calling it again has no effect. */
+void mmu_page_init(void);
+
+/* `mmu_page_select` forces kernels `impl` (one of `MMU_PAGE_*`), for
+ * benchmarks.  Returns -1 if the CPU does not support them, 0
+ * otherwise. */
+int mmu_page_select(int impl);
+
+/* `mmu_page_impl` returns the name of the kernels in use. */
+const char * mmu_page_impl(void);
+
+/* `mmu_page_fill` sets `len` bytes at `dst` to `c`. */
+void mmu_page_fill(void *dst, int c, size_t len);
+
+/* `mmu_page_copy` copies `len` bytes from `src` to `dst`, which must
+ * not overlap. */
+void mmu_page_copy(void *dst, const void *src, size_t len);
+
+/* `mmu_page_equal` returns 1 if the `len` bytes at `a` and `b` are
+ * equal, 0 otherwise. */
+int mmu_page_equal(const void *a, const void *b, size_t len);
+
+/* `mmu_page_is_filled` returns 1 if all `len` bytes at `p` are `c`,
+ * 0 otherwise. */
+int mmu_page_is_filled(const void *p, int c, size_t len);
+
+#endif
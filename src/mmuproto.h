@@ -20,10 +20,71 @@
  * `uvm_segv_action`) wait on a condition variable for the request
  * to be serviced.
  *
+ * `EXTEND_N` allocates `npages` consecutive pages in one request.
+ * With `MMU_PROTO_EXTEND_POPULATE` in `flags`, the MMU also makes the
+ * pages resident (sending `REMAP` messages) before replying, so the
+ * client does not fault on first access.
+ *
+ * `ADVISE` passes an access hint (`UVM_ADV_*` in uvm.h) for a range
+ * of the client's pages to the pager.  The MMU replies after the
+ * pager acts on the hint; for `UVM_ADV_WILLNEED`, this includes the
+ * `REMAP` messages for pages read in.
+ *
+ * `SHRINK` gives back all the client's pages from the `npages`-th
+ * onwards.  The MMU unmaps resident pages (sending `CHPROT` messages)
+ * and the pager frees their frames and disk blocks before the reply.
+ *
+ * `LIMIT` sets the minimum and maximum number of frames holding the
+ * client's pages (see `pager_limit`); the reply carries the pager's
+ * return code.  `STAT` asks for the client's limits and paging
+ * counters (see `pager_stat`).
+ *
+ * `HIBERNATE` pages out all the client's resident pages at once (see
+ * `pager_hibernate`); the reply carries the number of pages paged
+ * out.  The MMU also hibernates clients that send no request for the
+ * idle period given with `-i`.
+ *
+ * `EXTEND`, `EXTEND_N`, `SYSLOG`, `ADVISE`, `SHRINK`, `LIMIT`,
+ * `STAT`, `HIBERNATE`, and `SEGV` requests carry a `reqid` chosen by
+ * the client; the MMU copies it into the reply.  Clients may have
+ * several requests outstanding and use `reqid` to match replies to
+ * requests.  The MMU services each client's requests in order.
+ *
  * The `REMAP` and `CHPROT` messages are generated by the MMU and
  * are processed by `uvm_thread` asynchronously.  These messages are
  * used to service sergmentation faults and whenever the pager pages
- * some of the processes pages to disk. */
+ * some of the processes pages to disk.
+ *
+ * The `CREATE` reply also carries, as `SCM_RIGHTS` ancillary data,
+ * a file descriptor for the process's page-state table: one
+ * `struct mmu_proto_page_state` per page in the UVM region (`npages`
+ * in the reply), shared between the MMU and the client.  The MMU
+ * updates an entry before sending the REMAP or CHPROT message that
+ * changes the page.  When the MMU revokes access to a resident page
+ * with `CHPROT` (the clock's second chance), it sets `soft`; the
+ * client may then restore `PROT_READ` by itself on the next access,
+ * setting `referenced` and clearing `soft`, without sending a SEGV
+ * request.  The pager reads `referenced` through `mmu_referenced`.
+ *
+ * Clients that can track page state with the kernel (asynchronous
+ * userfaultfd write-protection and `PAGEMAP_SCAN`) set `track` in
+ * `CREATE_REQ`.  If the MMU was started with access sampling, the
+ * reply carries the sampling period in `track_ms`, and the pager may
+ * map pages writable right away.  Every `track_ms` milliseconds the
+ * client sets `referenced` for pages it accessed.  When a page loses
+ * access through `CHPROT` to `PROT_NONE`, the client sets `dirty` if
+ * the page was written since its last `REMAP`; the pager reads it
+ * through `mmu_dirty`.
+ *
+ * The table ends with the client's extend lease, a `uint64_t` word
+ * built with `MMU_PROTO_LEASE`.  Pages below `end` are allocated to
+ * the client by the pager; pages below `used` were handed out by
+ * `uvm_extend`.  While `used < end`, the client hands out pages by
+ * incrementing `used` with a compare-and-swap, without sending an
+ * `EXTEND` request.  The MMU grants leases (moving `end`) when the
+ * client is created and when an `EXTEND` finds the lease used up, and
+ * revokes the unused part (setting `end` to `used`) when disk blocks
+ * run short. */
 
 #ifndef __MMUPROTO_HEADER__
 #define __MMUPROTO_HEADER__
@@ -44,63 +105,180 @@
 #define MMU_PROTO_REMAP_REP 10
 #define MMU_PROTO_CHPROT_REQ 11
 #define MMU_PROTO_CHPROT_REP 12
+#define MMU_PROTO_EXTEND_N_REQ 13
+#define MMU_PROTO_EXTEND_N_REP 14
+#define MMU_PROTO_ADVISE_REQ 15
+#define MMU_PROTO_ADVISE_REP 16
+#define MMU_PROTO_SHRINK_REQ 17
+#define MMU_PROTO_SHRINK_REP 18
+#define MMU_PROTO_LIMIT_REQ 19
+#define MMU_PROTO_LIMIT_REP 20
+#define MMU_PROTO_STAT_REQ 21
+#define MMU_PROTO_STAT_REP 22
+#define MMU_PROTO_HIBERNATE_REQ 23
+#define MMU_PROTO_HIBERNATE_REP 24
 #define MMU_PROTO_EXIT_REQ 32
 #define MMU_PROTO_EXIT_REP 33
 
+struct mmu_proto_page_state {
+	int32_t frame;              /* -1 if not resident */
+	uint8_t prot;
+	uint8_t soft;
+	uint8_t referenced;
+	uint8_t dirty;
+} __attribute__((packed));
+
+#define MMU_PROTO_LEASE(end, used) \
+		(((uint64_t)(end) << 32) | (uint64_t)(uint32_t)(used))
+#define MMU_PROTO_LEASE_END(lease) ((uint32_t)((lease) >> 32))
+#define MMU_PROTO_LEASE_USED(lease) ((uint32_t)(lease))
+
 struct mmu_proto_create_req {
 	uint32_t type;
 	uint32_t pid;
+	uint32_t track;             /* client can track page state */
 } __attribute__((packed));
 struct mmu_proto_create_rep {
 	uint32_t type;
 	char pmem_fn[MMU_PROTO_PATH_MAX];
+	uint32_t track_ms;          /* 0 if not tracking */
+	uint32_t npages;            /* pages in the UVM region */
+	uint32_t pageshift;         /* UVM_PAGESHIFT of the MMU */
 } __attribute__((packed));
 
 struct mmu_proto_extend_req {
 	uint32_t type;
+	uint32_t reqid;
 } __attribute__((packed));
 struct mmu_proto_extend_rep {
 	uint32_t type;
+	uint32_t reqid;
+	uint64_t vaddr;
+} __attribute__((packed));
+
+#define MMU_PROTO_EXTEND_POPULATE 1
+struct mmu_proto_extend_n_req {
+	uint32_t type;
+	uint32_t reqid;
+	uint32_t npages;
+	uint32_t flags;
+} __attribute__((packed));
+struct mmu_proto_extend_n_rep {
+	uint32_t type;
+	uint32_t reqid;
+	uint32_t npages;
 	uint64_t vaddr;
 } __attribute__((packed));
 
 struct mmu_proto_syslog_req {
 	uint32_t type;
+	uint32_t reqid;
 	uint32_t len;
 	uint64_t addr;
 } __attribute__((packed));
 struct mmu_proto_syslog_rep {
 	uint32_t type;
+	uint32_t reqid;
+	uint32_t retcode;
+} __attribute__((packed));
+
+struct mmu_proto_advise_req {
+	uint32_t type;
+	uint32_t reqid;
+	int32_t advice;
+	uint64_t addr;
+	uint64_t len;
+} __attribute__((packed));
+struct mmu_proto_advise_rep {
+	uint32_t type;
+	uint32_t reqid;
 	uint32_t retcode;
 } __attribute__((packed));
 
+struct mmu_proto_shrink_req {
+	uint32_t type;
+	uint32_t reqid;
+	uint32_t npages;
+} __attribute__((packed));
+struct mmu_proto_shrink_rep {
+	uint32_t type;
+	uint32_t reqid;
+} __attribute__((packed));
+
+struct mmu_proto_limit_req {
+	uint32_t type;
+	uint32_t reqid;
+	uint32_t min_frames;
+	uint32_t max_frames;        /* 0 if unlimited */
+} __attribute__((packed));
+struct mmu_proto_limit_rep {
+	uint32_t type;
+	uint32_t reqid;
+	uint32_t retcode;
+} __attribute__((packed));
+
+struct mmu_proto_stat_req {
+	uint32_t type;
+	uint32_t reqid;
+} __attribute__((packed));
+struct mmu_proto_stat_rep {
+	uint32_t type;
+	uint32_t reqid;
+	uint32_t resident;
+	uint32_t min_frames;
+	uint32_t max_frames;        /* 0 if unlimited */
+	uint64_t faults;
+	uint64_t pageins;
+	uint64_t evictions;
+	uint64_t writes;
+	uint64_t writes_skipped;
+} __attribute__((packed));
+
+struct mmu_proto_hibernate_req {
+	uint32_t type;
+	uint32_t reqid;
+} __attribute__((packed));
+struct mmu_proto_hibernate_rep {
+	uint32_t type;
+	uint32_t reqid;
+	uint32_t npages;
+} __attribute__((packed));
+
 struct mmu_proto_segv_req {
 	uint32_t type;
+	uint32_t reqid;
 	int32_t code;
 	uint64_t addr;
 } __attribute__((packed));
 struct mmu_proto_segv_rep {
 	uint32_t type;
+	uint32_t reqid;
 } __attribute__((packed));
 // segv causes remap and chprot to happen
 
 struct mmu_proto_remap_req {
 	uint32_t type;
 } __attribute__((packed));
+/* Maps `npages` consecutive pages starting at `vaddr` to consecutive
+ * frames starting at pmem `offset`. */
 struct mmu_proto_remap_rep {
 	uint32_t type;
 	int32_t prot;
 	uint64_t offset;
 	uint64_t vaddr;
+	uint32_t npages;
 } __attribute__((packed));
 
 struct mmu_proto_chprot_req {
 	uint32_t type;
 } __attribute__((packed));
+/* Changes the protection of `npages` consecutive pages starting at
+ * `vaddr`. */
 struct mmu_proto_chprot_rep {
 	uint32_t type;
 	int32_t prot;
 	uint64_t vaddr;
+	uint32_t npages;
 } __attribute__((packed));
 
 struct mmu_proto_exit_req {
@@ -0,0 +1,170 @@
+/* UNIVERSIDADE FEDERAL DE MINAS GERAIS     *
+ * DEPARTAMENTO DE CIENCIA DA COMPUTACAO    *
+ * Copyright (c) Italo Fernando Scota Cunha */
+
+/* `mmustat` prints the rates of the MMU's statistics counters (see
+ * mmustat.h), one line every INTERVAL seconds, like vmstat.  The
+ * first line covers the time since the MMU started.  Run it in the
+ * MMU's working directory.  Columns are per second, except `clock`,
+ * the average number of pages the clock hands passed per victim, and
+ * `resid`, the pages resident over all clients.  With `-p`, each line
+ * is followed by the resident pages of each client. */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mmustat.h"
+
+#define MMUSTAT_HEADER_EVERY 20
+
+static const struct {
+	int counter;
+	const char *name;
+} columns[] = {
+	{ MMU_STAT_FAULTS, "faults" },
+	{ MMU_STAT_FAULT_ZERO, "zero" },
+	{ MMU_STAT_FAULT_MAJOR, "major" },
+	{ MMU_STAT_FAULT_MINOR, "minor" },
+	{ MMU_STAT_FAULT_WRITE, "write" },
+	{ MMU_STAT_EVICT_CLEAN, "evclean" },
+	{ MMU_STAT_EVICT_DIRTY, "evdirty" },
+	{ MMU_STAT_ZERO_FILLS, "zfill" },
+	{ MMU_STAT_DISK_READS, "dread" },
+	{ MMU_STAT_DISK_WRITES, "dwrite" },
+};
+#define NCOLUMNS (sizeof(columns) / sizeof(columns[0]))
+
+static uint64_t now_ns(void)/*{{{*/
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}/*}}}*/
+
+static void sample(const struct mmu_stat_seg *seg, uint64_t *values)/*{{{*/
+{
+	for(int i = 0; i < MMU_STAT_NCOUNTERS; i++) {
+		values[i] = __atomic_load_n(&seg->counters[i].value,
+				__ATOMIC_RELAXED);
+	}
+}/*}}}*/
+
+static void print_header(void)/*{{{*/
+{
+	for(size_t i = 0; i < NCOLUMNS; i++) printf("%8s", columns[i].name);
+	printf("%8s%8s\n", "clock", "resid");
+}/*}}}*/
+
+static void print_line(const struct mmu_stat_seg *seg, const uint64_t *prev,/*{{{*/
+		const uint64_t *cur, double secs)
+{
+	for(size_t i = 0; i < NCOLUMNS; i++) {
+		int k = columns[i].counter;
+		printf("%8.0f", (double)(cur[k] - prev[k]) / secs);
+	}
+	uint64_t victims = cur[MMU_STAT_CLOCK_VICTIMS] -
+			prev[MMU_STAT_CLOCK_VICTIMS];
+	uint64_t steps = cur[MMU_STAT_CLOCK_STEPS] - prev[MMU_STAT_CLOCK_STEPS];
+	printf("%8.1f", victims ? (double)steps / (double)victims : 0.0);
+	long resident = 0;
+	for(int i = 0; i < MMU_STAT_MAXPROCS; i++) {
+		if(!__atomic_load_n(&seg->procs[i].pid, __ATOMIC_ACQUIRE)) continue;
+		resident += __atomic_load_n(&seg->procs[i].resident,
+				__ATOMIC_RELAXED);
+	}
+	printf("%8ld\n", resident);
+}/*}}}*/
+
+static void print_procs(const struct mmu_stat_seg *seg)/*{{{*/
+{
+	for(int i = 0; i < MMU_STAT_MAXPROCS; i++) {
+		int pid = __atomic_load_n(&seg->procs[i].pid, __ATOMIC_ACQUIRE);
+		if(!pid) continue;
+		printf("  id %d pid %d resident %d\n", i, pid,
+				__atomic_load_n(&seg->procs[i].resident,
+						__ATOMIC_RELAXED));
+	}
+}/*}}}*/
+
+static void usage(char **argv)/*{{{*/
+{
+	printf("usage: %s [-p] [-c COUNT] [INTERVAL]\n", argv[0]);
+	printf("\n");
+	printf("  -c COUNT  print COUNT lines and exit\n");
+	printf("  -p        print the resident pages of each client\n");
+	exit(EXIT_FAILURE);
+}/*}}}*/
+
+int main(int argc, char **argv) {/*{{{*/
+	int procs = 0;
+	long count = -1;
+	int opt;
+	while((opt = getopt(argc, argv, "c:p")) != -1) {
+		switch(opt) {
+		case 'c':
+			count = atol(optarg);
+			if(count < 1) usage(argv);
+			break;
+		case 'p':
+			procs = 1;
+			break;
+		default:
+			usage(argv);
+		}
+	}
+	double interval = 1;
+	if(argc - optind > 1) usage(argv);
+	if(argc - optind == 1) {
+		interval = atof(argv[optind]);
+		if(interval <= 0) usage(argv);
+	}
+
+	int fd = open(MMU_STAT_PATH, O_RDONLY);
+	if(fd == -1) {
+		perror(MMU_STAT_PATH);
+		exit(EXIT_FAILURE);
+	}
+	const struct mmu_stat_seg *seg = mmap(NULL, sizeof(*seg), PROT_READ,
+			MAP_SHARED, fd, 0);
+	if(seg == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+	if(memcmp(seg->magic, MMU_STAT_MAGIC, sizeof(seg->magic)) != 0) {
+		fprintf(stderr, "%s: not MMU statistics\n", MMU_STAT_PATH);
+		exit(EXIT_FAILURE);
+	}
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	printf("%d frames, %d blocks\n", seg->nframes, seg->nblocks);
+
+	uint64_t prev[MMU_STAT_NCOUNTERS], cur[MMU_STAT_NCOUNTERS];
+	memset(prev, 0, sizeof(prev));
+	uint64_t last = seg->start_ns;
+	for(long line = 0; count < 0 || line < count; line++) {
+		if(line > 0) usleep((useconds_t)(interval * 1e6));
+		/* the MMU removes the file when it exits */
+		struct stat st;
+		if(fstat(fd, &st) == -1 || st.st_nlink == 0) {
+			printf("mmu exited\n");
+			break;
+		}
+		uint64_t t = now_ns();
+		sample(seg, cur);
+		if(line % MMUSTAT_HEADER_EVERY == 0) print_header();
+		double secs = (double)(t - last) / 1e9;
+		print_line(seg, prev, cur, secs > 0 ? secs : 1);
+		if(procs) print_procs(seg);
+		fflush(stdout);
+		memcpy(prev, cur, sizeof(prev));
+		last = t;
+	}
+	close(fd);
+	exit(EXIT_SUCCESS);
+}/*}}}*/
@@ -0,0 +1,66 @@
+/* UNIVERSIDADE FEDERAL DE MINAS GERAIS     *
+ * DEPARTAMENTO DE CIENCIA DA COMPUTACAO    *
+ * Copyright (c) Italo Fernando Scota Cunha */
+
+/* MMU statistics segment
+ *
+ * The MMU publishes counters in a file mapped in memory,
+ * `MMU_STAT_PATH` in its working directory, which it removes on
+ * exit.  Counters only grow and are updated with relaxed atomic
+ * additions, each in its own cache line, so neither the MMU nor the
+ * pager takes locks for them.  Readers such as `mmustat` map the file
+ * read-only and compute rates from successive samples.
+ *
+ * The MMU counts faults, zero fills, disk transfers (one per block),
+ * and the pages each client has resident.  The pager reports what
+ * only it knows with `mmu_stat_count`: the kind of each fault, clean
+ * and dirty evictions, and how far the clock hand moves to find each
+ * victim. */
+
+#ifndef __MMUSTAT_HEADER__
+#define __MMUSTAT_HEADER__
+
+#include <stdint.h>
+
+#define MMU_STAT_MAGIC "MMUSTA01"
+#define MMU_STAT_PATH "mmu.stats"
+
+#define MMU_STAT_FAULTS 0           /* faults sent to the pager */
+#define MMU_STAT_FAULT_ZERO 1       /* loaded a new (zero-filled) page */
+#define MMU_STAT_FAULT_MAJOR 2      /* read a page back from disk */
+#define MMU_STAT_FAULT_MINOR 3      /* restored access to a resident page */
+#define MMU_STAT_FAULT_WRITE 4      /* first write to a resident page */
+#define MMU_STAT_EVICT_CLEAN 5
+#define MMU_STAT_EVICT_DIRTY 6
+#define MMU_STAT_ZERO_FILLS 7
+#define MMU_STAT_DISK_READS 8
+#define MMU_STAT_DISK_WRITES 9
+#define MMU_STAT_CLOCK_VICTIMS 10   /* victims chosen by a clock */
+#define MMU_STAT_CLOCK_STEPS 11     /* pages the hands passed to choose them */
+#define MMU_STAT_NCOUNTERS 12
+
+/* Clients with ids up to `MMU_STAT_MAXPROCS` - 1 have a slot, indexed
+ * by id, in `procs`; slots with `pid` zero are unused. */
+#define MMU_STAT_MAXPROCS 1024
+
+struct mmu_stat_counter {
+	uint64_t value;
+} __attribute__((aligned(64)));
+
+struct mmu_stat_proc {
+	int32_t pid;
+	int32_t resident;
+};
+
+/* `magic` is written last, once the segment is initialized.
+ * `start_ns` is the MMU's start time on `CLOCK_MONOTONIC`. */
+struct mmu_stat_seg {
+	char magic[8];
+	int32_t nframes;
+	int32_t nblocks;
+	uint64_t start_ns;
+	struct mmu_stat_counter counters[MMU_STAT_NCOUNTERS];
+	struct mmu_stat_proc procs[MMU_STAT_MAXPROCS];
+};
+
+#endif
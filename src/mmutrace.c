@@ -0,0 +1,277 @@
+/* UNIVERSIDADE FEDERAL DE MINAS GERAIS     *
+ * DEPARTAMENTO DE CIENCIA DA COMPUTACAO    *
+ * Copyright (c) Italo Fernando Scota Cunha */
+
+#include "mmutrace.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log.h"
+
+#define MMU_TRACE_RINGSZ 4096
+#define MMU_TRACE_IDLE_NS 1000000
+
+/****************************************************************************
+ * structure definitions and static variables
+ ***************************************************************************/
+/* Single-producer single-consumer ring.  The owner thread advances
+ * `head` after writing a record; the writer thread advances `tail`
+ * after saving records to the trace file. */
+struct mmu_trace_ring {/*{{{*/
+	struct mmu_trace_rec recs[MMU_TRACE_RINGSZ];
+	uint64_t head;
+	uint64_t tail;
+	int dead;                   /* owner thread exited */
+	struct mmu_trace_ring *next;
+};/*}}}*/
+
+static struct {/*{{{*/
+	int live;
+	int binary;
+	int running;
+	uint64_t seq;
+	FILE *file;
+	pthread_t writer;
+	pthread_mutex_t mutex;      /* protects `rings` */
+	pthread_key_t key;
+	struct mmu_trace_ring *rings;
+} trace = {
+	.live = 1,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};/*}}}*/
+
+static __thread struct mmu_trace_ring *self = NULL;
+
+/****************************************************************************
+ * static function declarations
+ ***************************************************************************/
+static void * mmu_trace_writer(void *unused);
+static int mmu_trace_drain(void);
+static void mmu_trace_push(const struct mmu_trace_rec *r);
+static void mmu_trace_thread_exit(void *vring);
+
+/****************************************************************************
+ * external functions {{{
+ ***************************************************************************/
+void mmu_trace_init(const char *path, int live)/*{{{*/
+{
+	trace.live = live;
+	if(!path) return;
+	trace.file = fopen(path, "w");
+	if(!trace.file) logea(__FILE__, __LINE__, path);
+	fwrite(MMU_TRACE_MAGIC, 1, strlen(MMU_TRACE_MAGIC), trace.file);
+	if(pthread_key_create(&trace.key, mmu_trace_thread_exit))
+		logea(__FILE__, __LINE__, NULL);
+	trace.running = 1;
+	if(pthread_create(&trace.writer, NULL, mmu_trace_writer, NULL))
+		logea(__FILE__, __LINE__, NULL);
+	__atomic_store_n(&trace.binary, 1, __ATOMIC_RELEASE);
+	logd(LOG_INFO, "%s: binary trace at %s, live %d\n", __func__,
+			path, live);
+}/*}}}*/
+
+void mmu_trace_destroy(void)/*{{{*/
+{
+	if(!trace.file) return;
+	__atomic_store_n(&trace.binary, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&trace.running, 0, __ATOMIC_RELEASE);
+	pthread_join(trace.writer, NULL);
+	mmu_trace_drain();
+	fclose(trace.file);
+	trace.file = NULL;
+	/* rings of live threads are not freed as their owners may
+	 * still reference them through `self`. */
+}/*}}}*/
+
+void mmu_trace(int type, int32_t id, int32_t a, int32_t b, uint64_t vaddr)/*{{{*/
+{
+	struct mmu_trace_rec r;
+	r.seq = __atomic_fetch_add(&trace.seq, 1, __ATOMIC_RELAXED);
+	r.type = (uint16_t)type;
+	r.len = 0;
+	r.id = id;
+	r.u.ev.a = a;
+	r.u.ev.b = b;
+	r.u.ev.vaddr = vaddr;
+	if(trace.live) mmu_trace_format(stdout, &r);
+	if(__atomic_load_n(&trace.binary, __ATOMIC_ACQUIRE)) mmu_trace_push(&r);
+}/*}}}*/
+
+void mmu_trace_text(const char *buf, size_t len)/*{{{*/
+{
+	if(trace.live) fwrite(buf, 1, len, stdout);
+	if(!__atomic_load_n(&trace.binary, __ATOMIC_ACQUIRE)) return;
+	while(len > 0) {
+		struct mmu_trace_rec r;
+		size_t n = len < MMU_TRACE_TEXTLEN ? len : MMU_TRACE_TEXTLEN;
+		r.seq = __atomic_fetch_add(&trace.seq, 1, __ATOMIC_RELAXED);
+		r.type = MMU_TRACE_TEXT;
+		r.len = (uint16_t)n;
+		r.id = -1;
+		memcpy(r.u.text, buf, n);
+		mmu_trace_push(&r);
+		buf += n;
+		len -= n;
+	}
+}/*}}}*/
+
+void mmu_trace_format(FILE *out, const struct mmu_trace_rec *r)/*{{{*/
+{
+	int id = (int)r->id;
+	int a = (int)r->u.ev.a;
+	int b = (int)r->u.ev.b;
+	void *vaddr = (void *)(uintptr_t)r->u.ev.vaddr;
+	switch(r->type) {
+	case MMU_TRACE_PAGER_CREATE:
+		fprintf(out, "pager_create pid %d\n", id);
+		break;
+	case MMU_TRACE_PAGER_EXTEND:
+		fprintf(out, "pager_extend pid %d vaddr %p\n", id, vaddr);
+		break;
+	case MMU_TRACE_PAGER_EXTEND_N:
+		fprintf(out, "pager_extend_n pid %d npages %d populate %d\n",
+				id, a, b);
+		break;
+	case MMU_TRACE_PAGER_SHRINK:
+		fprintf(out, "pager_shrink pid %d npages %d\n", id, a);
+		break;
+	case MMU_TRACE_PAGER_ADVISE:
+		fprintf(out, "pager_advise pid %d vaddr %p len %d advice %d\n",
+				id, vaddr, a, b);
+		break;
+	case MMU_TRACE_PAGER_LIMIT:
+		fprintf(out, "pager_limit pid %d min %d max %d\n", id, a, b);
+		break;
+	case MMU_TRACE_PAGER_STAT:
+		fprintf(out, "pager_stat pid %d\n", id);
+		break;
+	case MMU_TRACE_PAGER_HIBERNATE:
+		fprintf(out, "pager_hibernate pid %d\n", id);
+		break;
+	case MMU_TRACE_PAGER_SYSLOG:
+		fprintf(out, "pager_syslog pid %d %p\n", id, vaddr);
+		break;
+	case MMU_TRACE_PAGER_FAULT:
+		fprintf(out, "pager_fault pid %d vaddr %p\n", id, vaddr);
+		break;
+	case MMU_TRACE_PAGER_DESTROY:
+		fprintf(out, "pager_destroy pid %d\n", id);
+		break;
+	case MMU_TRACE_ZERO_FILL:
+		fprintf(out, "mmu_zero_fill frame %u\n", (unsigned)a);
+		break;
+	case MMU_TRACE_RESIDENT:
+		fprintf(out, "mmu_resident pid %d vaddr %p prot %d frame %u\n",
+				id, vaddr, b, (unsigned)a);
+		break;
+	case MMU_TRACE_NONRESIDENT:
+		fprintf(out, "mmu_nonresident pid %d vaddr %p\n", id, vaddr);
+		break;
+	case MMU_TRACE_CHPROT:
+		fprintf(out, "mmu_chprot pid %d vaddr %p prot %d\n",
+				id, vaddr, b);
+		break;
+	case MMU_TRACE_OOM_KILL:
+		fprintf(out, "mmu_oom_kill pid %d\n", id);
+		break;
+	case MMU_TRACE_DISK_READ:
+		fprintf(out, "mmu_disk_read from block %d to frame %d\n", a, b);
+		break;
+	case MMU_TRACE_DISK_WRITE:
+		fprintf(out, "mmu_disk_write from frame %d to block %d\n", a, b);
+		break;
+	case MMU_TRACE_NOTFOUND:
+		fprintf(out, "error: pid %d not found.  aborting.\n", a);
+		break;
+	case MMU_TRACE_TEXT:
+		fwrite(r->u.text, 1, r->len, out);
+		break;
+	default:
+		fprintf(out, "unknown trace record type %d\n", (int)r->type);
+		break;
+	}
+}/*}}}*/
+/*}}}*/
+
+/****************************************************************************
+ * ring and writer functions {{{
+ ***************************************************************************/
+void mmu_trace_push(const struct mmu_trace_rec *r)/*{{{*/
+{
+	if(!self) {
+		self = calloc(1, sizeof(*self));
+		if(!self) logea(__FILE__, __LINE__, NULL);
+		pthread_setspecific(trace.key, self);
+		pthread_mutex_lock(&trace.mutex);
+		self->next = trace.rings;
+		trace.rings = self;
+		pthread_mutex_unlock(&trace.mutex);
+	}
+	uint64_t head = self->head;
+	while(head - __atomic_load_n(&self->tail, __ATOMIC_ACQUIRE)
+			>= MMU_TRACE_RINGSZ) {
+		/* ring full; wait for the writer unless it is gone */
+		if(!__atomic_load_n(&trace.running, __ATOMIC_ACQUIRE)) return;
+		sched_yield();
+	}
+	self->recs[head % MMU_TRACE_RINGSZ] = *r;
+	__atomic_store_n(&self->head, head + 1, __ATOMIC_RELEASE);
+}/*}}}*/
+
+void mmu_trace_thread_exit(void *vring)/*{{{*/
+{
+	struct mmu_trace_ring *ring = vring;
+	__atomic_store_n(&ring->dead, 1, __ATOMIC_RELEASE);
+}/*}}}*/
+
+/* Saves pending records of all rings and frees rings of dead threads.
+ * Returns the number of records saved. */
+int mmu_trace_drain(void)/*{{{*/
+{
+	int cnt = 0;
+	pthread_mutex_lock(&trace.mutex);
+	struct mmu_trace_ring **prev = &trace.rings;
+	while(*prev) {
+		struct mmu_trace_ring *ring = *prev;
+		int dead = __atomic_load_n(&ring->dead, __ATOMIC_ACQUIRE);
+		uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		uint64_t tail = ring->tail;
+		while(tail != head) {
+			size_t idx = tail % MMU_TRACE_RINGSZ;
+			size_t n = head - tail;
+			if(idx + n > MMU_TRACE_RINGSZ) n = MMU_TRACE_RINGSZ - idx;
+			if(fwrite(&ring->recs[idx], sizeof(ring->recs[0]), n,
+					trace.file) != n) {
+				loge(LOG_ERROR, __FILE__, __LINE__);
+			}
+			tail += n;
+			cnt += n;
+		}
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+		if(dead) {
+			*prev = ring->next;
+			free(ring);
+			continue;
+		}
+		prev = &ring->next;
+	}
+	pthread_mutex_unlock(&trace.mutex);
+	return cnt;
+}/*}}}*/
+
+void * mmu_trace_writer(void *unused)/*{{{*/
+{
+	struct timespec idle = { 0, MMU_TRACE_IDLE_NS };
+	while(__atomic_load_n(&trace.running, __ATOMIC_ACQUIRE)) {
+		if(mmu_trace_drain() == 0) nanosleep(&idle, NULL);
+	}
+	return NULL;
+}/*}}}*/
+/*}}}*/
@@ -0,0 +1,90 @@
+/* UNIVERSIDADE FEDERAL DE MINAS GERAIS     *
+ * DEPARTAMENTO DE CIENCIA DA COMPUTACAO    *
+ * Copyright (c) Italo Fernando Scota Cunha */
+
+/* MMU event tracing
+ *
+ * Every pager dispatch and every MMU operation generates one trace
+ * event.  Events can be printed to stdout as they happen (the
+ * `.mmu.out` format used for grading), recorded in a binary trace
+ * file, or both.
+ *
+ * Binary tracing is cheap: each thread appends fixed-size records to
+ * its own lock-free ring, and a background thread drains all rings
+ * to the trace file.  Records carry a global sequence number; the
+ * `mmudump` tool sorts records by sequence number and prints them in
+ * exactly the format used by live tracing. */
+
+#ifndef __MMUTRACE_HEADER__
+#define __MMUTRACE_HEADER__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MMU_TRACE_MAGIC "MMUTRC01"
+
+#define MMU_TRACE_PAGER_CREATE 1
+#define MMU_TRACE_PAGER_EXTEND 2
+#define MMU_TRACE_PAGER_SYSLOG 3
+#define MMU_TRACE_PAGER_FAULT 4
+#define MMU_TRACE_PAGER_DESTROY 5
+#define MMU_TRACE_ZERO_FILL 6
+#define MMU_TRACE_RESIDENT 7
+#define MMU_TRACE_NONRESIDENT 8
+#define MMU_TRACE_CHPROT 9
+#define MMU_TRACE_DISK_READ 10
+#define MMU_TRACE_DISK_WRITE 11
+#define MMU_TRACE_NOTFOUND 12
+#define MMU_TRACE_TEXT 13
+#define MMU_TRACE_PAGER_EXTEND_N 14
+#define MMU_TRACE_PAGER_SHRINK 15
+#define MMU_TRACE_PAGER_ADVISE 16
+#define MMU_TRACE_OOM_KILL 17
+#define MMU_TRACE_PAGER_LIMIT 18
+#define MMU_TRACE_PAGER_STAT 19
+#define MMU_TRACE_PAGER_HIBERNATE 20
+
+#define MMU_TRACE_TEXTLEN 16
+
+/* Trace records are 32 bytes.  For `MMU_TRACE_TEXT` records, `len`
+ * bytes of output are stored in `text`; other records store the
+ * event's arguments in `ev`. */
+struct mmu_trace_rec {
+	uint64_t seq;
+	uint16_t type;
+	uint16_t len;
+	int32_t id;
+	union {
+		struct {
+			int32_t a;
+			int32_t b;
+			uint64_t vaddr;
+		} __attribute__((packed)) ev;
+		char text[MMU_TRACE_TEXTLEN];
+	} u;
+} __attribute__((packed));
+
+/* `mmu_trace_init` starts tracing.  If `live` is nonzero, events are
+ * printed to stdout as they happen.  If `path` is not NULL, events
+ * are also recorded in binary form at `path`.  Before
+ * `mmu_trace_init` is called, events are printed live. */
+void mmu_trace_init(const char *path, int live);
+
+/* `mmu_trace_destroy` drains pending records and closes the trace
+ * file.  Events generated afterwards are only printed if live
+ * tracing is on. */
+void mmu_trace_destroy(void);
+
+/* `mmu_trace` records event `type` for client `id`.  The meaning of
+ * `a`, `b`, and `vaddr` depends on the event; see
+ * `mmu_trace_format`. */
+void mmu_trace(int type, int32_t id, int32_t a, int32_t b, uint64_t vaddr);
+
+/* `mmu_trace_text` records `len` bytes of free-form output. */
+void mmu_trace_text(const char *buf, size_t len);
+
+/* `mmu_trace_format` prints record `r` to `out` in `.mmu.out` format. */
+void mmu_trace_format(FILE *out, const struct mmu_trace_rec *r);
+
+#endif
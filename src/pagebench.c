@@ -0,0 +1,155 @@
+/* UNIVERSIDADE FEDERAL DE MINAS GERAIS     *
+ * DEPARTAMENTO DE CIENCIA DA COMPUTACAO    *
+ * Copyright (c) Italo Fernando Scota Cunha */
+
+/* `pagebench` compares the MMU's page kernels (see mmupage.h) with
+ * libc.  For each kernel set the CPU supports, it fills, copies, and
+ * compares NPAGES pages spread over buffers larger than the cache, as
+ * the MMU does with frames and disk blocks.  After every batch of
+ * pages, it reads a small working set that should have stayed in the
+ * cache; the `hot` column is the time that read takes, which grows
+ * when the page operations evict the working set. */
+
+#include <sys/mman.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mmupage.h"
+#include "uvm.h"
+
+#define PAGEBENCH_PAGES 65536
+#define PAGEBENCH_BATCH 64
+#define PAGEBENCH_HOT (256 * 1024)
+
+#define OP_FILL 0
+#define OP_COPY 1
+#define OP_EQUAL 2
+#define OP_FILLED 3
+
+static const char *opnames[] = { "fill", "copy", "equal", "filled" };
+
+static double now_ns(void)/*{{{*/
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}/*}}}*/
+
+static char * map(size_t len)/*{{{*/
+{
+	char *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(p == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+	memset(p, '0', len);
+	return p;
+}/*}}}*/
+
+static size_t gcd(size_t a, size_t b)/*{{{*/
+{
+	while(b) {
+		size_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}/*}}}*/
+
+/* Reads the working set and returns the time it took. */
+static double touch_hot(volatile const char *hot)/*{{{*/
+{
+	unsigned sum = 0;
+	double start = now_ns();
+	for(size_t i = 0; i < PAGEBENCH_HOT; i += 64) sum += hot[i];
+	double end = now_ns();
+	if(sum == 0) fprintf(stderr, "unexpected working set\n");
+	return end - start;
+}/*}}}*/
+
+/* Runs `op` over `npages` pages in a scattered order and prints the
+ * time per page and the average working set read time. */
+static void run(int op, char *a, char *b, const char *hot, size_t npages)/*{{{*/
+{
+	size_t pagesz = UVM_PAGESIZE;
+	double busy = 0, hotns = 0;
+	size_t nbatch = 0;
+	int ok = 1;
+	/* a stride coprime with `npages` visits every page once, out of
+	 * order */
+	size_t stride = 40503;
+	while(gcd(stride, npages) != 1) stride++;
+	touch_hot(hot);
+	for(size_t k = 0; k < npages; k += PAGEBENCH_BATCH) {
+		double start = now_ns();
+		for(size_t j = k; j < k + PAGEBENCH_BATCH && j < npages; j++) {
+			size_t i = (j * stride) % npages;
+			char *x = a + i * pagesz;
+			char *y = b + i * pagesz;
+			switch(op) {
+			case OP_FILL:
+				mmu_page_fill(x, '0', pagesz);
+				break;
+			case OP_COPY:
+				mmu_page_copy(x, y, pagesz);
+				break;
+			case OP_EQUAL:
+				ok &= mmu_page_equal(x, y, pagesz);
+				break;
+			case OP_FILLED:
+				ok &= mmu_page_is_filled(x, '0', pagesz);
+				break;
+			}
+		}
+		busy += now_ns() - start;
+		hotns += touch_hot(hot);
+		nbatch++;
+	}
+	if(!ok) fprintf(stderr, "%s: unexpected result\n", opnames[op]);
+	printf("%-6s %-7s %10.1f %10.2f %10.0f\n", mmu_page_impl(),
+			opnames[op], busy / (double)npages,
+			(double)npages * pagesz / busy, hotns / (double)nbatch);
+	fflush(stdout);
+}/*}}}*/
+
+int main(int argc, char **argv) {/*{{{*/
+	size_t npages = PAGEBENCH_PAGES;
+	int opt;
+	while((opt = getopt(argc, argv, "n:")) != -1) {
+		switch(opt) {
+		case 'n':
+			npages = strtoul(optarg, NULL, 10);
+			if(npages > 0) break;
+			/* fall through */
+		default:
+			fprintf(stderr, "usage: %s [-n NPAGES]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	char *a = map(npages * UVM_PAGESIZE);
+	char *b = map(npages * UVM_PAGESIZE);
+	char *hot = map(PAGEBENCH_HOT);
+
+	mmu_page_init();
+	printf("page size %zu, %zu pages, detected %s\n", UVM_PAGESIZE,
+			npages, mmu_page_impl());
+	printf("%-6s %-7s %10s %10s %10s\n", "impl", "op", "ns/page",
+			"GB/s", "hot ns");
+	int impls[] = { MMU_PAGE_LIBC, MMU_PAGE_SSE2, MMU_PAGE_AVX2 };
+	for(size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+		if(mmu_page_select(impls[i]) != 0) continue;
+		for(int op = OP_FILL; op <= OP_FILLED; op++) {
+			run(op, a, b, hot, npages);
+		}
+	}
+	munmap(a, npages * UVM_PAGESIZE);
+	munmap(b, npages * UVM_PAGESIZE);
+	munmap(hot, PAGEBENCH_HOT);
+	exit(EXIT_SUCCESS);
+}/*}}}*/
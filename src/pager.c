@@ -8,60 +8,222 @@
 
 #include "pager.h"
 #include "mmu.h"
+#include "mmupage.h"
+#include "uvm.h"
 
+#include <limits.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
 #include <assert.h>
+#include <time.h>
 #include <sys/mman.h>
 
+/* páginas lidas adiante numa falta em região sequencial */
+#define READAHEAD_PAGES 4
+
+/* PFF: limites da taxa de faltas, em porcentagem da parcela justa de
+ * cada processo nas faltas da janela */
+#define PFF_UPPER 150
+#define PFF_LOWER 50
+
+/* controle de carga: porcentagem de recargas (faltas em páginas que
+ * já saíram da memória) numa janela acima da qual um processo é
+ * suspenso, e abaixo da qual um suspenso é retomado */
+#define LC_THRASH 50
+#define LC_CALM 10
+/* prazo máximo de uma suspensão: os processos podem estar esperando
+ * uns pelos outros */
+#define LC_SUSPEND_MS 1000
+
+/* páginas carregadas por lote (leituras agrupadas e mapeamentos) */
+#define LOAD_BATCH 32
+
+/* blocos por extensão (divide 64): páginas vizinhas de um processo
+ * ocupam blocos vizinhos da mesma extensão */
+#define EXTENT_BLOCKS 16
+
+/* de onde vem a vítima numa falta */
+#define VICTIM_ANY 0
+#define VICTIM_DONOR 1 /* processos acima da alocação do PFF */
+#define VICTIM_SELF 2  /* o próprio processo */
+
 typedef enum {
     PAGE_UNINITIALIZED,
     PAGE_ON_DISK,
     PAGE_IN_MEMORY
 } page_state_t;
 
+/* campos em bits para a tabela continuar pequena com milhões de
+ * páginas */
 typedef struct {
-    page_state_t state;
     int frame;
     int disk_block;
-    int prot;
-    int referenced;
-    int dirty;
-    int initialized;
-    int saved_on_disk;
+    unsigned state : 2; /* page_state_t */
+    unsigned prot : 3;
+    unsigned referenced : 1;
+    unsigned dirty : 1;
+    unsigned initialized : 1;
+    unsigned saved_on_disk : 1;
+    unsigned advice : 3; /* UVM_ADV_NORMAL, UVM_ADV_RANDOM ou UVM_ADV_SEQUENTIAL */
+    unsigned hibernated : 1; /* residente quando o processo hibernou */
 } page_entry_t;
 
+/* tabela de páginas em dois níveis: o diretório do processo aponta
+ * para folhas de PT_LEAF_PAGES entradas, alocadas quando alguma
+ * página da folha passa a ser usada; uma folha ausente equivale a
+ * páginas novas sem bloco de disco */
+#define PT_LEAF_BITS 9
+#define PT_LEAF_PAGES (1 << PT_LEAF_BITS)
+
 typedef struct process_table {
     pid_t pid;
-    page_entry_t *pages;
+    page_entry_t **dir;
+    int dir_len;
     int page_count;
+    int tracking; /* o processo informa acessos e escritas (mmu_tracking) */
+    int resident;   /* quadros com páginas do processo */
+    int min_frames; /* até aqui os quadros não são tomados por outros */
+    int max_frames; /* daqui em diante as vítimas são do próprio processo */
+    int clock_hand; /* relógio local, sobre os índices das páginas */
+    int pff_frames; /* alocação do PFF (INT_MAX antes da primeira janela) */
+    int pff_faults; /* faltas na janela atual */
+    int suspended;  /* ordem da suspensão pelo controle de carga, 0 se ativo */
+    int hibernated; /* há páginas a trazer de volta na próxima falta */
+    long faults;
+    long pageins;
+    long evictions;
+    long writes;         /* blocos escritos no disco */
+    long writes_skipped; /* escritas evitadas pelo conteúdo da página */
     struct process_table *next;
 } process_table_t;
 
 typedef struct {
-    int free;
-    pid_t pid;
-    int page_index;
-    int referenced;
+    process_table_t *proc; /* dono do quadro, NULL se livre */
+    int page_index : 31;
+    unsigned referenced : 1;
+    mmu_io_token_t io; /* escrita pendente do quadro (0 se nenhuma) */
 } frame_entry_t;
 
+/* conjunto de quadros ou blocos livres, um bit por elemento; todos
+ * abaixo de `hint` estão em uso, então o menor livre é achado sem
+ * percorrer o início a cada vez */
+typedef struct {
+    uint64_t *bits;
+    int n;
+    int hint;
+} freemap_t;
+
 static struct {
     int nframes;
     int nblocks;
 
     frame_entry_t *frames;
-    int *free_blocks;
-    int free_block_count;
+    freemap_t free_frames;
+    freemap_t free_blocks;
+    freemap_t free_extents; /* extensões com todos os blocos livres */
+    uint64_t *block_hash;   /* hash do último conteúdo escrito em cada bloco */
+    mmu_io_token_t *block_io; /* escrita pendente em cada bloco (0 se nenhuma) */
+    freemap_t zeroed;       /* quadros livres já preenchidos com zeros */
+    int zeroed_count;
+    int zero_pool;          /* quadros livres a manter zerados, 0 se desligado */
+    int zeroing;            /* quadro sendo zerado fora do lock, -1 se nenhum */
+    pthread_cond_t zero_work;
 
     process_table_t *processes;
 
+    int overcommit; /* PAGER_OVERCOMMIT_* */
+    int committed;  /* páginas alocadas a todos os processos */
+
+    int pff_window; /* faltas por janela do PFF, 0 se desligado */
+    int pff_faults; /* faltas na janela atual */
+
+    int lc_window;   /* faltas por janela do controle de carga, 0 se desligado */
+    int lc_faults;   /* faltas na janela atual */
+    int lc_refaults; /* das quais em páginas que já saíram da memória */
+    int lc_seq;      /* quantas suspensões já houve */
+    pthread_cond_t resume;
+
     int clock_hand;
     pthread_mutex_t mutex;
 } pager;
 
+/* todos os elementos começam livres */
+static void freemap_init(freemap_t *m, int n) {
+    int nwords = (n + 63) / 64;
+    m->bits = malloc(nwords * sizeof(uint64_t));
+    for (int w = 0; w < nwords; w++) m->bits[w] = ~(uint64_t)0;
+    if (n % 64) m->bits[nwords - 1] = ((uint64_t)1 << (n % 64)) - 1;
+    m->n = n;
+    m->hint = 0;
+}
+
+static int freemap_test(const freemap_t *m, int i) {
+    return (m->bits[i / 64] >> (i % 64)) & 1;
+}
+
+/* menor elemento livre, ou -1 */
+static int freemap_first(freemap_t *m) {
+    for (int w = m->hint / 64; w < (m->n + 63) / 64; w++) {
+        if (m->bits[w]) {
+            m->hint = w * 64 + __builtin_ctzll(m->bits[w]);
+            return m->hint;
+        }
+    }
+    m->hint = m->n;
+    return -1;
+}
+
+static void freemap_set(freemap_t *m, int i, int free) {
+    if (free) {
+        m->bits[i / 64] |= (uint64_t)1 << (i % 64);
+        if (i < m->hint) m->hint = i;
+    } else {
+        m->bits[i / 64] &= ~((uint64_t)1 << (i % 64));
+    }
+}
+
+/* inicializa entrada de página recém-alocada */
+static void init_page(page_entry_t *page, int block) {
+    page->state = PAGE_UNINITIALIZED;
+    page->frame = -1;
+    page->disk_block = block;
+    page->prot = PROT_NONE;
+    page->referenced = 0;
+    page->dirty = 0;
+    page->initialized = 0;
+    page->saved_on_disk = 0;
+    page->advice = UVM_ADV_NORMAL;
+    page->hibernated = 0;
+}
+
+/* entrada da página, ou NULL se a folha não foi alocada */
+static page_entry_t* find_page(process_table_t *proc, int page_idx) {
+    page_entry_t *leaf = proc->dir[page_idx >> PT_LEAF_BITS];
+    return leaf ? &leaf[page_idx & (PT_LEAF_PAGES - 1)] : NULL;
+}
+
+/* entrada da página, alocando a folha se necessário; NULL sem memória */
+static page_entry_t* get_page(process_table_t *proc, int page_idx) {
+    page_entry_t **leaf = &proc->dir[page_idx >> PT_LEAF_BITS];
+    if (!*leaf) {
+        *leaf = malloc(PT_LEAF_PAGES * sizeof(page_entry_t));
+        if (!*leaf) return NULL;
+        for (int i = 0; i < PT_LEAF_PAGES; i++) init_page(&(*leaf)[i], -1);
+    }
+    return &(*leaf)[page_idx & (PT_LEAF_PAGES - 1)];
+}
+
+/* aloca as folhas das páginas [first, first + npages) */
+static int alloc_leaves(process_table_t *proc, int first, int npages) {
+    for (int i = first; i < first + npages; i = (i | (PT_LEAF_PAGES - 1)) + 1) {
+        if (!get_page(proc, i)) return -1;
+    }
+    return 0;
+}
+
 /* busca tabela do processo */
 static process_table_t* find_process_table(pid_t pid) {
     process_table_t *proc = pager.processes;
@@ -76,9 +238,30 @@ static process_table_t* create_process_table(pid_t pid) {
     process_table_t *proc = malloc(sizeof(process_table_t));
     if (!proc) return NULL;
 
+    /* o diretório cobre a região inteira; as folhas vêm sob demanda */
+    proc->dir_len = (mmu_region_pages() + PT_LEAF_PAGES - 1) / PT_LEAF_PAGES;
+    proc->dir = calloc(proc->dir_len, sizeof(page_entry_t *));
+    if (!proc->dir) {
+        free(proc);
+        return NULL;
+    }
+
     proc->pid = pid;
-    proc->pages = NULL;
     proc->page_count = 0;
+    proc->tracking = mmu_tracking(pid);
+    proc->resident = 0;
+    proc->min_frames = 0;
+    proc->max_frames = INT_MAX;
+    proc->clock_hand = 0;
+    proc->pff_frames = INT_MAX;
+    proc->pff_faults = 0;
+    proc->suspended = 0;
+    proc->hibernated = 0;
+    proc->faults = 0;
+    proc->pageins = 0;
+    proc->evictions = 0;
+    proc->writes = 0;
+    proc->writes_skipped = 0;
     proc->next = pager.processes;
     pager.processes = proc;
 
@@ -95,153 +278,933 @@ static void destroy_process_table(process_table_t *proc) {
     }
     if (*prev) *prev = proc->next;
 
-    if (proc->pages) free(proc->pages);
+    for (int i = 0; i < proc->dir_len; i++) free(proc->dir[i]);
+    free(proc->dir);
     free(proc);
 }
 
-/* acha quadro livre */
-static int find_free_frame() {
-    for (int i = 0; i < pager.nframes; i++) {
-        if (pager.frames[i].free) {
-            return i;
-        }
+static int frame_is_free(int frame) {
+    return freemap_test(&pager.free_frames, frame);
+}
+
+/* se a página precisa ser zerada ao ser carregada */
+static int needs_zero(const page_entry_t *page) {
+    return page->state == PAGE_UNINITIALIZED ||
+           (page->state == PAGE_ON_DISK && !page->saved_on_disk);
+}
+
+/* acha quadro livre; páginas a zerar preferem quadros já zerados */
+static int find_free_frame(int zero) {
+    if (zero && pager.zeroed_count > 0) return freemap_first(&pager.zeroed);
+    return freemap_first(&pager.free_frames);
+}
+
+/* menor quadro livre ainda não zerado, ou -1 */
+static int find_unzeroed_frame(void) {
+    for (int w = pager.free_frames.hint / 64; w < (pager.nframes + 63) / 64; w++) {
+        uint64_t bits = pager.free_frames.bits[w] & ~pager.zeroed.bits[w];
+        if (bits) return w * 64 + __builtin_ctzll(bits);
     }
-    return -1; /* não encontrado */
+    return -1;
 }
 
-/* acha bloco de disco livre */
-static int find_free_block() {
-    for (int i = 0; i < pager.nblocks; i++) {
-        if (pager.free_blocks[i]) {
-            pager.free_blocks[i] = 0; /* marca como usado */
-            pager.free_block_count--;
-            return i;
+/* devolve quadro à memória livre */
+static void release_frame(int frame) {
+    pager.frames[frame].proc = NULL;
+    pager.frames[frame].referenced = 0;
+    freemap_set(&pager.free_frames, frame, 1);
+    if (pager.zero_pool) pthread_cond_signal(&pager.zero_work);
+}
+
+/* a extensão do bloco fica livre só com todos os seus blocos livres */
+static void extent_update(int block) {
+    int e = block / EXTENT_BLOCKS;
+    if (e >= pager.free_extents.n) return; /* extensão incompleta no fim */
+    int first = e * EXTENT_BLOCKS;
+    uint64_t mask = (((uint64_t)1 << EXTENT_BLOCKS) - 1) << (first % 64);
+    freemap_set(&pager.free_extents, e,
+                (pager.free_blocks.bits[first / 64] & mask) == mask);
+}
+
+/* acha bloco de disco livre para a página `page_idx`: logo depois do
+ * bloco da página anterior ou antes do da seguinte, na mesma extensão;
+ * senão, na posição da página numa extensão livre; senão, o menor
+ * bloco livre */
+static int find_free_block(process_table_t *proc, int page_idx) {
+    int block = -1;
+    for (int d = -1; d <= 1 && block < 0; d += 2) {
+        int n = page_idx + d;
+        if (n < 0 || n >= proc->dir_len * PT_LEAF_PAGES) continue;
+        page_entry_t *near = find_page(proc, n);
+        if (!near || near->disk_block < 0) continue;
+        int b = near->disk_block - d;
+        if (b >= 0 && b < pager.nblocks &&
+            b / EXTENT_BLOCKS == near->disk_block / EXTENT_BLOCKS &&
+            freemap_test(&pager.free_blocks, b)) {
+            block = b;
         }
     }
-    return -1;  /* não encontrado */
+    if (block < 0) {
+        int e = freemap_first(&pager.free_extents);
+        block = e >= 0 ? e * EXTENT_BLOCKS + page_idx % EXTENT_BLOCKS
+                       : freemap_first(&pager.free_blocks);
+    }
+    if (block >= 0) {
+        freemap_set(&pager.free_blocks, block, 0); /* marca como usado */
+        extent_update(block);
+    }
+    return block;  /* -1 se não encontrado */
 }
 
 /* devolve bloco ao disco */
 static void free_block(int block) {
-    if (block >= 0 && block < pager.nblocks && !pager.free_blocks[block]) {
-        pager.free_blocks[block] = 1;
-        pager.free_block_count++;
+    if (block >= 0 && block < pager.nblocks &&
+        !freemap_test(&pager.free_blocks, block)) {
+        freemap_set(&pager.free_blocks, block, 1);
+        extent_update(block);
+    }
+}
+
+/* o processo pode ter restaurado PROT_READ sozinho ao acessar uma
+ * página que recebeu segunda chance (falta leve); sincroniza o bit
+ * de referência e a proteção com a tabela compartilhada */
+static void sync_soft_fault(pid_t pid, int page_idx, page_entry_t *page) {
+    if (page->state != PAGE_IN_MEMORY || page->prot != PROT_NONE) return;
+
+    void *vaddr = (void *)(UVM_BASEADDR + page_idx * UVM_PAGESIZE);
+    if (mmu_referenced(pid, vaddr)) {
+        page->referenced = 1;
+        pager.frames[page->frame].referenced = 1;
+        page->prot = PROT_READ;
+    }
+}
+
+/* segunda chance para a página residente `page_idx`: devolve 1 se ela
+ * foi referenciada (e perde a referência), 0 se pode ser a vítima */
+static int second_chance(process_table_t *proc, int page_idx, page_entry_t *page) {
+    frame_entry_t *frame = &pager.frames[page->frame];
+    void *vaddr = (void *)(UVM_BASEADDR + page_idx * UVM_PAGESIZE);
+
+    sync_soft_fault(proc->pid, page_idx, page);
+
+    /* com rastreamento, o processo amostra os acessos e não é preciso
+     * revogar a permissão */
+    if (proc->tracking && mmu_referenced(proc->pid, vaddr)) {
+        page->referenced = 1;
+    }
+
+    if (!frame->referenced && !page->referenced) return 0;
+
+    frame->referenced = 0;
+    page->referenced = 0;
+    if (!proc->tracking && page->prot != PROT_NONE) {
+        mmu_chprot(proc->pid, vaddr, PROT_NONE);
+        page->prot = PROT_NONE;
+    }
+    return 1;
+}
+
+/* estatísticas: uma vítima achada pelo relógio depois de `steps`
+ * páginas */
+static void clock_stat(int steps) {
+    mmu_stat_count(MMU_STAT_CLOCK_VICTIMS, 1);
+    mmu_stat_count(MMU_STAT_CLOCK_STEPS, steps);
+}
+
+/* o quadro do processo `proc` pode ser a vítima de uma falta de
+ * `self`?  Quadros de outros processos no seu mínimo nunca são */
+static int victim_allowed(process_table_t *self, process_table_t *proc, int which) {
+    if (proc && proc != self && proc->resident <= proc->min_frames) return 0;
+    switch (which) {
+    case VICTIM_DONOR:
+        return proc && proc != self && proc->resident > proc->pff_frames;
+    case VICTIM_SELF:
+        return proc == self;
+    default:
+        return 1;
     }
 }
 
-/* segunda chance: escolhe quadro vítima */
-static int select_victim_frame() {
+/* segunda chance: escolhe quadro vítima para uma falta de `self`
+ * entre os quadros que `which` permite.  Devolve -1 se nenhum quadro
+ * é permitido */
+static int select_victim_frame(process_table_t *self, int which) {
     int start = pager.clock_hand;
+    int fallback = -1;
+    int steps = 0;
 
     while (1) {
-        frame_entry_t *frame = &pager.frames[pager.clock_hand];
-
-        if (!frame->free) {
-            process_table_t *proc = find_process_table(frame->pid);
-            if (proc && frame->page_index < proc->page_count) {
-                page_entry_t *page = &proc->pages[frame->page_index];
+        int hand = pager.clock_hand;
+        steps++;
+        frame_entry_t *frame = &pager.frames[hand];
+        int protected = 0;
+
+        if (hand == pager.zeroing) {
+            /* reservado pela thread que zera quadros */
+            protected = 1;
+        } else if (!frame_is_free(hand)) {
+            process_table_t *proc = frame->proc;
+            if (!victim_allowed(self, proc, which)) {
+                protected = 1;
+            } else if (proc && frame->page_index < proc->page_count) {
+                page_entry_t *page = find_page(proc, frame->page_index);
 
                 /* processa se a página está na memória */
-                if (page->state == PAGE_IN_MEMORY) {
-                    if (frame->referenced || page->referenced) {
-                        frame->referenced = 0;
-                        page->referenced = 0;
-
-                        if (page->prot != PROT_NONE) {
-                            void *vaddr = (void *)(UVM_BASEADDR +
-                                frame->page_index * sysconf(_SC_PAGESIZE));
-                            mmu_chprot(proc->pid, vaddr, PROT_NONE);
-                            page->prot = PROT_NONE;
-                        }
-                    } else {
-                        int victim = pager.clock_hand;
-                        pager.clock_hand = (pager.clock_hand + 1) % pager.nframes;
-                        return victim;
-                    }
+                if (page->state == PAGE_IN_MEMORY &&
+                    !second_chance(proc, frame->page_index, page)) {
+                    pager.clock_hand = (hand + 1) % pager.nframes;
+                    clock_stat(steps);
+                    return hand;
                 }
             }
+        } else if (which != VICTIM_ANY) {
+            protected = 1;
         }
+        if (!protected && fallback < 0) fallback = hand;
+
+        pager.clock_hand = (hand + 1) % pager.nframes;
 
-        pager.clock_hand = (pager.clock_hand + 1) % pager.nframes;
-        
         /* deu uma volta completa e não encontrou vítima */
         if (pager.clock_hand == start) {
-            int victim = pager.clock_hand;
-            pager.clock_hand = (pager.clock_hand + 1) % pager.nframes;
-            return victim;
+            if (fallback >= 0) {
+                pager.clock_hand = (fallback + 1) % pager.nframes;
+                clock_stat(steps);
+            }
+            return fallback;
+        }
+    }
+}
+
+/* relógio local: escolhe a vítima entre as páginas residentes do
+ * próprio processo, a partir de `proc->clock_hand`; devolve o quadro
+ * da vítima, ou -1 se o processo não tem páginas na memória */
+static int select_local_victim(process_table_t *proc) {
+    int fallback = -1;
+
+    for (int n = 0; n < proc->page_count; n++) {
+        int i = (proc->clock_hand + n) % proc->page_count;
+        page_entry_t *page = find_page(proc, i);
+        if (!page) {
+            /* folha ausente: pula para a próxima, sem passar do fim */
+            int last = i | (PT_LEAF_PAGES - 1);
+            if (last >= proc->page_count) last = proc->page_count - 1;
+            n += last - i;
+            continue;
+        }
+        if (page->state != PAGE_IN_MEMORY) continue;
+        if (!second_chance(proc, i, page)) {
+            proc->clock_hand = (i + 1) % proc->page_count;
+            clock_stat(n + 1);
+            return page->frame;
         }
+        if (fallback < 0) {
+            fallback = i;
+        }
+    }
+
+    /* deu uma volta completa: todas tinham referência */
+    if (fallback < 0) return -1;
+    proc->clock_hand = (fallback + 1) % proc->page_count;
+    clock_stat(proc->page_count);
+    return find_page(proc, fallback)->frame;
+}
+
+/* espera a escrita pendente no bloco, se houver; o disco não ordena
+ * uma leitura ou escrita depois de uma escrita anterior no mesmo bloco */
+static void block_wait(int block) {
+    mmu_disk_wait(pager.block_io[block]);
+    pager.block_io[block] = 0;
+}
+
+/* sem blocos livres: toma o bloco de uma página que está na memória;
+ * a cópia no disco deixa de valer e a página será escrita ao sair */
+static int steal_block(void) {
+    for (int i = 0; i < pager.nframes; i++) {
+        frame_entry_t *f = &pager.frames[i];
+        if (frame_is_free(i)) continue;
+        process_table_t *proc = f->proc;
+        if (!proc || f->page_index >= proc->page_count) continue;
+        page_entry_t *page = find_page(proc, f->page_index);
+        if (page->disk_block < 0) continue;
+
+        int block = page->disk_block;
+        /* a última escrita no bloco pode estar pendente */
+        block_wait(block);
+        page->disk_block = -1;
+        page->saved_on_disk = 0;
+        page->dirty = 1;
+        return block;
+    }
+    return -1;
+}
+
+/* o quadro só tem '0', como `mmu_zero_fill` o deixa? */
+static int frame_is_zero(int frame) {
+    return mmu_page_is_filled(pmem + (size_t)frame * UVM_PAGESIZE, '0',
+                              UVM_PAGESIZE);
+}
+
+/* hash de 64 bits do conteúdo do quadro, em quatro acumuladores
+ * independentes; nunca devolve 0, que marca bloco sem hash */
+static uint64_t frame_hash(int frame) {
+    const uint64_t *w = (const uint64_t *)(pmem + (size_t)frame * UVM_PAGESIZE);
+    const uint64_t k = 0x9E3779B97F4A7C15ULL;
+    uint64_t h[4] = {k, k + 1, k + 2, k + 3};
+    for (size_t i = 0; i < UVM_PAGESIZE / 8; i += 4) {
+        for (int j = 0; j < 4; j++) {
+            h[j] = (h[j] ^ w[i + j]) * k;
+            h[j] ^= h[j] >> 29;
+        }
+    }
+    uint64_t r = h[0] ^ (h[1] * 3) ^ (h[2] * 5) ^ (h[3] * 7);
+    r ^= r >> 32;
+    return r ? r : 1;
+}
+
+/* escritas de quadros para blocos consecutivos juntadas num só pedido */
+typedef struct {
+    int block; /* primeiro bloco */
+    int n;
+    int frames[MMU_DISK_MAXVEC];
+} write_cluster_t;
+
+/* envia as escritas juntadas; os quadros só são reutilizados depois */
+static void cluster_flush(write_cluster_t *wc) {
+    if (wc->n == 0) return;
+    mmu_io_token_t io = mmu_disk_writev_async(wc->frames, wc->block, wc->n);
+    for (int k = 0; k < wc->n; k++) {
+        pager.frames[wc->frames[k]].io = io;
+        pager.block_io[wc->block + k] = io;
     }
+    wc->n = 0;
 }
 
-/* remove página da memória e atualiza disco se necessário */
-static void evict_page(int frame) {
+static void cluster_write(write_cluster_t *wc, int frame, int block) {
+    if (wc->n > 0 && (block != wc->block + wc->n || wc->n == MMU_DISK_MAXVEC)) {
+        cluster_flush(wc);
+    }
+    if (wc->n == 0) wc->block = block;
+    block_wait(block);
+    wc->frames[wc->n++] = frame;
+}
 
+/* página já retirada do processo: salva no disco se estiver suja e
+ * libera o quadro; com `wc`, a escrita entra no grupo em vez de sair
+ * sozinha */
+static void page_out(process_table_t *proc, int page_idx, page_entry_t *page,
+                     write_cluster_t *wc) {
+    int frame = page->frame;
     frame_entry_t *f = &pager.frames[frame];
-    if (f->free) return;
+    void *vaddr = (void *)(UVM_BASEADDR + page_idx * UVM_PAGESIZE);
 
-    process_table_t *proc = find_process_table(f->pid);
-    if (!proc || f->page_index >= proc->page_count) {
-        f->free = 1;
-        return;
+    /* escritas que não passaram por pager_fault */
+    if (proc->tracking && mmu_dirty(proc->pid, vaddr)) {
+        page->dirty = 1;
     }
+    mmu_stat_count(page->dirty ? MMU_STAT_EVICT_DIRTY : MMU_STAT_EVICT_CLEAN, 1);
+
+    page->state = PAGE_ON_DISK;
 
-    page_entry_t *page = &proc->pages[f->page_index];
-    void *vaddr = (void *)(UVM_BASEADDR + f->page_index * sysconf(_SC_PAGESIZE));
-    
-    mmu_nonresident(f->pid, vaddr);
+    /* suja mas só com '0': volta a ser página nova, zerada no próximo
+     * acesso, sem escrita; o bloco continua com a página */
+    if (page->dirty && frame_is_zero(frame)) {
+        page->state = PAGE_UNINITIALIZED;
+        page->initialized = 0;
+        page->saved_on_disk = 0;
+        page->dirty = 0;
+        proc->writes_skipped++;
+    }
 
-    /* salva no disco se a página estiver suja */
+    /* salva no disco se a página estiver suja e o bloco não tiver o
+     * mesmo conteúdo; o hash só aponta candidatos, a comparação com o
+     * bloco confirma, depois da escrita pendente no bloco.  A escrita
+     * segue em paralelo e só é aguardada quando o quadro for
+     * reutilizado */
     if (page->dirty) {
-        mmu_disk_write(frame, page->disk_block);
+        uint64_t hash = frame_hash(frame);
+        block_wait(page->disk_block);
+        if (page->saved_on_disk && pager.block_hash[page->disk_block] == hash &&
+            mmu_disk_equal(frame, page->disk_block)) {
+            proc->writes_skipped++;
+        } else if (wc) {
+            cluster_write(wc, frame, page->disk_block);
+            proc->writes++;
+        } else {
+            f->io = mmu_disk_write_async(frame, page->disk_block);
+            pager.block_io[page->disk_block] = f->io;
+            proc->writes++;
+        }
+        pager.block_hash[page->disk_block] = hash;
         page->dirty = 0;
         page->saved_on_disk = 1;  /* tem dados válidos */
-    } else {
-        /* se não está suja, não há dados válidos no disco */
-        page->saved_on_disk = 0;
     }
+    /* se não está suja, a cópia no disco (se houver) continua válida */
 
-    page->state = PAGE_ON_DISK;
-    f->free = 1;
-    f->referenced = 0;
+    release_frame(frame);
+    proc->resident--;
+    proc->evictions++;
 }
 
-/* carrega página no quadro escolhido */
-static void load_page(process_table_t *proc, int page_idx, int frame) {
-    page_entry_t *page = &proc->pages[page_idx];
+/* dá um bloco à página que vai ser escrita, tomando o de outra página
+ * se não houver livre; devolve o bloco, ou -1 */
+static int give_block(process_table_t *proc, int page_idx, page_entry_t *page) {
+    page->disk_block = find_free_block(proc, page_idx);
+    if (page->disk_block < 0) page->disk_block = steal_block();
+    return page->disk_block;
+}
+
+/* remove página da memória e atualiza disco se necessário; devolve -1
+ * se a página precisaria ser salva e não há bloco de disco para ela */
+static int evict_page(int frame) {
+
     frame_entry_t *f = &pager.frames[frame];
-    page_state_t old_state = page->state;
+    if (frame_is_free(frame)) return 0;
+
+    process_table_t *proc = f->proc;
+    if (!proc || f->page_index >= proc->page_count) {
+        release_frame(frame);
+        return 0;
+    }
+
+    page_entry_t *page = find_page(proc, f->page_index);
+    void *vaddr = (void *)(UVM_BASEADDR + f->page_index * UVM_PAGESIZE);
+
+    /* alocação tardia: o bloco só é escolhido quando a página vai ser
+     * escrita, suja e não só com '0'.  Sem rastreamento a sujeira já é
+     * conhecida e o bloco é tomado antes de retirar a página */
+    if (page->disk_block < 0 && page->dirty && !proc->tracking &&
+        !frame_is_zero(frame) && give_block(proc, f->page_index, page) < 0) {
+        return -1;
+    }
+
+    mmu_nonresident(proc->pid, vaddr);
+
+    /* com rastreamento, a sujeira só se sabe depois de retirá-la; sem,
+     * o processo pode ter escrito no quadro que tinha só '0' */
+    if (proc->tracking && mmu_dirty(proc->pid, vaddr)) {
+        page->dirty = 1;
+    }
+    if (page->disk_block < 0 && page->dirty && !frame_is_zero(frame) &&
+        give_block(proc, f->page_index, page) < 0) {
+        /* sem bloco, a página volta para o processo */
+        mmu_resident(proc->pid, vaddr, frame, page->prot);
+        return -1;
+    }
+
+    page_out(proc, f->page_index, page, NULL);
+    return 0;
+}
+
+/* PFF: um processo abaixo da sua alocação cresce tomando quadros dos
+ * que estão acima da deles; os demais substituem as próprias páginas */
+static int pff_victims(process_table_t *proc) {
+    if (!pager.pff_window || proc->pff_frames == INT_MAX) return VICTIM_ANY;
+    if (proc->resident < proc->pff_frames) return VICTIM_DONOR;
+    return proc->resident > 0 ? VICTIM_SELF : VICTIM_ANY;
+}
+
+/* PFF: conta uma falta de `proc`; ao fim de cada janela, a alocação de
+ * cada processo cresce ou diminui conforme sua parcela das faltas */
+static void pff_fault(process_table_t *proc) {
+    if (!pager.pff_window) return;
+    proc->pff_faults++;
+    if (++pager.pff_faults < pager.pff_window) return;
+
+    int nproc = 0;
+    for (process_table_t *p = pager.processes; p; p = p->next) nproc++;
+    int step = pager.nframes / 16 > 1 ? pager.nframes / 16 : 1;
+    for (process_table_t *p = pager.processes; p; p = p->next) {
+        long share = (long)p->pff_faults * nproc * 100 / pager.pff_window;
+        if (share > PFF_UPPER) {
+            p->pff_frames = p->resident + step;
+        } else if (share < PFF_LOWER) {
+            p->pff_frames = p->resident - step;
+            if (p->pff_frames < p->min_frames) p->pff_frames = p->min_frames;
+        } else {
+            p->pff_frames = p->resident;
+        }
+        p->pff_faults = 0;
+    }
+    pager.pff_faults = 0;
+}
+
+/* hibernação: tira da memória as páginas [first, first + len), todas
+ * residentes, com uma só mensagem ao processo; as sujas em blocos
+ * consecutivos são escritas juntas */
+static void hibernate_run(process_table_t *proc, int first, int len) {
+    write_cluster_t wc;
+    wc.n = 0;
+    mmu_nonresident_range(proc->pid, (void *)(UVM_BASEADDR + first * UVM_PAGESIZE), len);
+    for (int i = first; i < first + len; i++) {
+        page_entry_t *page = find_page(proc, i);
+        page_out(proc, i, page, &wc);
+        page->hibernated = 1;
+    }
+    cluster_flush(&wc);
+}
+
+/* hibernação: tira da memória todas as páginas residentes do
+ * processo, em trechos contíguos; sem blocos livres, as páginas que
+ * precisariam de um ficam na memória.  Devolve quantas saíram */
+static int hibernate_pages(process_table_t *proc) {
+    int run_page = 0, run_len = 0, count = 0;
+    for (int i = 0; i < proc->page_count; i++) {
+        page_entry_t *page = find_page(proc, i);
+        int out = page && page->state == PAGE_IN_MEMORY;
+        if (out && page->disk_block < 0 && (page->dirty || proc->tracking)) {
+            /* sem tomar blocos de outras páginas, que podem estar no
+             * trecho; sem bloco a página fica na memória */
+            page->disk_block = find_free_block(proc, i);
+            out = page->disk_block >= 0;
+        }
+        if (!out) {
+            if (run_len > 0) {
+                hibernate_run(proc, run_page, run_len);
+                count += run_len;
+                run_len = 0;
+            }
+            if (!page) i |= PT_LEAF_PAGES - 1;
+            continue;
+        }
+        if (run_len == 0) run_page = i;
+        run_len++;
+    }
+    if (run_len > 0) {
+        hibernate_run(proc, run_page, run_len);
+        count += run_len;
+    }
+    if (count > 0) proc->hibernated = 1;
+    return count;
+}
 
-    f->free = 0;
-    f->pid = proc->pid;
+/* controle de carga: suspende o processo ativo mais novo, tirando
+ * todas as suas páginas da memória de uma vez, como na hibernação; o
+ * último processo ativo nunca é suspenso */
+static void lc_suspend(void) {
+    process_table_t *victim = NULL;
+    int active = 0;
+    for (process_table_t *p = pager.processes; p; p = p->next) {
+        if (p->suspended) continue;
+        active++;
+        if (!victim) victim = p; /* a lista começa pelo mais novo */
+    }
+    if (active < 2) return;
+
+    int count = hibernate_pages(victim);
+
+    /* páginas sem bloco livre saem uma a uma, tomando blocos de
+     * páginas de outros processos */
+    for (int i = 0; victim->resident > 0 && i < victim->page_count; i++) {
+        page_entry_t *page = find_page(victim, i);
+        if (!page) {
+            i |= PT_LEAF_PAGES - 1;
+            continue;
+        }
+        if (page->state != PAGE_IN_MEMORY || evict_page(page->frame) < 0) continue;
+        page->hibernated = 1;
+        victim->hibernated = 1;
+        count++;
+    }
+
+    /* nenhuma página pôde sair: suspender não libera memória */
+    if (count == 0 && victim->resident > 0) return;
+    victim->suspended = ++pager.lc_seq;
+}
+
+/* controle de carga: retoma o processo suspenso há mais tempo */
+static void lc_resume(void) {
+    process_table_t *oldest = NULL;
+    for (process_table_t *p = pager.processes; p; p = p->next) {
+        if (p->suspended && (!oldest || p->suspended < oldest->suspended)) {
+            oldest = p;
+        }
+    }
+    if (!oldest) return;
+    oldest->suspended = 0;
+    pthread_cond_broadcast(&pager.resume);
+}
+
+/* controle de carga: conta uma falta; ao fim de cada janela, muitas
+ * recargas indicam que os processos não cabem juntos na memória */
+static void lc_fault(int refault) {
+    if (!pager.lc_window) return;
+    pager.lc_faults++;
+    if (refault) pager.lc_refaults++;
+    if (pager.lc_faults < pager.lc_window) return;
+
+    int pct = pager.lc_refaults * 100 / pager.lc_window;
+    if (pct >= LC_THRASH) {
+        lc_suspend();
+    } else if (pct <= LC_CALM) {
+        lc_resume();
+    }
+    pager.lc_faults = 0;
+    pager.lc_refaults = 0;
+}
+
+/* falta de processo suspenso: espera ser retomado ou o prazo vencer;
+ * devolve a tabela do processo, ou NULL se ele foi destruído */
+static process_table_t* lc_wait(process_table_t *proc) {
+    pid_t pid = proc->pid;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += LC_SUSPEND_MS / 1000;
+    deadline.tv_nsec += (LC_SUSPEND_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while (proc && proc->suspended) {
+        int r = pthread_cond_timedwait(&pager.resume, &pager.mutex, &deadline);
+        proc = find_process_table(pid);
+        if (proc && r == ETIMEDOUT) proc->suspended = 0;
+    }
+    return proc;
+}
+
+/* acha quadro para uma página de `proc`, expulsando uma página se
+ * necessário: do próprio processo se ele está no seu máximo, senão
+ * pelo relógio global, guiado pelo PFF se ligado; devolve -1 se
+ * nenhuma página pode sair da memória por falta de blocos */
+static int get_frame(process_table_t *proc, int zero) {
+    int frame;
+    if (proc->resident >= proc->max_frames) {
+        for (int tries = 0; tries < 2 * proc->resident; tries++) {
+            frame = select_local_victim(proc);
+            if (frame < 0) break;
+            if (evict_page(frame) == 0) return frame;
+        }
+        return -1;
+    }
+
+    frame = find_free_frame(zero);
+    if (frame >= 0) return frame;
+
+    int which = pff_victims(proc);
+    for (int tries = 0; tries < 2 * pager.nframes; tries++) {
+        frame = select_victim_frame(proc, which);
+        if (frame < 0 && which != VICTIM_ANY) {
+            /* ninguém para doar: relógio global sem preferência */
+            which = VICTIM_ANY;
+            frame = select_victim_frame(proc, which);
+        }
+        if (frame < 0) break;
+        if (evict_page(frame) == 0) return frame;
+    }
+    return -1;
+}
+
+/* prepara o quadro escolhido para a página, sem mapear; devolve o
+ * bloco que ainda precisa ser lido para o quadro (já sem escrita
+ * pendente), ou -1 */
+static int start_fill(process_table_t *proc, int page_idx, int frame) {
+    page_entry_t *page = find_page(proc, page_idx);
+    frame_entry_t *f = &pager.frames[frame];
+    page_state_t old_state = page->state;
+    int block = -1;
+    int zeroed = freemap_test(&pager.zeroed, frame);
+
+    /* espera a escrita do conteúdo anterior do quadro terminar */
+    mmu_disk_wait(f->io);
+    f->io = 0;
+
+    freemap_set(&pager.free_frames, frame, 0);
+    if (zeroed) {
+        freemap_set(&pager.zeroed, frame, 0);
+        pager.zeroed_count--;
+        pthread_cond_signal(&pager.zero_work);
+    }
+    f->proc = proc;
     f->page_index = page_idx;
     f->referenced = 1;
 
     page->frame = frame;
     page->state = PAGE_IN_MEMORY;
     page->referenced = 1;
-
-    void *vaddr = (void *)(UVM_BASEADDR + page_idx * sysconf(_SC_PAGESIZE));
+    proc->resident++;
+    proc->pageins++;
 
     if (old_state == PAGE_UNINITIALIZED) {
-        mmu_zero_fill(frame);
+        if (!zeroed) mmu_zero_fill(frame);
         page->initialized = 1;
         page->saved_on_disk = 0;  /* não tem dados válidos */
         page->dirty = 0;
     } else if (old_state == PAGE_ON_DISK) {
         if (page->saved_on_disk) {
-            mmu_disk_read(page->disk_block, frame);
+            block = page->disk_block;
+            /* a página pode ter sido escrita de outro quadro há pouco */
+            block_wait(block);
             page->dirty = 0;
         } else {
-            mmu_zero_fill(frame);
+            if (!zeroed) mmu_zero_fill(frame);
             page->initialized = 1;
             page->saved_on_disk = 0;
             page->dirty = 0;
         }
     }
 
-    /* começa como somente leitura */
-    mmu_resident(proc->pid, vaddr, frame, PROT_READ);
-    page->prot = PROT_READ;
+    /* começa como somente leitura; com rastreamento a primeira
+     * escrita não precisa de falta para marcar a página suja */
+    page->prot = proc->tracking ? PROT_READ | PROT_WRITE : PROT_READ;
+    return block;
+}
+
+/* prepara o conteúdo da página no quadro escolhido, sem mapear */
+static void fill_page(process_table_t *proc, int page_idx, int frame) {
+    int block = start_fill(proc, page_idx, frame);
+    if (block >= 0) mmu_disk_wait(mmu_disk_read_async(block, frame));
+}
+
+/* carrega página no quadro escolhido */
+static void load_page(process_table_t *proc, int page_idx, int frame) {
+    fill_page(proc, page_idx, frame);
+    void *vaddr = (void *)(UVM_BASEADDR + page_idx * UVM_PAGESIZE);
+    mmu_resident(proc->pid, vaddr, frame, find_page(proc, page_idx)->prot);
+}
+
+/* mapeia `len` páginas a partir de `page_idx` em quadros consecutivos */
+static void map_run(process_table_t *proc, int page_idx, int frame, int len) {
+    void *vaddr = (void *)(UVM_BASEADDR + page_idx * UVM_PAGESIZE);
+    mmu_resident_range(proc->pid, vaddr, frame, len,
+                       find_page(proc, page_idx)->prot);
+}
+
+/* páginas carregadas em lote: leituras de blocos consecutivos viram um
+ * só pedido ao disco, e páginas consecutivas em quadros consecutivos
+ * são mapeadas com uma só mensagem ao processo */
+typedef struct {
+    int n;
+    int pages[LOAD_BATCH];
+    int frames[LOAD_BATCH];
+    int blocks[LOAD_BATCH]; /* -1 se a página não precisa de leitura */
+} load_batch_t;
+
+/* lê e mapeia as páginas do lote, esvaziando-o */
+static void batch_flush(process_table_t *proc, load_batch_t *b) {
+    mmu_io_token_t io[LOAD_BATCH];
+    int nio = 0;
+    for (int k = 0; k < b->n; ) {
+        int len = 1;
+        if (b->blocks[k] < 0) {
+            k++;
+            continue;
+        }
+        while (k + len < b->n && len < MMU_DISK_MAXVEC &&
+               b->blocks[k + len] == b->blocks[k] + len) {
+            len++;
+        }
+        io[nio++] = mmu_disk_readv_async(b->blocks[k], &b->frames[k], len);
+        k += len;
+    }
+    for (int k = 0; k < nio; k++) mmu_disk_wait(io[k]);
+
+    for (int k = 0; k < b->n; ) {
+        int len = 1;
+        while (k + len < b->n && b->pages[k + len] == b->pages[k] + len &&
+               b->frames[k + len] == b->frames[k] + len) {
+            len++;
+        }
+        map_run(proc, b->pages[k], b->frames[k], len);
+        k += len;
+    }
+    b->n = 0;
+}
+
+/* põe a página no quadro escolhido e no lote */
+static void batch_add(process_table_t *proc, load_batch_t *b, int page_idx, int frame) {
+    b->pages[b->n] = page_idx;
+    b->frames[b->n] = frame;
+    b->blocks[b->n] = start_fill(proc, page_idx, frame);
+    if (++b->n == LOAD_BATCH) batch_flush(proc, b);
+}
+
+/* carrega as páginas do intervalo que não estão na memória, em lotes */
+static void populate_pages(process_table_t *proc, int first, int npages) {
+    load_batch_t batch;
+    int loaded = 0;
+    /* mais páginas que quadros (ou que o máximo do processo) só
+     * expulsaria as primeiras */
+    int limit = pager.nframes < proc->max_frames ? pager.nframes : proc->max_frames;
+    batch.n = 0;
+    for (int i = first; i < first + npages && loaded < limit; i++) {
+        page_entry_t *page = get_page(proc, i);
+        if (!page) break;
+        if (page->state == PAGE_IN_MEMORY) continue;
+        int zero = needs_zero(page);
+        int frame = proc->resident < proc->max_frames ? find_free_frame(zero) : -1;
+        if (frame < 0) {
+            /* a vítima não pode estar no lote ainda não mapeado */
+            batch_flush(proc, &batch);
+            frame = get_frame(proc, zero);
+            if (frame < 0) break;
+        }
+        batch_add(proc, &batch, i, frame);
+        loaded++;
+    }
+    batch_flush(proc, &batch);
+}
+
+/* primeira falta depois de hibernar: traz de volta as páginas que
+ * estavam residentes, em lotes; devolve se `page_idx` voltou */
+static int wake_pages(process_table_t *proc, int page_idx) {
+    load_batch_t batch;
+    int loaded = 0;
+    int limit = pager.nframes < proc->max_frames ? pager.nframes : proc->max_frames;
+
+    batch.n = 0;
+    proc->hibernated = 0;
+    for (int i = 0; i < proc->page_count; i++) {
+        page_entry_t *page = find_page(proc, i);
+        if (!page) {
+            i |= PT_LEAF_PAGES - 1;
+            continue;
+        }
+        if (!page->hibernated) continue;
+        page->hibernated = 0;
+        if (page->state == PAGE_IN_MEMORY || loaded >= limit) continue;
+
+        int zero = needs_zero(page);
+        int frame = proc->resident < proc->max_frames ? find_free_frame(zero) : -1;
+        if (frame < 0) {
+            /* a vítima não pode estar no lote ainda não mapeado */
+            batch_flush(proc, &batch);
+            frame = get_frame(proc, zero);
+            if (frame < 0) {
+                loaded = limit;
+                continue;
+            }
+        }
+        batch_add(proc, &batch, i, frame);
+        loaded++;
+    }
+    batch_flush(proc, &batch);
+
+    page_entry_t *page = find_page(proc, page_idx);
+    return page && page->state == PAGE_IN_MEMORY;
+}
+
+/* reserva `npages` páginas novas para o processo; devolve -1 se o
+ * limite de alocação ou a região da MMU não comportam as páginas */
+static int commit_pages(process_table_t *proc, int npages) {
+    if (npages <= 0 || npages > mmu_region_pages() - proc->page_count) return -1;
+
+    /* estrito: um bloco por página; heurístico: páginas na memória
+     * não precisam de bloco, e sobra sempre um quadro para expulsar
+     * páginas sujas */
+    int limit;
+    switch (pager.overcommit) {
+    case PAGER_OVERCOMMIT_HEURISTIC:
+        limit = pager.nblocks + pager.nframes - 1;
+        break;
+    case PAGER_OVERCOMMIT_UNLIMITED:
+        limit = INT_MAX;
+        break;
+    default:
+        limit = pager.nblocks;
+        break;
+    }
+    if (npages > limit - pager.committed) return -1;
+    pager.committed += npages;
+    return 0;
+}
+
+/* páginas novas [first, first + npages): no modo estrito cada uma
+ * recebe seu bloco já, nos outros o bloco só é escolhido quando a
+ * página sai suja da memória e as folhas nem precisam existir */
+static int init_new_pages(process_table_t *proc, int first, int npages) {
+    if (pager.overcommit != PAGER_OVERCOMMIT_STRICT) return 0;
+    if (alloc_leaves(proc, first, npages) < 0) return -1;
+    for (int i = first; i < first + npages; i++) {
+        find_page(proc, i)->disk_block = find_free_block(proc, i);
+    }
+    return 0;
+}
+
+/* libera as páginas do processo a partir de `first` sem salvá-las,
+ * junto com as folhas que ficam vazias; `unmap` retira as páginas
+ * residentes do processo */
+static void release_pages(process_table_t *proc, int first, int unmap) {
+    long pagesize = UVM_PAGESIZE;
+    for (int i = first; i < proc->page_count; i++) {
+        page_entry_t *page = find_page(proc, i);
+        if (!page) {
+            /* folha ausente: nada a liberar até a próxima */
+            i |= PT_LEAF_PAGES - 1;
+            continue;
+        }
+
+        /* libera quadro físico se estiver ocupado */
+        if (page->state == PAGE_IN_MEMORY) {
+            if (unmap) {
+                mmu_nonresident(proc->pid, (void *)(UVM_BASEADDR + i * pagesize));
+            }
+            release_frame(page->frame);
+            proc->resident--;
+        }
+
+        free_block(page->disk_block);
+        init_page(page, -1);
+    }
+    for (int l = (first + PT_LEAF_PAGES - 1) >> PT_LEAF_BITS; l < proc->dir_len; l++) {
+        free(proc->dir[l]);
+        proc->dir[l] = NULL;
+    }
+    pager.committed -= proc->page_count - first;
+    proc->page_count = first;
+}
+
+/* descarta a página sem salvá-la; o próximo acesso a encontra zerada */
+static void discard_page(process_table_t *proc, int page_idx) {
+    page_entry_t *page = find_page(proc, page_idx);
+    if (!page) return; /* nunca usada */
+    if (page->state == PAGE_IN_MEMORY) {
+        void *vaddr = (void *)(UVM_BASEADDR + page_idx * UVM_PAGESIZE);
+        mmu_nonresident(proc->pid, vaddr);
+        release_frame(page->frame);
+        proc->resident--;
+    }
+    /* o bloco pode voltar a ser escrito a partir de outro quadro */
+    if (page->disk_block >= 0) block_wait(page->disk_block);
+    page->state = PAGE_UNINITIALIZED;
+    page->frame = -1;
+    page->prot = PROT_NONE;
+    page->referenced = 0;
+    page->dirty = 0;
+    page->initialized = 0;
+    page->saved_on_disk = 0;
+    page->hibernated = 0;
+}
+
+/* falta em região sequencial: as páginas que ficaram para trás serão
+ * as próximas vítimas do relógio, sem segunda chance */
+static void drop_behind(process_table_t *proc, int page_idx) {
+    int behind = page_idx - 2 * READAHEAD_PAGES;
+    if (behind < 0) behind = 0;
+    for (int i = behind; i < page_idx; i++) {
+        page_entry_t *page = find_page(proc, i);
+        if (page && page->advice == UVM_ADV_SEQUENTIAL &&
+            page->state == PAGE_IN_MEMORY) {
+            /* consome acessos já registrados na tabela compartilhada */
+            sync_soft_fault(proc->pid, i, page);
+            if (proc->tracking) {
+                mmu_referenced(proc->pid,
+                    (void *)(UVM_BASEADDR + i * UVM_PAGESIZE));
+            }
+            page->referenced = 0;
+            pager.frames[page->frame].referenced = 0;
+        }
+    }
+}
+
+/* falta em região sequencial: lê as próximas páginas */
+static void read_ahead(process_table_t *proc, int page_idx) {
+    int n = 0;
+    while (n < READAHEAD_PAGES && page_idx + 1 + n < proc->page_count) {
+        page_entry_t *next = find_page(proc, page_idx + 1 + n);
+        if (!next || next->advice != UVM_ADV_SEQUENTIAL) break;
+        n++;
+    }
+    populate_pages(proc, page_idx + 1, n);
 }
 
 /* inicialização global do paginador */
@@ -255,13 +1218,98 @@ void pager_init(int nframes, int nblocks) {
 
     pager.frames = malloc(nframes * sizeof(frame_entry_t));
     for (int i = 0; i < nframes; i++) {
-        pager.frames[i].free = 1;
+        pager.frames[i].proc = NULL;
         pager.frames[i].referenced = 0;
+        pager.frames[i].io = 0;
+    }
+    freemap_init(&pager.free_frames, nframes);
+    freemap_init(&pager.free_blocks, nblocks);
+    freemap_init(&pager.free_extents, nblocks / EXTENT_BLOCKS);
+    pager.block_hash = calloc(nblocks, sizeof(uint64_t));
+    pager.block_io = calloc(nblocks, sizeof(mmu_io_token_t));
+    freemap_init(&pager.zeroed, nframes);
+    memset(pager.zeroed.bits, 0, (nframes + 63) / 64 * sizeof(uint64_t));
+    pager.zeroed_count = 0;
+    pager.zero_pool = 0;
+    pager.zeroing = -1;
+    pthread_cond_init(&pager.zero_work, NULL);
+
+    pager.overcommit = PAGER_OVERCOMMIT_STRICT;
+    pager.committed = 0;
+
+    pager.pff_window = 0;
+    pager.pff_faults = 0;
+
+    pager.lc_window = 0;
+    pager.lc_faults = 0;
+    pager.lc_refaults = 0;
+    pager.lc_seq = 0;
+    pthread_cond_init(&pager.resume, NULL);
+}
+
+/* política de alocação de blocos de disco */
+void pager_overcommit(int mode) {
+    pthread_mutex_lock(&pager.mutex);
+    pager.overcommit = mode;
+    pthread_mutex_unlock(&pager.mutex);
+}
+
+/* liga a alocação por frequência de faltas */
+void pager_pff(int window) {
+    pthread_mutex_lock(&pager.mutex);
+    pager.pff_window = window;
+    pthread_mutex_unlock(&pager.mutex);
+}
+
+/* liga o controle de carga */
+void pager_load_control(int window) {
+    pthread_mutex_lock(&pager.mutex);
+    pager.lc_window = window;
+    pthread_mutex_unlock(&pager.mutex);
+}
+
+/* mantém até `zero_pool` quadros livres zerados, fora das faltas.
+ * O quadro é reservado (sai dos livres) e zerado sem o lock; o
+ * relógio não o escolhe enquanto isso */
+static void *zero_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&pager.mutex);
+    for (;;) {
+        int frame = pager.zeroed_count < pager.zero_pool ? find_unzeroed_frame() : -1;
+        if (frame < 0) {
+            pthread_cond_wait(&pager.zero_work, &pager.mutex);
+            continue;
+        }
+        freemap_set(&pager.free_frames, frame, 0);
+        pager.zeroing = frame;
+        mmu_io_token_t io = pager.frames[frame].io;
+        pager.frames[frame].io = 0;
+        pthread_mutex_unlock(&pager.mutex);
+
+        /* a escrita do conteúdo anterior ainda pode estar lendo o quadro */
+        mmu_disk_wait(io);
+        mmu_zero_fill(frame);
+
+        pthread_mutex_lock(&pager.mutex);
+        pager.zeroing = -1;
+        /* reservado, o quadro não pode ter sido tomado */
+        assert(!frame_is_free(frame) && !pager.frames[frame].proc);
+        freemap_set(&pager.free_frames, frame, 1);
+        freemap_set(&pager.zeroed, frame, 1);
+        pager.zeroed_count++;
     }
+    return NULL;
+}
 
-    pager.free_blocks = malloc(nblocks * sizeof(int));
-    for (int i = 0; i < nblocks; i++) pager.free_blocks[i] = 1;
-    pager.free_block_count = nblocks;
+/* liga o conjunto de quadros zerados */
+void pager_zero_pool(int nframes) {
+    pthread_t thread;
+    pthread_mutex_lock(&pager.mutex);
+    pager.zero_pool = nframes < pager.nframes ? nframes : pager.nframes;
+    pthread_mutex_unlock(&pager.mutex);
+    if (pthread_create(&thread, NULL, zero_thread, NULL) == 0) {
+        pthread_detach(thread);
+    }
 }
 
 /* cria processo */
@@ -289,45 +1337,59 @@ void *pager_extend(pid_t pid) {
     }
 
     /* verifica se há blocos de disco disponíveis */
-    if (pager.free_block_count <= 0) {
+    if (commit_pages(proc, 1) < 0) {
         errno = ENOSPC;
         pthread_mutex_unlock(&pager.mutex);
         return NULL;
     }
 
-    /* aloca um bloco de disco */
-    int block = find_free_block();
-    if (block < 0) {
+    /* aloca um bloco de disco e a entrada na tabela de páginas */
+    if (init_new_pages(proc, proc->page_count, 1) < 0) {
+        pager.committed--;
         pthread_mutex_unlock(&pager.mutex);
         return NULL;
     }
 
-    /* expande a tabela de páginas */
-    int new_count = proc->page_count + 1;
-    page_entry_t *new_pages = realloc(proc->pages, new_count * sizeof(page_entry_t));
-    if (!new_pages) {
-        free_block(block);
+    /* calcula endereço virtual */
+    void *vaddr = (void *)(UVM_BASEADDR + proc->page_count * UVM_PAGESIZE);
+    proc->page_count++;
+
+    pthread_mutex_unlock(&pager.mutex);
+    return vaddr;
+}
+
+/* aloca várias páginas virtuais consecutivas de uma vez */
+void *pager_extend_n(pid_t pid, int npages, int populate) {
+    pthread_mutex_lock(&pager.mutex);
+
+    process_table_t *proc = find_process_table(pid);
+    if (!proc) {
         pthread_mutex_unlock(&pager.mutex);
         return NULL;
     }
 
-    proc->pages = new_pages;
+    /* todas ou nenhuma: todas devem caber no limite de alocação e na
+     * região gerenciada pela MMU */
+    long pagesize = UVM_PAGESIZE;
+    if (commit_pages(proc, npages) < 0) {
+        errno = ENOSPC;
+        pthread_mutex_unlock(&pager.mutex);
+        return NULL;
+    }
 
-    /* inicializa nova página */
-    page_entry_t *page = &proc->pages[proc->page_count];
-    page->state = PAGE_UNINITIALIZED;
-    page->frame = -1;
-    page->disk_block = block;
-    page->prot = PROT_NONE;
-    page->referenced = 0;
-    page->dirty = 0;
-    page->initialized = 0;
-    page->saved_on_disk = 0; 
+    int first = proc->page_count;
+    if (init_new_pages(proc, first, npages) < 0) {
+        pager.committed -= npages;
+        pthread_mutex_unlock(&pager.mutex);
+        return NULL;
+    }
+    proc->page_count += npages;
 
-    /* calcula endereço virtual */
-    void *vaddr = (void *)(UVM_BASEADDR + proc->page_count * sysconf(_SC_PAGESIZE));
-    proc->page_count++;
+    if (populate) {
+        populate_pages(proc, first, npages);
+    }
 
+    void *vaddr = (void *)(UVM_BASEADDR + first * pagesize);
     pthread_mutex_unlock(&pager.mutex);
     return vaddr;
 }
@@ -337,22 +1399,40 @@ void pager_fault(pid_t pid, void *addr) {
     pthread_mutex_lock(&pager.mutex);
 
     process_table_t *proc = find_process_table(pid);
+    if (proc && proc->suspended) {
+        proc = lc_wait(proc);
+    }
     if (!proc) {
         pthread_mutex_unlock(&pager.mutex);
         return;
     }
 
     intptr_t offset = (intptr_t)addr - UVM_BASEADDR;
-    int page_idx = offset / sysconf(_SC_PAGESIZE);
+    int page_idx = (int)(offset >> UVM_PAGESHIFT);
     if (page_idx < 0 || page_idx >= proc->page_count) {
         pthread_mutex_unlock(&pager.mutex);
         return;
     }
+    proc->faults++;
 
-    page_entry_t *page = &proc->pages[page_idx];
-    void *page_vaddr = (void *)(UVM_BASEADDR + page_idx * sysconf(_SC_PAGESIZE));
+    if (proc->hibernated && wake_pages(proc, page_idx)) {
+        /* a página voltou com as demais: o acesso se repete */
+        mmu_stat_count(MMU_STAT_FAULT_MAJOR, 1);
+        pthread_mutex_unlock(&pager.mutex);
+        return;
+    }
+
+    page_entry_t *page = get_page(proc, page_idx);
+    if (!page) {
+        /* sem memória para a tabela de páginas */
+        mmu_oom_kill(pid);
+        pthread_mutex_unlock(&pager.mutex);
+        return;
+    }
+    void *page_vaddr = (void *)(UVM_BASEADDR + page_idx * UVM_PAGESIZE);
 
     if (page->state == PAGE_IN_MEMORY) {
+        sync_soft_fault(pid, page_idx, page);
         page->referenced = 1;
         pager.frames[page->frame].referenced = 1;
 
@@ -360,25 +1440,46 @@ void pager_fault(pid_t pid, void *addr) {
             /* dada segunda chance e a página voltou a ser usada */
             page->prot = PROT_READ;
             mmu_chprot(pid, page_vaddr, page->prot);
+            mmu_stat_count(MMU_STAT_FAULT_MINOR, 1);
         } else if (page->prot == PROT_READ) {
             /* falta por escrita em página só leitura */
             page->prot = PROT_READ | PROT_WRITE;
             page->dirty = 1;  /* MARCADA COMO SUJA! */
             mmu_chprot(pid, page_vaddr, page->prot);
+            mmu_stat_count(MMU_STAT_FAULT_WRITE, 1);
         }
 
         pthread_mutex_unlock(&pager.mutex);
         return;
     }
 
+    if (page->advice == UVM_ADV_SEQUENTIAL) {
+        drop_behind(proc, page_idx);
+    }
+
     /* não está na memória: escolher quadro */
-    int frame = find_free_frame();
+    pff_fault(proc);
+    lc_fault(page->state == PAGE_ON_DISK);
+    if (proc->suspended) {
+        /* o próprio processo foi suspenso: a falta se repete e espera */
+        pthread_mutex_unlock(&pager.mutex);
+        return;
+    }
+    int zero = needs_zero(page);
+    int frame = get_frame(proc, zero);
     if (frame < 0) {
-        frame = select_victim_frame();
-        evict_page(frame);
+        /* sem overcommit estrito pode faltar disco: mata o processo */
+        mmu_oom_kill(pid);
+        pthread_mutex_unlock(&pager.mutex);
+        return;
     }
 
     load_page(proc, page_idx, frame);
+    mmu_stat_count(zero ? MMU_STAT_FAULT_ZERO : MMU_STAT_FAULT_MAJOR, 1);
+
+    if (page->advice == UVM_ADV_SEQUENTIAL) {
+        read_ahead(proc, page_idx);
+    }
 
     pthread_mutex_unlock(&pager.mutex);
 }
@@ -394,7 +1495,10 @@ int pager_syslog(pid_t pid, void *addr, size_t len) {
         return -1;
     }
 
-    long pagesize = sysconf(_SC_PAGESIZE);
+    long pagesize = UVM_PAGESIZE;
+    static const char hexdigits[] = "0123456789abcdef";
+    char hex[256];
+    size_t nhex = 0;
 
     /* check se endereço está dentro do espaço alocado */
     intptr_t start_offset = (intptr_t)addr - UVM_BASEADDR;
@@ -414,50 +1518,29 @@ int pager_syslog(pid_t pid, void *addr, size_t len) {
         int page_idx    = offset / pagesize;
         int byte_in_page = offset % pagesize;
 
-        page_entry_t *page = &proc->pages[page_idx];
+        page_entry_t *page = get_page(proc, page_idx);
+        if (!page) {
+            pthread_mutex_unlock(&pager.mutex);
+            errno = ENOMEM;
+            return -1;
+        }
 
         /* página não está na memória, traz para memória */
         if (page->state != PAGE_IN_MEMORY) {
-            int frame = find_free_frame();
-            if (frame < 0) {
-                frame = select_victim_frame();
-                evict_page(frame);
-            }
+            /* descarrega a saída pendente antes de paginar */
+            mmu_print(hex, nhex);
+            nhex = 0;
 
-            frame_entry_t *f = &pager.frames[frame];
-            f->free = 0;
-            f->pid = pid;
-            f->page_index = page_idx;
-            f->referenced = 1;
-
-            page->frame = frame;
-            page->state = PAGE_IN_MEMORY;
-            page->referenced = 1;
-
-            void *vaddr = (void *)(UVM_BASEADDR +
-                                   (intptr_t)page_idx * pagesize);
-
-            /* a mesma lógica de load_page */
-            if (page->state == PAGE_UNINITIALIZED) {
-                mmu_zero_fill(frame);
-                page->initialized = 1;
-                page->saved_on_disk = 0;
-                page->dirty = 0;
-            } else if (page->state == PAGE_ON_DISK) {
-                if (page->saved_on_disk) {
-                    mmu_disk_read(page->disk_block, frame);
-                    page->dirty = 0;
-                } else {
-                    mmu_zero_fill(frame);
-                    page->initialized = 1;
-                    page->saved_on_disk = 0;
-                    page->dirty = 0;
-                }
+            int frame = get_frame(proc, needs_zero(page));
+            if (frame < 0) {
+                pthread_mutex_unlock(&pager.mutex);
+                errno = ENOMEM;
+                return -1;
             }
 
-            /* map como somente leitura para syslog */
-            mmu_resident(pid, vaddr, frame, PROT_READ);
-            page->prot = PROT_READ;
+            /* mapeia como em pager_fault (somente leitura, ou leitura e
+             * escrita com rastreamento) */
+            load_page(proc, page_idx, frame);
         }
 
         /* update bit de referência */
@@ -467,15 +1550,161 @@ int pager_syslog(pid_t pid, void *addr, size_t len) {
         /* lê da memória física e imprime */
         unsigned char byte =
             pmem[page->frame * pagesize + byte_in_page];
-        printf("%02x", (unsigned)byte);
+        if (nhex + 3 > sizeof(hex)) {
+            mmu_print(hex, nhex);
+            nhex = 0;
+        }
+        hex[nhex++] = hexdigits[byte >> 4];
+        hex[nhex++] = hexdigits[byte & 0xf];
     }
 
-    printf("\n");
+    hex[nhex++] = '\n';
+    mmu_print(hex, nhex);
+
+    pthread_mutex_unlock(&pager.mutex);
+    return 0;
+}
+
+/* dicas de acesso do processo para um intervalo de páginas */
+int pager_advise(pid_t pid, void *addr, size_t len, int advice) {
+    pthread_mutex_lock(&pager.mutex);
+
+    process_table_t *proc = find_process_table(pid);
+    long pagesize = UVM_PAGESIZE;
+    intptr_t start_offset = (intptr_t)addr - UVM_BASEADDR;
+    if (!proc || start_offset < 0 || len == 0 ||
+        start_offset + (intptr_t)len > (intptr_t)proc->page_count * pagesize) {
+        pthread_mutex_unlock(&pager.mutex);
+        errno = EINVAL;
+        return -1;
+    }
+    int first = start_offset / pagesize;
+    int last = (start_offset + (intptr_t)len - 1) / pagesize;
+
+    switch (advice) {
+    case UVM_ADV_NORMAL:
+    case UVM_ADV_RANDOM:
+    case UVM_ADV_SEQUENTIAL:
+        for (int i = first; i <= last; i++) {
+            page_entry_t *page = get_page(proc, i);
+            if (!page) {
+                pthread_mutex_unlock(&pager.mutex);
+                errno = ENOMEM;
+                return -1;
+            }
+            page->advice = advice;
+        }
+        break;
+    case UVM_ADV_WILLNEED:
+        populate_pages(proc, first, last - first + 1);
+        break;
+    case UVM_ADV_DONTNEED:
+        for (int i = first; i <= last; i++) {
+            discard_page(proc, i);
+        }
+        break;
+    default:
+        pthread_mutex_unlock(&pager.mutex);
+        errno = EINVAL;
+        return -1;
+    }
 
     pthread_mutex_unlock(&pager.mutex);
     return 0;
 }
 
+/* devolve as páginas do processo a partir de npages, sem salvá-las */
+void pager_shrink(pid_t pid, int npages) {
+    pthread_mutex_lock(&pager.mutex);
+
+    process_table_t *proc = find_process_table(pid);
+    if (!proc || npages < 0 || npages >= proc->page_count) {
+        pthread_mutex_unlock(&pager.mutex);
+        return;
+    }
+
+    /* blocos liberados não podem ter escritas pendentes */
+    for (int i = 0; i < pager.nframes; i++) {
+        mmu_disk_wait(pager.frames[i].io);
+        pager.frames[i].io = 0;
+    }
+
+    /* encolhe a tabela de páginas junto */
+    release_pages(proc, npages, 1);
+
+    pthread_mutex_unlock(&pager.mutex);
+}
+
+/* limites de quadros do processo */
+int pager_limit(pid_t pid, int min_frames, int max_frames) {
+    pthread_mutex_lock(&pager.mutex);
+
+    process_table_t *proc = find_process_table(pid);
+    if (max_frames <= 0) max_frames = INT_MAX;
+
+    /* sobra sempre um quadro fora dos mínimos para as faltas dos
+     * outros processos */
+    int reserved = 0;
+    for (process_table_t *p = pager.processes; p; p = p->next) {
+        if (p != proc) reserved += p->min_frames;
+    }
+    if (!proc || min_frames < 0 || min_frames > max_frames ||
+        min_frames > pager.nframes - 1 - reserved) {
+        pthread_mutex_unlock(&pager.mutex);
+        errno = EINVAL;
+        return -1;
+    }
+    proc->min_frames = min_frames;
+    proc->max_frames = max_frames;
+
+    /* o excesso sai já, pelo relógio local */
+    while (proc->resident > proc->max_frames) {
+        int frame = select_local_victim(proc);
+        if (frame < 0 || evict_page(frame) < 0) break;
+    }
+
+    pthread_mutex_unlock(&pager.mutex);
+    return 0;
+}
+
+/* contadores do processo */
+int pager_stat(pid_t pid, struct pager_stat *st) {
+    pthread_mutex_lock(&pager.mutex);
+
+    process_table_t *proc = find_process_table(pid);
+    if (!proc) {
+        pthread_mutex_unlock(&pager.mutex);
+        return -1;
+    }
+    st->resident = proc->resident;
+    st->min_frames = proc->min_frames;
+    st->max_frames = proc->max_frames == INT_MAX ? 0 : proc->max_frames;
+    st->faults = proc->faults;
+    st->pageins = proc->pageins;
+    st->evictions = proc->evictions;
+    st->writes = proc->writes;
+    st->writes_skipped = proc->writes_skipped;
+
+    pthread_mutex_unlock(&pager.mutex);
+    return 0;
+}
+
+/* hibernação: tira da memória todas as páginas residentes do processo */
+int pager_hibernate(pid_t pid) {
+    pthread_mutex_lock(&pager.mutex);
+
+    process_table_t *proc = find_process_table(pid);
+    if (!proc) {
+        pthread_mutex_unlock(&pager.mutex);
+        return 0;
+    }
+
+    int count = hibernate_pages(proc);
+
+    pthread_mutex_unlock(&pager.mutex);
+    return count;
+}
+
 /* libera todas as estruturas de um processo */
 void pager_destroy(pid_t pid) {
     pthread_mutex_lock(&pager.mutex);
@@ -486,22 +1715,20 @@ void pager_destroy(pid_t pid) {
         return;
     }
 
-    /* para cada página do processo */
-    for (int i = 0; i < proc->page_count; i++) {
-        page_entry_t *page = &proc->pages[i];
-
-        /* libera quadro físico se estiver ocupado */
-        if (page->state == PAGE_IN_MEMORY) {
-            pager.frames[page->frame].free = 1;
-            pager.frames[page->frame].referenced = 0;
-        }
-
-        /* liebra bloco de disco */
-        free_block(page->disk_block);
+    /* blocos liberados não podem ter escritas pendentes */
+    for (int i = 0; i < pager.nframes; i++) {
+        mmu_disk_wait(pager.frames[i].io);
+        pager.frames[i].io = 0;
     }
 
+    /* libera quadros e blocos de todas as páginas do processo */
+    release_pages(proc, 0, 0);
+
     /* remove tabela do processo */
     destroy_process_table(proc);
 
+    /* a memória liberada pode comportar um processo suspenso */
+    lc_resume();
+
     pthread_mutex_unlock(&pager.mutex);
 }
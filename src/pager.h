@@ -13,6 +13,59 @@
  * backing store, respectively. */
 void pager_init(int nframes, int nblocks);
 
+/* `pager_overcommit` is called after `pager_init`, before any process
+ * is created, to choose how pages are backed by disk blocks:
+ *
+ * - `PAGER_OVERCOMMIT_STRICT` (the default) allocates a block with
+ *   each page, so allocation fails once blocks run out.
+ * - `PAGER_OVERCOMMIT_HEURISTIC` allocates a block only when a page
+ *   is first paged out dirty, and allows as many pages as there are
+ *   blocks and frames, minus one.  Paging out never runs out of
+ *   blocks.
+ * - `PAGER_OVERCOMMIT_UNLIMITED` also allocates blocks lazily and
+ *   does not limit allocation.  If a page cannot be paged out for
+ *   lack of blocks, the pager kills the faulting process with
+ *   `mmu_oom_kill`. */
+#define PAGER_OVERCOMMIT_STRICT 0
+#define PAGER_OVERCOMMIT_HEURISTIC 1
+#define PAGER_OVERCOMMIT_UNLIMITED 2
+void pager_overcommit(int mode);
+
+/* `pager_pff` is called after `pager_init`, before any process is
+ * created, to turn on page-fault-frequency (PFF) frame allocation.
+ * The pager counts faults that load a page, in windows of `window`
+ * faults across all processes.  At the end of each window, it
+ * compares each process's faults with its fair share of the window.
+ * Processes with more than 1.5 times their share may grow by a few
+ * frames; those with less than half their share should give a few
+ * up; the others keep the frames they have.  Victims for a process
+ * below its allocation then come from processes above theirs, and a
+ * process at its allocation replaces its own pages.  PFF is off by
+ * default; allocations never go below `pager_limit` minimums. */
+void pager_pff(int window);
+
+/* `pager_load_control` is called after `pager_init`, before any
+ * process is created, to turn on load control.  The pager counts
+ * faults that load a page in windows of `window` faults.  If at least
+ * half the faults in a window load pages that had been paged out,
+ * processes are thrashing: the pager suspends the newest running
+ * process, paging all its pages out, and keeps the process's faults
+ * waiting.  Suspended processes are resumed, oldest suspension first,
+ * after a window where at most a tenth of the faults load pages back,
+ * when another process is destroyed, or after one second, as
+ * processes may be waiting on each other.  The last running process
+ * is never suspended.  Load control is off by default. */
+void pager_load_control(int window);
+
+/* `pager_zero_pool` is called after `pager_init`, before any process
+ * is created, to keep up to `nframes` free frames filled with '0' in
+ * advance.  A background thread zeroes free frames with
+ * `mmu_zero_fill` as frames are freed, so faults on new pages take the
+ * lowest-numbered zeroed frame and skip the fill; when none is left,
+ * they take the lowest-numbered free frame and fill it as usual.  The
+ * pool is off by default. */
+void pager_zero_pool(int nframes);
+
 /* `pager_create` should initialize any resources the pager needs to
  * manage memory for a new process `pid`. */
 void pager_create(pid_t pid);
@@ -26,6 +79,24 @@ void pager_create(pid_t pid);
  * use as backing storage. */
 void *pager_extend(pid_t pid);
 
+/* `pager_extend_n` allocates `npages` consecutive pages to process
+ * `pid` and returns the address of the first one.  It either
+ * allocates all pages or none, returning NULL if there are not
+ * enough disk blocks.  If `populate` is nonzero, the pager should
+ * also make the pages resident right away (as if the process had
+ * accessed them), sparing the process one fault per page; it may
+ * populate fewer pages than requested if memory is short. */
+void *pager_extend_n(pid_t pid, int npages, int populate);
+
+/* `pager_shrink` is called when process `pid` gives back all its
+ * pages from the `npages`-th onwards, either by calling `uvm_shrink`
+ * or because the MMU allocated pages in advance that the process
+ * never used.  The pager should unmap resident pages, free their
+ * frames and disk blocks without writing them back, and shrink the
+ * process's page table.  The next page allocated to the process will
+ * be the `npages`-th. */
+void pager_shrink(pid_t pid, int npages);
+
 /* `pager_fault` is called when process `pid` receives
  * a segmentation fault at address `addr`.  `pager_fault` is only
  * called for addresses previously returned with `pager_extend`.  If
@@ -49,6 +120,63 @@ void pager_fault(pid_t pid, void *addr);
  * the syslog succeeds, it should return 0. */
 int pager_syslog(pid_t pid, void *addr, size_t len);
 
+/* `pager_advise` receives an access hint from process `pid` for the
+ * pages overlapping the `len` bytes following `addr`; `advice` is
+ * one of the `UVM_ADV_*` values in uvm.h.  `UVM_ADV_WILLNEED` should
+ * read the pages in; `UVM_ADV_DONTNEED` should drop them, freeing
+ * their frames without writing them back, so the next access finds
+ * a zeroed page.  The other hints apply to future faults on the
+ * pages.  If the region was not allocated or `advice` is unknown,
+ * `pager_advise` should return -1 and set errno to EINVAL;
+ * otherwise, it should return 0. */
+int pager_advise(pid_t pid, void *addr, size_t len, int advice);
+
+/* `pager_limit` bounds the number of frames holding pages of process
+ * `pid`.  While the process has `min_frames` frames or fewer, other
+ * processes' faults should not take its frames.  Once it has
+ * `max_frames` frames, its faults should page out one of its own
+ * pages, chosen by a clock over the process's pages, instead of
+ * taking frames from others; if it has more frames than that, the
+ * excess should be paged out right away.  A zero `max_frames` means
+ * no maximum.  If `min_frames` is larger than `max_frames`, or the
+ * minimums of all processes would leave no frame for other faults
+ * (at least one frame must remain unreserved), `pager_limit` should
+ * return -1 and set errno to EINVAL; otherwise, it should return 0.
+ * Processes start without limits. */
+int pager_limit(pid_t pid, int min_frames, int max_frames);
+
+/* `pager_stat` fills `st` with the limits and counters of process
+ * `pid`.  `faults` counts calls to `pager_fault`, `pageins` counts
+ * pages loaded into frames (zero-filled or read from disk), and
+ * `evictions` counts pages of the process paged out.  `writes` counts
+ * dirty pages written to disk when paged out; `writes_skipped` counts
+ * dirty pages paged out without a write, because they held only '0'
+ * (they become new pages again) or the same data their disk block
+ * already had.  Returns -1 if `pid` is unknown, 0 otherwise. */
+struct pager_stat {
+	int resident;
+	int min_frames;
+	int max_frames; /* zero if unlimited */
+	long faults;
+	long pageins;
+	long evictions;
+	long writes;
+	long writes_skipped;
+};
+int pager_stat(pid_t pid, struct pager_stat *st);
+
+/* `pager_hibernate` is called when process `pid` calls
+ * `uvm_hibernate` or stays idle for the period given to the MMU with
+ * `-i`.  The pager should page out all the process's resident pages
+ * at once, unmapping runs of consecutive pages with
+ * `mmu_nonresident_range`, and remember which pages were resident.
+ * On the process's next call to `pager_fault`, those pages should be
+ * brought back together, as far as frames allow, before the fault is
+ * serviced.  Pages that would need a disk block when none is free
+ * stay resident.  Returns the number of pages paged out (0 if `pid`
+ * is unknown). */
+int pager_hibernate(pid_t pid);
+
 /* `pager_destroy` is called when the process is already dead.  It
  * should free all resources process `pid` allocated (memory frames
  * and disk blocks).  `pager_destroy` should not call any of the MMU
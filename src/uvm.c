@@ -4,15 +4,25 @@
 
 #include "uvm.h"
 
+#include <linux/fs.h>
+#include <linux/userfaultfd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/un.h>
+#ifdef UVMUFFD
+#include <linux/magic.h>
+#include <sys/vfs.h>
+#endif
 
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
@@ -26,6 +36,39 @@
 #include "mmu.h"
 #include "mmuproto.h"
 
+/* Asynchronous write-protection and PAGEMAP_SCAN appeared in Linux
+ * 6.7; older headers lack them. */
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED (1<<13)
+#endif
+#ifndef UFFD_FEATURE_WP_ASYNC
+#define UFFD_FEATURE_WP_ASYNC (1<<15)
+#endif
+#ifndef PAGEMAP_SCAN
+#define PAGE_IS_WRITTEN (1<<1)
+#define PAGE_IS_PRESENT (1<<3)
+struct page_region {
+	uint64_t start;
+	uint64_t end;
+	uint64_t categories;
+};
+struct pm_scan_arg {
+	uint64_t size;
+	uint64_t flags;
+	uint64_t start;
+	uint64_t end;
+	uint64_t walk_end;
+	uint64_t vec;
+	uint64_t vec_len;
+	uint64_t max_pages;
+	uint64_t category_inverted;
+	uint64_t category_mask;
+	uint64_t category_anyof_mask;
+	uint64_t return_mask;
+};
+#define PAGEMAP_SCAN _IOWR('f', 16, struct pm_scan_arg)
+#endif
+
 /****************************************************************************
  * structure definitions and static variables
  ***************************************************************************/
@@ -38,7 +81,47 @@ struct uvm_data {/*{{{*/
 	pthread_cond_t cond;
 	char *pmem_fn;
 	int pmem_fd;
+	uint32_t nextid;
+	struct uvm_request *inflight;
+	int uffd;                   /* -1 if faults arrive as SIGSEGV */
+	int uffd_wp;                /* write faults arrive through uffd */
+	int uffd_stop;              /* eventfd to stop `uffd_thread` */
+	pthread_t uffd_thread;
+	int track_uffd;             /* -1 if not tracking page state */
+	int track_pagemap;
+	int track_stop;             /* eventfd to stop `track_thread` */
+	uint32_t track_ms;
+	pthread_t track_thread;
+	struct uvm_page *pages;
+	size_t npstate;
+	struct mmu_proto_page_state *pstate; /* shared with the MMU */
+	uint64_t *lease;            /* extend lease, after `pstate` */
+};/*}}}*/
+/* Outstanding EXTEND, SYSLOG, ADVISE and SEGV requests.  Requests are
+ * completed by `uvm_thread` when the matching reply arrives, which
+ * then broadcasts `uvm->cond`.  A request is freed when its last
+ * waiter (`refs`) is done with it. */
+struct uvm_request {/*{{{*/
+	uint32_t id;
+	uint32_t type;
+	uintptr_t page;             /* faulting page for SEGV requests */
+	struct uvm_stat *stat;      /* filled by STAT replies */
+	int done;
+	int refs;
 	intptr_t result;
+	struct uvm_request *next;
+};/*}}}*/
+
+/* Protection currently applied to each page, as set by REMAP and
+ * CHPROT messages and soft faults.  In userfaultfd mode, pages
+ * without a frame mapped are "parked": the address range is backed by
+ * anonymous memory registered for missing faults, so the first access
+ * is reported to `uvm_uffd_thread`.  The frame offset is kept while
+ * parked so a later CHPROT can map the frame back. */
+struct uvm_page {/*{{{*/
+	off_t off;
+	int prot;
+	int mapped;
 };/*}}}*/
 
 static struct uvm_data *uvm = NULL;
@@ -49,10 +132,37 @@ static struct uvm_data *uvm = NULL;
 static void * uvm_thread(void *data);
 static void uvm_exit(int status, void *arg);
 static void uvm_segv_action(int signum, siginfo_t *si, void *context);
+#ifdef UVMUFFD
+static int uvm_uffd_init(void);
+static void * uvm_uffd_thread(void *data);
+static void uvm_uffd_park(void *addr, size_t len);
+static void uvm_uffd_map(void *addr, off_t off, size_t npages, int prot);
+static void uvm_uffd_chprot(void *addr, int prot);
+static void uvm_uffd_wp(void *addr, size_t len, int wp);
+#endif
+static int uvm_track_init(void);
+static void * uvm_track_thread(void *data);
+static void uvm_track_map(void *addr, size_t len);
+static void uvm_track_unmap(void *addr);
 
-/* Protocol message handlers assume assume `uvm->mutex` is locked. */
+/* Request helpers and protocol message handlers assume `uvm->mutex`
+ * is locked. */
+static struct uvm_request * uvm_request_new(uint32_t type);
+static intptr_t uvm_lease_take(void);
+static int uvm_lease_reaches(void *addr, size_t len);
+static void uvm_request_complete(uint32_t id, intptr_t result);
+static intptr_t uvm_request_wait(struct uvm_request *r);
+static void uvm_fault_check(intptr_t va);
+static int uvm_soft_fault(intptr_t va);
+static struct uvm_request * uvm_fault_send(intptr_t va, int code);
 static void uvm_proto_extend_rep(void);
+static void uvm_proto_extend_n_rep(void);
 static void uvm_proto_syslog_rep(void);
+static void uvm_proto_advise_rep(void);
+static void uvm_proto_shrink_rep(void);
+static void uvm_proto_limit_rep(void);
+static void uvm_proto_stat_rep(void);
+static void uvm_proto_hibernate_rep(void);
 static void uvm_proto_segv_rep(void);
 static void uvm_proto_remap_rep(void);
 static void uvm_proto_chprot_rep(void);
@@ -61,6 +171,8 @@ static void uvm_proto_chprot_rep(void);
 static void uvm_connect_socket(int sock, const struct sockaddr_un * addr);
 
 #define NUM_CONNECTION_TRIES 3
+#define UVM_UFFD_BATCH 16
+#define UVM_TRACK_BATCH 64
 
 #define prexit() do { loge(LOG_FATAL, __FILE__, __LINE__); \
 			char buf[80]; sprintf(buf, "%s:%d: ", __FILE__, __LINE__); \
@@ -73,6 +185,9 @@ void uvm_create(void)/*{{{*/
 {
 	#ifdef UVMLOG
 	log_init(LOG_EXTRA, "uvm.log", 1, 1<<20);
+	#ifdef LOGASYNC
+	log_async(LOG_ASYNC_FLUSH_MS, LOG_ASYNC_FLUSH_BYTES);
+	#endif
 	#endif
 	logd(LOG_DEBUG, "uvm_create starting\n");
 	assert(uvm == NULL);
@@ -80,6 +195,11 @@ void uvm_create(void)/*{{{*/
 	if(!uvm) prexit();
 	uvm->running = 1;
 	uvm->npages = 0;
+	uvm->track_uffd = -1;
+	uvm->track_pagemap = -1;
+	uvm->track_ms = 0;
+	if(uvm_track_init() == -1)
+		logd(LOG_INFO, "  page-state tracking unavailable\n");
 
 	logd(LOG_DEBUG, "  connecting unix socket [%s]\n", MMU_PROTO_UNIX_PATH);
 	uvm->sock = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -96,13 +216,61 @@ void uvm_create(void)/*{{{*/
 	struct mmu_proto_create_req req;
 	req.type = MMU_PROTO_CREATE_REQ;
 	req.pid = (uint32_t)getpid();
+	req.track = uvm->track_uffd != -1;
 	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
 		prexit();
 
 	logd(LOG_DEBUG, "  waiting CREATE_REP\n");
 	struct mmu_proto_create_rep rep;
-	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep)) prexit();
+	struct iovec iov = { .iov_base = &rep, .iov_len = sizeof(rep) };
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} ctl;
+	struct msghdr mh;
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = ctl.buf;
+	mh.msg_controllen = sizeof(ctl.buf);
+	if(recvmsg(uvm->sock, &mh, MSG_WAITALL | MSG_CMSG_CLOEXEC)
+			!= sizeof(rep))
+		prexit();
 	assert(rep.type == MMU_PROTO_CREATE_REP);
+	if(rep.pageshift != UVM_PAGESHIFT) {
+		logd(LOG_FATAL, "MMU page shift %u, built with %d\n",
+				rep.pageshift, UVM_PAGESHIFT);
+		fprintf(stderr, "page size differs from the MMU's. aborting.\n");
+		exit(EXIT_FAILURE);
+	}
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+	if(!cm || cm->cmsg_type != SCM_RIGHTS) {
+		logd(LOG_FATAL, "CREATE_REP without page-state table\n");
+		prexit();
+	}
+	int pstate_fd;
+	memcpy(&pstate_fd, CMSG_DATA(cm), sizeof(int));
+	uvm->track_ms = rep.track_ms;
+	if(uvm->track_ms == 0 && uvm->track_uffd != -1) {
+		close(uvm->track_pagemap);
+		close(uvm->track_uffd);
+		uvm->track_pagemap = -1;
+		uvm->track_uffd = -1;
+	}
+
+	size_t npages = (size_t)rep.npages;
+	logd(LOG_DEBUG, "  mapping page-state table, %zu pages\n", npages);
+	uvm->npstate = npages;
+	uvm->pstate = mmap(NULL, npages * sizeof(uvm->pstate[0]) +
+			sizeof(*uvm->lease), PROT_READ | PROT_WRITE, MAP_SHARED,
+			pstate_fd, 0);
+	if(uvm->pstate == MAP_FAILED)
+		prexit();
+	uvm->lease = (uint64_t *)(uvm->pstate + npages);
+	close(pstate_fd);
+	uvm->pages = calloc(npages, sizeof(uvm->pages[0]));
+	if(!uvm->pages)
+		prexit();
 
 	uvm->pmem_fn = strndup(rep.pmem_fn, MMU_PROTO_PATH_MAX);
 	logd(LOG_DEBUG, "  mapping pmem_fn [%s]\n", uvm->pmem_fn);
@@ -110,6 +278,16 @@ void uvm_create(void)/*{{{*/
 	if(uvm->pmem_fd == -1)
 		prexit();
 
+	uvm->uffd = -1;
+	uvm->uffd_wp = 0;
+	#ifdef UVMUFFD
+	logd(LOG_DEBUG, "  registering UVM region with userfaultfd\n");
+	if(uvm_uffd_init() == -1)
+		logd(LOG_INFO, "  userfaultfd unavailable, using SIGSEGV\n");
+	#endif
+
+	/* SIGSEGV also reports external faults and, if userfaultfd cannot
+	 * write-protect pmem, write faults on read-only pages. */
 	logd(LOG_DEBUG, "  setting up SEGV handler\n");
 	struct sigaction new;
 	new.sa_sigaction = uvm_segv_action;
@@ -119,9 +297,22 @@ void uvm_create(void)/*{{{*/
 	sigaction(SIGSEGV, &new, NULL);
 
 	logd(LOG_DEBUG, "  starting uvm_thread()\n");
+	uvm->nextid = 1;
+	uvm->inflight = NULL;
 	pthread_mutex_init(&uvm->mutex, NULL);
 	pthread_cond_init(&uvm->cond, NULL);
 	pthread_create(&uvm->thread, NULL, uvm_thread, NULL);
+	#ifdef UVMUFFD
+	if(uvm->uffd != -1)
+		pthread_create(&uvm->uffd_thread, NULL, uvm_uffd_thread, NULL);
+	#endif
+	if(uvm->track_uffd != -1) {
+		logd(LOG_DEBUG, "  sampling accesses every %u ms\n",
+				uvm->track_ms);
+		uvm->track_stop = eventfd(0, EFD_CLOEXEC);
+		if(uvm->track_stop == -1) prexit();
+		pthread_create(&uvm->track_thread, NULL, uvm_track_thread, NULL);
+	}
 
 	logd(LOG_DEBUG, "  setting up uvm_exit() on_exit()\n");
 	if(on_exit(uvm_exit, NULL)) prexit();
@@ -130,30 +321,204 @@ void uvm_create(void)/*{{{*/
 }/*}}}*/
 
 void * uvm_extend(void) {/*{{{*/
+	return uvm_extend_wait(uvm_extend_async());
+}/*}}}*/
+
+void * uvm_extend_n(size_t npages, int flags)/*{{{*/
+{
+	return uvm_extend_wait(uvm_extend_n_async(npages, flags));
+}/*}}}*/
+
+int uvm_syslog(void *addr, size_t len)/*{{{*/
+{
+	return uvm_syslog_wait(uvm_syslog_async(addr, len));
+}/*}}}*/
+
+int uvm_advise(void *addr, size_t len, int advice)/*{{{*/
+{
+	return uvm_advise_wait(uvm_advise_async(addr, len, advice));
+}/*}}}*/
+
+int uvm_shrink(size_t npages)/*{{{*/
+{
 	pthread_mutex_lock(&uvm->mutex);
+	if(npages > (size_t)uvm->npages) {
+		pthread_mutex_unlock(&uvm->mutex);
+		errno = EINVAL;
+		return -1;
+	}
+	struct uvm_request *r = uvm_request_new(MMU_PROTO_SHRINK_REQ);
+	struct mmu_proto_shrink_req req;
+	req.type = MMU_PROTO_SHRINK_REQ;
+	req.reqid = r->id;
+	req.npages = (uint32_t)npages;
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	uvm_request_wait(r);
+	uvm->npages = (int)npages;
+	pthread_mutex_unlock(&uvm->mutex);
+	return 0;
+}/*}}}*/
+
+int uvm_limit(size_t min_frames, size_t max_frames)/*{{{*/
+{
+	pthread_mutex_lock(&uvm->mutex);
+	struct uvm_request *r = uvm_request_new(MMU_PROTO_LIMIT_REQ);
+	struct mmu_proto_limit_req req;
+	req.type = MMU_PROTO_LIMIT_REQ;
+	req.reqid = r->id;
+	req.min_frames = min_frames > UINT32_MAX ? UINT32_MAX : (uint32_t)min_frames;
+	req.max_frames = max_frames > UINT32_MAX ? UINT32_MAX : (uint32_t)max_frames;
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	int result = (int)uvm_request_wait(r);
+	pthread_mutex_unlock(&uvm->mutex);
+	if(result != 0) errno = EINVAL;
+	return result;
+}/*}}}*/
+
+int uvm_stat(struct uvm_stat *st)/*{{{*/
+{
+	pthread_mutex_lock(&uvm->mutex);
+	struct uvm_request *r = uvm_request_new(MMU_PROTO_STAT_REQ);
+	r->stat = st;
+	struct mmu_proto_stat_req req;
+	req.type = MMU_PROTO_STAT_REQ;
+	req.reqid = r->id;
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	uvm_request_wait(r);
+	pthread_mutex_unlock(&uvm->mutex);
+	return 0;
+}/*}}}*/
+
+int uvm_hibernate(void)/*{{{*/
+{
+	pthread_mutex_lock(&uvm->mutex);
+	struct uvm_request *r = uvm_request_new(MMU_PROTO_HIBERNATE_REQ);
+	struct mmu_proto_hibernate_req req;
+	req.type = MMU_PROTO_HIBERNATE_REQ;
+	req.reqid = r->id;
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	int npages = (int)uvm_request_wait(r);
+	pthread_mutex_unlock(&uvm->mutex);
+	return npages;
+}/*}}}*/
+
+uvm_request_t uvm_extend_async(void)/*{{{*/
+{
+	pthread_mutex_lock(&uvm->mutex);
+	struct uvm_request *r = uvm_request_new(MMU_PROTO_EXTEND_REQ);
+	intptr_t vaddr = uvm_lease_take();
+	if(vaddr) {
+		uvm_request_complete(r->id, vaddr);
+		pthread_mutex_unlock(&uvm->mutex);
+		return r;
+	}
 	struct mmu_proto_extend_req req;
 	req.type = MMU_PROTO_EXTEND_REQ;
+	req.reqid = r->id;
 	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
 		prexit();
-	pthread_cond_wait(&uvm->cond, &uvm->mutex);
-	if(uvm->result) uvm->npages++;
 	pthread_mutex_unlock(&uvm->mutex);
-	return (void *)uvm->result;
+	return r;
 }/*}}}*/
 
-int uvm_syslog(void *addr, size_t len)/*{{{*/
+uvm_request_t uvm_extend_n_async(size_t npages, int flags)/*{{{*/
 {
 	pthread_mutex_lock(&uvm->mutex);
+	struct uvm_request *r = uvm_request_new(MMU_PROTO_EXTEND_N_REQ);
+	struct mmu_proto_extend_n_req req;
+	req.type = MMU_PROTO_EXTEND_N_REQ;
+	req.reqid = r->id;
+	/* the MMU refuses requests larger than the UVM region */
+	req.npages = npages > UINT32_MAX ? UINT32_MAX : (uint32_t)npages;
+	req.flags = (flags & UVM_POPULATE) ? MMU_PROTO_EXTEND_POPULATE : 0;
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	pthread_mutex_unlock(&uvm->mutex);
+	return r;
+}/*}}}*/
+
+uvm_request_t uvm_syslog_async(void *addr, size_t len)/*{{{*/
+{
+	pthread_mutex_lock(&uvm->mutex);
+	struct uvm_request *r = uvm_request_new(MMU_PROTO_SYSLOG_REQ);
+	if(uvm_lease_reaches(addr, len)) {
+		uvm_request_complete(r->id, -1);
+		pthread_mutex_unlock(&uvm->mutex);
+		return r;
+	}
 	struct mmu_proto_syslog_req req;
 	req.type = MMU_PROTO_SYSLOG_REQ;
+	req.reqid = r->id;
+	req.addr = (intptr_t)addr;
+	req.len = len;
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	pthread_mutex_unlock(&uvm->mutex);
+	return r;
+}/*}}}*/
+
+uvm_request_t uvm_advise_async(void *addr, size_t len, int advice)/*{{{*/
+{
+	pthread_mutex_lock(&uvm->mutex);
+	struct uvm_request *r = uvm_request_new(MMU_PROTO_ADVISE_REQ);
+	if(uvm_lease_reaches(addr, len)) {
+		uvm_request_complete(r->id, -1);
+		pthread_mutex_unlock(&uvm->mutex);
+		return r;
+	}
+	struct mmu_proto_advise_req req;
+	req.type = MMU_PROTO_ADVISE_REQ;
+	req.reqid = r->id;
+	req.advice = advice;
 	req.addr = (intptr_t)addr;
 	req.len = len;
 	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
 		prexit();
-	pthread_cond_wait(&uvm->cond, &uvm->mutex);
-	if(uvm->result != 0) errno = EINVAL;
 	pthread_mutex_unlock(&uvm->mutex);
-	return (int)uvm->result;
+	return r;
+}/*}}}*/
+
+int uvm_poll(uvm_request_t r)/*{{{*/
+{
+	pthread_mutex_lock(&uvm->mutex);
+	int done = r->done;
+	pthread_mutex_unlock(&uvm->mutex);
+	return done;
+}/*}}}*/
+
+void * uvm_extend_wait(uvm_request_t r)/*{{{*/
+{
+	pthread_mutex_lock(&uvm->mutex);
+	assert(r->type == MMU_PROTO_EXTEND_REQ ||
+			r->type == MMU_PROTO_EXTEND_N_REQ);
+	void *vaddr = (void *)uvm_request_wait(r);
+	pthread_mutex_unlock(&uvm->mutex);
+	if(!vaddr) errno = ENOSPC;
+	return vaddr;
+}/*}}}*/
+
+int uvm_syslog_wait(uvm_request_t r)/*{{{*/
+{
+	pthread_mutex_lock(&uvm->mutex);
+	assert(r->type == MMU_PROTO_SYSLOG_REQ);
+	int result = (int)uvm_request_wait(r);
+	pthread_mutex_unlock(&uvm->mutex);
+	if(result != 0) errno = EINVAL;
+	return result;
+}/*}}}*/
+
+int uvm_advise_wait(uvm_request_t r)/*{{{*/
+{
+	pthread_mutex_lock(&uvm->mutex);
+	assert(r->type == MMU_PROTO_ADVISE_REQ);
+	int result = (int)uvm_request_wait(r);
+	pthread_mutex_unlock(&uvm->mutex);
+	if(result != 0) errno = EINVAL;
+	return result;
 }/*}}}*/
 
 /****************************************************************************
@@ -177,9 +542,27 @@ void * uvm_thread(void *data) {/*{{{*/
 			case MMU_PROTO_EXTEND_REP:
 				uvm_proto_extend_rep();
 				break;
+			case MMU_PROTO_EXTEND_N_REP:
+				uvm_proto_extend_n_rep();
+				break;
 			case MMU_PROTO_SYSLOG_REP:
 				uvm_proto_syslog_rep();
 				break;
+			case MMU_PROTO_ADVISE_REP:
+				uvm_proto_advise_rep();
+				break;
+			case MMU_PROTO_SHRINK_REP:
+				uvm_proto_shrink_rep();
+				break;
+			case MMU_PROTO_LIMIT_REP:
+				uvm_proto_limit_rep();
+				break;
+			case MMU_PROTO_STAT_REP:
+				uvm_proto_stat_rep();
+				break;
+			case MMU_PROTO_HIBERNATE_REP:
+				uvm_proto_hibernate_rep();
+				break;
 			case MMU_PROTO_SEGV_REP:
 				uvm_proto_segv_rep();
 				break;
@@ -205,6 +588,24 @@ void * uvm_thread(void *data) {/*{{{*/
 void uvm_exit(int status, void *arg)/*{{{*/
 {
 	logd(LOG_DEBUG, "uvm_exit running\n");
+	/* `uvm_uffd_thread` exits the process on bad accesses */
+	int uffd_exiting = uvm->uffd != -1 &&
+			pthread_equal(pthread_self(), uvm->uffd_thread);
+	#ifdef UVMUFFD
+	if(uvm->uffd != -1 && !uffd_exiting) {
+		uint64_t one = 1;
+		if(write(uvm->uffd_stop, &one, sizeof(one)) != sizeof(one))
+			prexit();
+		pthread_join(uvm->uffd_thread, NULL);
+	}
+	#endif
+	if(uvm->track_uffd != -1) {
+		uint64_t one = 1;
+		if(write(uvm->track_stop, &one, sizeof(one)) != sizeof(one))
+			prexit();
+		pthread_join(uvm->track_thread, NULL);
+		close(uvm->track_stop);
+	}
 	struct mmu_proto_exit_req req;
 	req.type = MMU_PROTO_EXIT_REQ;
 	/* socket may have been closed by the MMU, ignore return value: */
@@ -212,11 +613,25 @@ void uvm_exit(int status, void *arg)/*{{{*/
 	pthread_mutex_unlock(&(uvm->mutex));
 	pthread_join(uvm->thread, NULL);
 	close(uvm->sock);
+	/* `uvm_thread` parks pages until the MMU acknowledges the exit.
+	 * Closing the uffd wakes faulting threads, so it is left open if
+	 * the process is exiting because of a bad access. */
+	if(uvm->uffd != -1 && !uffd_exiting) {
+		close(uvm->uffd_stop);
+		close(uvm->uffd);
+	}
+	if(uvm->track_uffd != -1) {
+		close(uvm->track_pagemap);
+		close(uvm->track_uffd);
+	}
 
 	pthread_mutex_destroy(&uvm->mutex);
 	pthread_cond_destroy(&uvm->cond);
 	free(uvm->pmem_fn);
 	close(uvm->pmem_fd);
+	free(uvm->pages);
+	munmap(uvm->pstate, uvm->npstate * sizeof(uvm->pstate[0]) +
+			sizeof(*uvm->lease));
 	free(uvm);
 	uvm = NULL;
 	#ifdef UVMLOG
@@ -230,29 +645,168 @@ void uvm_segv_action(int signum, siginfo_t *si, void *context)/*{{{*/
 	assert(si->si_signo == SIGSEGV);
 	logd(LOG_DEBUG, "segv addr %p code %d\n", si->si_addr, si->si_code);
 	intptr_t va = (intptr_t)si->si_addr;
-	if(va < UVM_BASEADDR || va > UVM_MAXADDR) {
+	uvm_fault_check(va);
+	if(uvm_soft_fault(va)) {
+		pthread_mutex_unlock(&uvm->mutex);
+		return;
+	}
+	struct uvm_request *r = uvm_fault_send(va, si->si_code);
+	logd(LOG_DEBUG, "%s waiting service at condition variable\n", __func__);
+	uvm_request_wait(r);
+	pthread_mutex_unlock(&uvm->mutex);
+	logd(LOG_DEBUG, "%s returning\n", __func__);
+}/*}}}*/
+
+/****************************************************************************
+ * request tracking
+ ***************************************************************************/
+struct uvm_request * uvm_request_new(uint32_t type)/*{{{*/
+{
+	struct uvm_request *r = malloc(sizeof(*r));
+	if(!r) prexit();
+	r->id = uvm->nextid++;
+	r->type = type;
+	r->page = 0;
+	r->stat = NULL;
+	r->done = 0;
+	r->refs = 1;
+	r->result = 0;
+	r->next = uvm->inflight;
+	uvm->inflight = r;
+	return r;
+}/*}}}*/
+
+void uvm_request_complete(uint32_t id, intptr_t result)/*{{{*/
+{
+	struct uvm_request **prev = &uvm->inflight;
+	while(*prev && (*prev)->id != id) prev = &(*prev)->next;
+	if(!*prev) {
+		logd(LOG_FATAL, "reply for unknown reqid %u\n", id);
+		prexit();
+	}
+	struct uvm_request *r = *prev;
+	*prev = r->next;
+	r->result = result;
+	r->done = 1;
+	pthread_cond_broadcast(&uvm->cond);
+}/*}}}*/
+
+/* Hands out the next page of the extend lease, if any is left.
+ * Returns the page's address or zero.  Called with `uvm->mutex`
+ * locked. */
+intptr_t uvm_lease_take(void)/*{{{*/
+{
+	uint64_t lease = __atomic_load_n(uvm->lease, __ATOMIC_ACQUIRE);
+	uint32_t used;
+	do {
+		used = MMU_PROTO_LEASE_USED(lease);
+		if(used == MMU_PROTO_LEASE_END(lease)) return 0;
+	} while(!__atomic_compare_exchange_n(uvm->lease, &lease,
+			MMU_PROTO_LEASE(MMU_PROTO_LEASE_END(lease), used + 1), 0,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+	if((int)used + 1 > uvm->npages) uvm->npages = (int)used + 1;
+	size_t pagesz = UVM_PAGESIZE;
+	return UVM_BASEADDR + (intptr_t)used * (intptr_t)pagesz;
+}/*}}}*/
+
+/* Returns nonzero if the `len` bytes following `addr` reach leased
+ * pages that were not handed out yet: the pager holds them for the
+ * process and would accept requests for them.  Called with
+ * `uvm->mutex` locked. */
+int uvm_lease_reaches(void *addr, size_t len)/*{{{*/
+{
+	uint64_t lease = __atomic_load_n(uvm->lease, __ATOMIC_ACQUIRE);
+	if(MMU_PROTO_LEASE_END(lease) <= (uint32_t)uvm->npages) return 0;
+	size_t pagesz = UVM_PAGESIZE;
+	return (intptr_t)addr < UVM_BASEADDR ||
+			(uintptr_t)addr - UVM_BASEADDR + len >
+			(uintptr_t)uvm->npages * pagesz;
+}/*}}}*/
+
+/* Waits for `r` to complete, drops one reference, and returns the
+ * request's result. */
+intptr_t uvm_request_wait(struct uvm_request *r)/*{{{*/
+{
+	while(!r->done) pthread_cond_wait(&uvm->cond, &uvm->mutex);
+	intptr_t result = r->result;
+	if(--r->refs == 0) free(r);
+	return result;
+}/*}}}*/
+
+/****************************************************************************
+ * fault forwarding
+ ***************************************************************************/
+/* Exits the process if `va` is not a page allocated with `uvm_extend`. */
+void uvm_fault_check(intptr_t va)/*{{{*/
+{
+	size_t pagesz = UVM_PAGESIZE;
+	if(va < UVM_BASEADDR ||
+			(uintptr_t)(va - UVM_BASEADDR) / pagesz >= uvm->npstate) {
 		logd(LOG_DEBUG, "external segfault. aborting.\n");
 		fprintf(stderr, "(external) segmentation fault\n");
 		exit(EXIT_FAILURE);
 	}
-	size_t pagesz = sysconf(_SC_PAGESIZE);
 	if(va >= UVM_BASEADDR + (uvm->npages * pagesz)) {
 		logd(LOG_DEBUG, "access to unnallocated MMU address.\n");
 		fprintf(stderr, "(internal) segmentation fault.\n");
 		fprintf(stderr, "address %p not allocated.\n", (void *)va);
 		exit(EXIT_FAILURE);
 	}
+}/*}}}*/
 
+/* Restores `PROT_READ` to a resident page the MMU set to `PROT_NONE`
+ * (see `struct mmu_proto_page_state`) and records the access for the
+ * pager.  Returns nonzero if the fault at `va` was handled. */
+int uvm_soft_fault(intptr_t va)/*{{{*/
+{
+	size_t pagesz = UVM_PAGESIZE;
+	size_t idx = (size_t)(va - UVM_BASEADDR) / pagesz;
+	struct uvm_page *p = &uvm->pages[idx];
+	struct mmu_proto_page_state *st = &uvm->pstate[idx];
+	if(p->prot != PROT_NONE || !__atomic_load_n(&st->soft, __ATOMIC_ACQUIRE))
+		return 0;
+	void *addr = (void *)(va & ~((intptr_t)pagesz - 1));
+	logd(LOG_DEBUG, "soft fault %p\n", addr);
+	if(uvm->uffd != -1) {
+		#ifdef UVMUFFD
+		uvm_uffd_map(addr, p->off, 1, PROT_READ);
+		#endif
+	} else if(mprotect(addr, pagesz, PROT_READ) == -1) {
+		prexit();
+	}
+	p->prot = PROT_READ;
+	st->prot = PROT_READ;
+	__atomic_store_n(&st->soft, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&st->referenced, 1, __ATOMIC_RELEASE);
+	return 1;
+}/*}}}*/
+
+/* Sends a SEGV_REQ for `va` and returns the request, or joins an
+ * outstanding fault on the same page.  The caller must wait on the
+ * returned request. */
+struct uvm_request * uvm_fault_send(intptr_t va, int code)/*{{{*/
+{
+	uvm_fault_check(va);
+	size_t pagesz = UVM_PAGESIZE;
+	uintptr_t page = (uintptr_t)va & ~((uintptr_t)pagesz - 1);
+	struct uvm_request *r = uvm->inflight;
+	while(r && !(r->type == MMU_PROTO_SEGV_REQ && r->page == page))
+		r = r->next;
+	if(r) {
+		logd(LOG_DEBUG, "%s joining reqid %u\n", __func__, r->id);
+		r->refs++;
+		return r;
+	}
+	r = uvm_request_new(MMU_PROTO_SEGV_REQ);
+	r->page = page;
 	struct mmu_proto_segv_req req;
 	req.type = MMU_PROTO_SEGV_REQ;
-	req.addr = (intptr_t)si->si_addr;
-	req.code = si->si_code;
-	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req)) prexit();
-
-	logd(LOG_DEBUG, "%s waiting service at condition variable\n", __func__);
-	pthread_cond_wait(&uvm->cond, &uvm->mutex);
-	pthread_mutex_unlock(&uvm->mutex);
-	logd(LOG_DEBUG, "%s returning\n", __func__);
+	req.reqid = r->id;
+	req.addr = va;
+	req.code = code;
+	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req))
+		prexit();
+	return r;
 }/*}}}*/
 
 /****************************************************************************
@@ -265,8 +819,29 @@ void uvm_proto_extend_rep(void)/*{{{*/
 	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
 		prexit();
 	assert(rep.type == MMU_PROTO_EXTEND_REP);
-	uvm->result = (intptr_t)rep.vaddr;
-	pthread_cond_signal(&uvm->cond);
+	if(rep.vaddr) {
+		/* concurrent extends may complete out of order */
+		size_t pagesz = UVM_PAGESIZE;
+		int npages = (int)((rep.vaddr - UVM_BASEADDR) / pagesz) + 1;
+		if(npages > uvm->npages) uvm->npages = npages;
+	}
+	uvm_request_complete(rep.reqid, (intptr_t)rep.vaddr);
+}/*}}}*/
+
+void uvm_proto_extend_n_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing EXTEND_N_REP\n");
+	struct mmu_proto_extend_n_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_EXTEND_N_REP);
+	if(rep.vaddr) {
+		size_t pagesz = UVM_PAGESIZE;
+		int npages = (int)((rep.vaddr - UVM_BASEADDR) / pagesz) +
+				(int)rep.npages;
+		if(npages > uvm->npages) uvm->npages = npages;
+	}
+	uvm_request_complete(rep.reqid, (intptr_t)rep.vaddr);
 }/*}}}*/
 
 void uvm_proto_syslog_rep(void)/*{{{*/
@@ -276,8 +851,69 @@ void uvm_proto_syslog_rep(void)/*{{{*/
 	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
 		prexit();
 	assert(rep.type == MMU_PROTO_SYSLOG_REP);
-	uvm->result = (intptr_t)rep.retcode;
-	pthread_cond_signal(&uvm->cond);
+	uvm_request_complete(rep.reqid, (intptr_t)(int32_t)rep.retcode);
+}/*}}}*/
+
+void uvm_proto_advise_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing ADVISE_REP\n");
+	struct mmu_proto_advise_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_ADVISE_REP);
+	uvm_request_complete(rep.reqid, (intptr_t)(int32_t)rep.retcode);
+}/*}}}*/
+
+void uvm_proto_shrink_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing SHRINK_REP\n");
+	struct mmu_proto_shrink_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_SHRINK_REP);
+	uvm_request_complete(rep.reqid, 0);
+}/*}}}*/
+
+void uvm_proto_limit_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing LIMIT_REP\n");
+	struct mmu_proto_limit_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_LIMIT_REP);
+	uvm_request_complete(rep.reqid, (intptr_t)(int32_t)rep.retcode);
+}/*}}}*/
+
+void uvm_proto_stat_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing STAT_REP\n");
+	struct mmu_proto_stat_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_STAT_REP);
+	struct uvm_request *r = uvm->inflight;
+	while(r && r->id != rep.reqid) r = r->next;
+	if(r && r->stat) {
+		r->stat->resident = rep.resident;
+		r->stat->min_frames = rep.min_frames;
+		r->stat->max_frames = rep.max_frames;
+		r->stat->faults = rep.faults;
+		r->stat->pageins = rep.pageins;
+		r->stat->evictions = rep.evictions;
+		r->stat->writes = rep.writes;
+		r->stat->writes_skipped = rep.writes_skipped;
+	}
+	uvm_request_complete(rep.reqid, 0);
+}/*}}}*/
+
+void uvm_proto_hibernate_rep(void)/*{{{*/
+{
+	logd(LOG_DEBUG, "processing HIBERNATE_REP\n");
+	struct mmu_proto_hibernate_rep rep;
+	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
+		prexit();
+	assert(rep.type == MMU_PROTO_HIBERNATE_REP);
+	uvm_request_complete(rep.reqid, (intptr_t)rep.npages);
 }/*}}}*/
 
 void uvm_proto_segv_rep(void)/*{{{*/
@@ -287,7 +923,7 @@ void uvm_proto_segv_rep(void)/*{{{*/
 	if(recv(uvm->sock, &rep, sizeof(rep), 0) != sizeof(rep))
 		prexit();
 	assert(rep.type == MMU_PROTO_SEGV_REP);
-	pthread_cond_signal(&uvm->cond);
+	uvm_request_complete(rep.reqid, 0);
 }/*}}}*/
 
 void uvm_proto_remap_rep(void)/*{{{*/
@@ -303,20 +939,35 @@ void uvm_proto_remap_rep(void)/*{{{*/
 	void *addr = (void *)(intptr_t)rep.vaddr;
 	int prot = (int)rep.prot;
 	off_t off = (off_t)rep.offset;
-	size_t pagesz = sysconf(_SC_PAGESIZE);
-	logd(LOG_DEBUG, "remapping %p at offset %llu prot %d\n", rep.vaddr,
-			(unsigned long long)rep.offset, prot);
+	size_t pagesz = UVM_PAGESIZE;
+	size_t len = pagesz * rep.npages;
+	logd(LOG_DEBUG, "remapping %p npages %u at offset %llu prot %d\n",
+			addr, rep.npages, (unsigned long long)rep.offset, prot);
 	if(((uintptr_t)rep.vaddr % (uintptr_t)pagesz) != 0) {
 		logd(LOG_FATAL, "error: unaligned remap of vaddr %p\n", addr);
 		prexit();
 	}
-	munmap(addr, pagesz);
-	void *r = mmap(addr, pagesz, prot, MAP_SHARED, uvm->pmem_fd, off);
-	if(r != addr)
-		prexit();
-	logd(LOG_DEBUG, "mprotect %p prot %d\n", rep.vaddr, prot);
-	if(mprotect(addr, pagesz, prot) == -1)
-		prexit();
+	assert(rep.npages > 0);
+	assert(rep.vaddr >= UVM_BASEADDR &&
+			(rep.vaddr - UVM_BASEADDR) / pagesz + rep.npages <= uvm->npstate);
+	if(uvm->uffd != -1) {
+		#ifdef UVMUFFD
+		uvm_uffd_map(addr, off, rep.npages, prot);
+		#endif
+	} else {
+		/* MAP_FIXED replaces any previous mapping in one call */
+		void *r = mmap(addr, len, prot, MAP_SHARED | MAP_FIXED,
+				uvm->pmem_fd, off);
+		if(r != addr)
+			prexit();
+		uvm_track_map(addr, len);
+		struct uvm_page *p = &uvm->pages[(rep.vaddr - UVM_BASEADDR) / pagesz];
+		for(uint32_t i = 0; i < rep.npages; i++) {
+			p[i].off = off + (off_t)(i * pagesz);
+			p[i].prot = prot;
+			p[i].mapped = 1;
+		}
+	}
 
 	struct mmu_proto_remap_req req;
 	req.type = MMU_PROTO_REMAP_REQ;
@@ -334,10 +985,27 @@ void uvm_proto_chprot_rep(void)/*{{{*/
 	assert(rep.vaddr < UINTPTR_MAX);
 	void *addr = (void *)(uintptr_t)rep.vaddr;
 	int prot = (int)rep.prot;
-	size_t pagesz = sysconf(_SC_PAGESIZE);
-	logd(LOG_DEBUG, "mprotect %p prot %d\n", addr, prot);
-	if(mprotect(addr, pagesz, prot) == -1)
-		prexit();
+	size_t pagesz = UVM_PAGESIZE;
+	assert(rep.npages > 0);
+	assert(rep.vaddr >= UVM_BASEADDR &&
+			(rep.vaddr - UVM_BASEADDR) / pagesz + rep.npages <= uvm->npstate);
+	if(prot == PROT_NONE) {
+		for(uint32_t i = 0; i < rep.npages; i++)
+			uvm_track_unmap((char *)addr + i * pagesz);
+	}
+	if(uvm->uffd != -1) {
+		#ifdef UVMUFFD
+		for(uint32_t i = 0; i < rep.npages; i++)
+			uvm_uffd_chprot((char *)addr + i * pagesz, prot);
+		#endif
+	} else {
+		logd(LOG_DEBUG, "mprotect %p npages %u prot %d\n", addr,
+				rep.npages, prot);
+		if(mprotect(addr, pagesz * rep.npages, prot) == -1)
+			prexit();
+		struct uvm_page *p = &uvm->pages[(rep.vaddr - UVM_BASEADDR) / pagesz];
+		for(uint32_t i = 0; i < rep.npages; i++) p[i].prot = prot;
+	}
 	/* if(prot == PROT_NONE) {
 		logd(LOG_DEBUG, "unmaping %p\n", rep.vaddr);
 		if(munmap(addr, pagesz) == -1)
@@ -349,6 +1017,344 @@ void uvm_proto_chprot_rep(void)/*{{{*/
 	if(send(uvm->sock, &req, sizeof(req), 0) != sizeof(req)) prexit();
 }/*}}}*/
 
+#ifdef UVMUFFD
+/****************************************************************************
+ * userfaultfd fault delivery
+ ***************************************************************************/
+/* Backs the UVM region with anonymous memory registered for missing
+ * faults.  Exact fault addresses are required so the pager sees the
+ * same addresses as with SIGSEGV.  Write faults are also delivered
+ * through userfaultfd if pmem lives in shmem, as uffd-wp does not
+ * support regular files.  Returns -1 if userfaultfd is unavailable. */
+int uvm_uffd_init(void)/*{{{*/
+{
+	size_t len = uvm->npstate * UVM_PAGESIZE;
+	int uffd = (int)syscall(SYS_userfaultfd,
+			O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+	if(uffd == -1) {
+		loge(LOG_INFO, __FILE__, __LINE__);
+		return -1;
+	}
+	struct statfs fs;
+	/* pmem mappings are registered with `track_uffd` when tracking */
+	int wp = uvm->track_uffd == -1 && fstatfs(uvm->pmem_fd, &fs) == 0 &&
+			fs.f_type == TMPFS_MAGIC;
+	struct uffdio_api api;
+	api.api = UFFD_API;
+	api.features = UFFD_FEATURE_EXACT_ADDRESS;
+	if(wp) api.features |= UFFD_FEATURE_WP_HUGETLBFS_SHMEM;
+	if(ioctl(uffd, UFFDIO_API, &api) == -1) goto out_uffd;
+
+	/* large regions are only backed as pages are mapped */
+	void *base = mmap((void *)UVM_BASEADDR, len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE |
+			MAP_FIXED_NOREPLACE, -1, 0);
+	if(base == MAP_FAILED) goto out_uffd;
+	if(base != (void *)UVM_BASEADDR) goto out_map;
+	struct uffdio_register reg;
+	reg.range.start = (uintptr_t)UVM_BASEADDR;
+	reg.range.len = len;
+	reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+	if(ioctl(uffd, UFFDIO_REGISTER, &reg) == -1) goto out_map;
+	uvm->uffd_stop = eventfd(0, EFD_CLOEXEC);
+	if(uvm->uffd_stop == -1) goto out_map;
+
+	uvm->uffd = uffd;
+	uvm->uffd_wp = wp;
+	logd(LOG_INFO, "%s: region registered, write-protect %d\n",
+			__func__, wp);
+	return 0;
+
+	out_map:
+	loge(LOG_INFO, __FILE__, __LINE__);
+	munmap(base, len);
+	close(uffd);
+	return -1;
+
+	out_uffd:
+	loge(LOG_INFO, __FILE__, __LINE__);
+	close(uffd);
+	return -1;
+}/*}}}*/
+
+/* Reads faults in batches, forwards them all to the MMU, waits for
+ * the replies, and then wakes the faulting threads. */
+void * uvm_uffd_thread(void *data)/*{{{*/
+{
+	logd(LOG_DEBUG, "uvm_uffd_thread starting\n");
+	size_t pagesz = UVM_PAGESIZE;
+	struct pollfd fds[2];
+	fds[0].fd = uvm->uffd;
+	fds[0].events = POLLIN;
+	fds[1].fd = uvm->uffd_stop;
+	fds[1].events = POLLIN;
+	struct uffd_msg msgs[UVM_UFFD_BATCH];
+	struct uvm_request *reqs[UVM_UFFD_BATCH];
+
+	for(;;) {
+		if(poll(fds, 2, -1) == -1) {
+			if(errno == EINTR) continue;
+			prexit();
+		}
+		if(fds[1].revents) break;
+		ssize_t c = read(uvm->uffd, msgs, sizeof(msgs));
+		if(c == -1 && errno == EAGAIN) continue;
+		if(c <= 0) prexit();
+		int n = (int)(c / sizeof(msgs[0]));
+
+		pthread_mutex_lock(&uvm->mutex);
+		for(int i = 0; i < n; i++) {
+			reqs[i] = NULL;
+			if(msgs[i].event != UFFD_EVENT_PAGEFAULT) continue;
+			intptr_t va = (intptr_t)msgs[i].arg.pagefault.address;
+			int wpfault = (msgs[i].arg.pagefault.flags &
+					UFFD_PAGEFAULT_FLAG_WP) != 0;
+			logd(LOG_DEBUG, "uffd addr %p wp %d\n", (void *)va, wpfault);
+			uvm_fault_check(va);
+			/* skip faults resolved while serving earlier messages */
+			struct uvm_page *p = &uvm->pages[(va - UVM_BASEADDR) / pagesz];
+			if(p->mapped && (!wpfault || (p->prot & PROT_WRITE))) continue;
+			if(!wpfault && uvm_soft_fault(va)) continue;
+			reqs[i] = uvm_fault_send(va, wpfault ? SEGV_ACCERR : SEGV_MAPERR);
+		}
+		for(int i = 0; i < n; i++) {
+			if(reqs[i]) uvm_request_wait(reqs[i]);
+		}
+		pthread_mutex_unlock(&uvm->mutex);
+
+		for(int i = 0; i < n; i++) {
+			if(msgs[i].event != UFFD_EVENT_PAGEFAULT) continue;
+			struct uffdio_range range;
+			range.start = msgs[i].arg.pagefault.address &
+					~((uint64_t)pagesz - 1);
+			range.len = pagesz;
+			if(ioctl(uvm->uffd, UFFDIO_WAKE, &range) == -1) prexit();
+		}
+	}
+	logd(LOG_DEBUG, "uvm_uffd_thread exiting\n");
+	return NULL;
+}/*}}}*/
+
+/* Replaces the mapping at `addr` with anonymous memory registered for
+ * missing faults. */
+void uvm_uffd_park(void *addr, size_t len)/*{{{*/
+{
+	logd(LOG_DEBUG, "parking %p\n", addr);
+	void *r = mmap(addr, len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+	if(r != addr) prexit();
+	struct uffdio_register reg;
+	reg.range.start = (uintptr_t)addr;
+	reg.range.len = len;
+	reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+	if(ioctl(uvm->uffd, UFFDIO_REGISTER, &reg) == -1) prexit();
+}/*}}}*/
+
+/* Maps `npages` frames of pmem starting at offset `off` at `addr`.
+ * With uffd-wp, pages are write-protected before they become writable
+ * so no write is missed. */
+void uvm_uffd_map(void *addr, off_t off, size_t npages, int prot)/*{{{*/
+{
+	size_t pagesz = UVM_PAGESIZE;
+	size_t len = npages * pagesz;
+	int mprot = uvm->uffd_wp ? PROT_READ : prot;
+	void *r = mmap(addr, len, mprot, MAP_SHARED | MAP_FIXED,
+			uvm->pmem_fd, off);
+	if(r != addr) prexit();
+	if(uvm->uffd_wp) {
+		struct uffdio_register reg;
+		reg.range.start = (uintptr_t)addr;
+		reg.range.len = len;
+		reg.mode = UFFDIO_REGISTER_MODE_WP;
+		if(ioctl(uvm->uffd, UFFDIO_REGISTER, &reg) == -1) prexit();
+		if(!(prot & PROT_WRITE)) uvm_uffd_wp(addr, len, 1);
+		if(mprotect(addr, len, PROT_READ | PROT_WRITE) == -1) prexit();
+	}
+	uvm_track_map(addr, len);
+	struct uvm_page *p = &uvm->pages[((intptr_t)addr - UVM_BASEADDR) / pagesz];
+	for(size_t i = 0; i < npages; i++) {
+		p[i].off = off + (off_t)(i * pagesz);
+		p[i].prot = prot;
+		p[i].mapped = 1;
+	}
+}/*}}}*/
+
+void uvm_uffd_chprot(void *addr, int prot)/*{{{*/
+{
+	size_t pagesz = UVM_PAGESIZE;
+	struct uvm_page *p = &uvm->pages[((intptr_t)addr - UVM_BASEADDR) / pagesz];
+	if(prot == PROT_NONE) {
+		if(p->mapped) uvm_uffd_park(addr, pagesz);
+		p->mapped = 0;
+	} else if(!p->mapped) {
+		uvm_uffd_map(addr, p->off, 1, prot);
+	} else if(uvm->uffd_wp) {
+		uvm_uffd_wp(addr, pagesz, !(prot & PROT_WRITE));
+	} else {
+		logd(LOG_DEBUG, "mprotect %p prot %d\n", addr, prot);
+		if(mprotect(addr, pagesz, prot) == -1) prexit();
+	}
+	p->prot = prot;
+}/*}}}*/
+
+/* Faulting threads are woken by `uvm_uffd_thread` once the SEGV_REP
+ * arrives, hence DONTWAKE (which the kernel only accepts when
+ * removing protection). */
+void uvm_uffd_wp(void *addr, size_t len, int wp)/*{{{*/
+{
+	struct uffdio_writeprotect w;
+	w.range.start = (uintptr_t)addr;
+	w.range.len = len;
+	w.mode = wp ? UFFDIO_WRITEPROTECT_MODE_WP :
+			UFFDIO_WRITEPROTECT_MODE_DONTWAKE;
+	logd(LOG_DEBUG, "writeprotect %p wp %d\n", addr, wp);
+	if(ioctl(uvm->uffd, UFFDIO_WRITEPROTECT, &w) == -1) prexit();
+}/*}}}*/
+#endif
+
+/****************************************************************************
+ * page-state tracking
+ ***************************************************************************/
+/* Tracking uses a userfaultfd in asynchronous write-protect mode: the
+ * kernel resolves writes to write-protected pages by itself, and
+ * `PAGEMAP_SCAN` reports which pages were written.  Accesses are
+ * sampled from the pagemap's present bit, which is cleared by zapping
+ * sampled pages with MADV_DONTNEED; pmem is a shared mapping, so no
+ * data is lost.  Returns -1 if the kernel lacks any of these. */
+int uvm_track_init(void)/*{{{*/
+{
+	int uffd = (int)syscall(SYS_userfaultfd,
+			O_CLOEXEC | UFFD_USER_MODE_ONLY);
+	if(uffd == -1) {
+		loge(LOG_INFO, __FILE__, __LINE__);
+		return -1;
+	}
+	struct uffdio_api api;
+	api.api = UFFD_API;
+	api.features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED |
+			UFFD_FEATURE_WP_HUGETLBFS_SHMEM;
+	if(ioctl(uffd, UFFDIO_API, &api) == -1) goto out_uffd;
+	int pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+	if(pagemap == -1) goto out_uffd;
+	struct pm_scan_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	arg.size = sizeof(arg);
+	arg.start = (uintptr_t)UVM_BASEADDR;
+	arg.end = (uintptr_t)UVM_BASEADDR;
+	if(ioctl(pagemap, PAGEMAP_SCAN, &arg) == -1) goto out_pagemap;
+
+	uvm->track_uffd = uffd;
+	uvm->track_pagemap = pagemap;
+	logd(LOG_INFO, "%s: kernel page-state tracking available\n", __func__);
+	return 0;
+
+	out_pagemap:
+	loge(LOG_INFO, __FILE__, __LINE__);
+	close(pagemap);
+	close(uffd);
+	return -1;
+
+	out_uffd:
+	loge(LOG_INFO, __FILE__, __LINE__);
+	close(uffd);
+	return -1;
+}/*}}}*/
+
+/* Every `track_ms` milliseconds, marks pages accessed since the last
+ * sample as referenced.  A sample is skipped if another thread holds
+ * `uvm->mutex`, so `uvm_exit` never waits on this thread. */
+void * uvm_track_thread(void *data)/*{{{*/
+{
+	logd(LOG_DEBUG, "uvm_track_thread starting\n");
+	size_t pagesz = UVM_PAGESIZE;
+	struct pollfd fds[1];
+	fds[0].fd = uvm->track_stop;
+	fds[0].events = POLLIN;
+	struct page_region regs[UVM_TRACK_BATCH];
+
+	for(;;) {
+		int r = poll(fds, 1, (int)uvm->track_ms);
+		if(r == -1 && errno == EINTR) continue;
+		if(r != 0) break;
+		if(pthread_mutex_trylock(&uvm->mutex) != 0) continue;
+		struct pm_scan_arg arg;
+		memset(&arg, 0, sizeof(arg));
+		arg.size = sizeof(arg);
+		arg.start = (uintptr_t)UVM_BASEADDR;
+		arg.end = arg.start + uvm->npages * pagesz;
+		arg.vec = (uintptr_t)regs;
+		arg.vec_len = UVM_TRACK_BATCH;
+		arg.category_mask = PAGE_IS_PRESENT;
+		arg.return_mask = PAGE_IS_PRESENT;
+		while(arg.start < arg.end) {
+			long n = ioctl(uvm->track_pagemap, PAGEMAP_SCAN, &arg);
+			if(n == -1) prexit();
+			for(long i = 0; i < n; i++) {
+				uint64_t va;
+				/* regions are in system pages */
+				va = regs[i].start & ~(uint64_t)UVM_PAGEMASK;
+				for(; va < regs[i].end; va += pagesz) {
+					size_t idx = (va - UVM_BASEADDR) / pagesz;
+					struct uvm_page *p = &uvm->pages[idx];
+					/* revoked pages keep stale PTEs in SIGSEGV mode */
+					if(!p->mapped || p->prot == PROT_NONE) continue;
+					__atomic_store_n(&uvm->pstate[idx].referenced, 1,
+							__ATOMIC_RELEASE);
+					if(madvise((void *)(uintptr_t)va, pagesz,
+							MADV_DONTNEED) == -1)
+						prexit();
+				}
+			}
+			arg.start = arg.walk_end;
+		}
+		pthread_mutex_unlock(&uvm->mutex);
+	}
+	logd(LOG_DEBUG, "uvm_track_thread exiting\n");
+	return NULL;
+}/*}}}*/
+
+/* Write-protects pmem pages just mapped at `addr` so writes are
+ * recorded from now on. */
+void uvm_track_map(void *addr, size_t len)/*{{{*/
+{
+	if(uvm->track_uffd == -1) return;
+	struct uffdio_register reg;
+	reg.range.start = (uintptr_t)addr;
+	reg.range.len = len;
+	reg.mode = UFFDIO_REGISTER_MODE_WP;
+	if(ioctl(uvm->track_uffd, UFFDIO_REGISTER, &reg) == -1) prexit();
+	struct uffdio_writeprotect w;
+	w.range = reg.range;
+	w.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+	if(ioctl(uvm->track_uffd, UFFDIO_WRITEPROTECT, &w) == -1) prexit();
+}/*}}}*/
+
+/* Sets `dirty` in the page-state table if the page at `addr` was
+ * written since it was mapped.  Access is revoked before the scan so
+ * no write slips in before the caller unmaps the page. */
+void uvm_track_unmap(void *addr)/*{{{*/
+{
+	if(uvm->track_uffd == -1) return;
+	size_t pagesz = UVM_PAGESIZE;
+	size_t idx = (size_t)((intptr_t)addr - UVM_BASEADDR) / pagesz;
+	if(!uvm->pages[idx].mapped) return;
+	if(mprotect(addr, pagesz, PROT_NONE) == -1) prexit();
+	struct page_region reg;
+	struct pm_scan_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	arg.size = sizeof(arg);
+	arg.start = (uintptr_t)addr;
+	arg.end = (uintptr_t)addr + pagesz;
+	arg.vec = (uintptr_t)&reg;
+	arg.vec_len = 1;
+	arg.category_mask = PAGE_IS_WRITTEN;
+	arg.return_mask = PAGE_IS_WRITTEN;
+	long n = ioctl(uvm->track_pagemap, PAGEMAP_SCAN, &arg);
+	if(n == -1) prexit();
+	logd(LOG_DEBUG, "%s %p written %ld\n", __func__, addr, n);
+	if(n > 0) __atomic_store_n(&uvm->pstate[idx].dirty, 1, __ATOMIC_RELEASE);
+}/*}}}*/
+
 /****************************************************************************
  * external functions
  ***************************************************************************/
@@ -7,10 +7,24 @@
 
 #include <stdlib.h>
 
+/* Memory is managed in pages of `UVM_PAGESIZE` bytes, a multiple of
+ * the system page size.  The default is 4KiB; build everything with
+ * `-DUVM_PAGESHIFT=N` for 2^N-byte pages, e.g., 21 for 2MiB pages
+ * that the MMU can back with huge frames (`mmu -H`).  Processes and
+ * the MMU must be built with the same page size. */
+#ifndef UVM_PAGESHIFT
+#define UVM_PAGESHIFT 12
+#endif
+#define UVM_PAGESIZE ((size_t)1 << UVM_PAGESHIFT)
+#define UVM_PAGEMASK (UVM_PAGESIZE - 1)
+
 /* `uvm_create` should be called when a program starts to bind it to
  * the memory management infrastructure.  This function sets up
  * a UNIX socket to communicate with the memory management
- * infrastructure and installs a signal handler for SIGSEGV. */
+ * infrastructure and installs a signal handler for SIGSEGV.  When
+ * compiled with `UVMUFFD`, page faults are instead delivered through
+ * userfaultfd to a dedicated thread if the kernel allows it; SIGSEGV
+ * remains in use for accesses outside the UVM region. */
 void uvm_create(void);
 
 /* `uvm_extend` allocates a new page for the calling process and
@@ -18,10 +32,33 @@ void uvm_create(void);
  * to the `sbrk` system call.  Memory allocated with `uvm_extend` is
  * managed by the memory infrastructure, and must not be `free`d.
  * `uvm_extend` fails, returns NULL, and sets `errno` to ENOSPC if
- * the memory infrastructure swap (disk) is out of space.  The
- * system page size is given by `sysconf(_SC_PAGESIZE)`. */
+ * the memory infrastructure swap (disk) is out of space.  Pages are
+ * `UVM_PAGESIZE` bytes long.  If the MMU leases pages to the process
+ * in advance (`mmu -l`), most calls return without messaging the
+ * MMU. */
 void * uvm_extend(void);
 
+/* `uvm_extend_n` allocates `npages` consecutive pages with a single
+ * request and returns the address of the first page.  Either all
+ * pages are allocated or none; on failure, `uvm_extend_n` returns
+ * NULL and sets `errno` to ENOSPC.  If `flags` includes
+ * `UVM_POPULATE`, the pages are also made resident before the call
+ * returns, like `MAP_POPULATE` for `mmap`, so first accesses do not
+ * fault.  The memory infrastructure may populate only some of the
+ * pages if physical memory is short. */
+#define UVM_POPULATE 1
+void * uvm_extend_n(size_t npages, int flags);
+
+/* `uvm_shrink` gives back all pages of the process from the
+ * `npages`-th onwards, like a negative `sbrk`: their contents are
+ * discarded, and their memory and disk space can be used by other
+ * processes.  Accessing them afterwards is a segmentation fault;
+ * later calls to `uvm_extend` return them again as fresh pages.
+ * The process should not call `uvm_extend` concurrently.  Returns 0
+ * on success; if the process has fewer than `npages` pages, returns
+ * -1 and sets `errno` to EINVAL. */
+int uvm_shrink(size_t npages);
+
 /* `uvm_syslog` requests the memory infrastructure to write the
  * string at `addr` with `len` bytes.  Memory at `addr` must be
  * managed by the memory infrastructure (i.e., allocated with
@@ -29,4 +66,88 @@ void * uvm_extend(void);
  * sets `errno` to EINVAL. */
 int uvm_syslog(void *addr, size_t len);
 
+/* `uvm_advise` tells the memory infrastructure how the process will
+ * access the pages overlapping the `len` bytes following `addr`, as
+ * `madvise` does:
+ *
+ * - `UVM_ADV_NORMAL` removes earlier SEQUENTIAL or RANDOM hints.
+ * - `UVM_ADV_RANDOM` expects accesses in random order; pages are
+ *   read one at a time on faults, as without hints.
+ * - `UVM_ADV_SEQUENTIAL` expects accesses in increasing address
+ *   order; faults read the following pages too, and pages behind the
+ *   faulting one are paged out first.
+ * - `UVM_ADV_WILLNEED` reads the pages in ahead of use.  Use
+ *   `uvm_advise_async` to let the process run meanwhile.
+ * - `UVM_ADV_DONTNEED` discards the pages' contents without writing
+ *   them to disk; the pages stay allocated and read as a fresh page
+ *   from `uvm_extend` afterwards.
+ *
+ * Returns 0 on success; if the memory was not allocated with
+ * `uvm_extend` or `advice` is unknown, returns -1 and sets `errno` to
+ * EINVAL. */
+#define UVM_ADV_NORMAL 0
+#define UVM_ADV_RANDOM 1
+#define UVM_ADV_SEQUENTIAL 2
+#define UVM_ADV_WILLNEED 3
+#define UVM_ADV_DONTNEED 4
+int uvm_advise(void *addr, size_t len, int advice);
+
+/* `uvm_limit` bounds the number of physical frames holding the
+ * process's pages, isolating it from other processes sharing the
+ * memory infrastructure.  Frames the process holds up to
+ * `min_frames` are not taken by other processes' page faults (the
+ * process still has to fault its pages in first).  Once the process
+ * holds `max_frames` frames, its page faults replace its own pages
+ * instead of taking frames from other processes; if it holds more,
+ * the excess is paged out before `uvm_limit` returns.  A zero
+ * `max_frames` removes the maximum.  Processes start without limits.
+ * Returns 0 on success; if `min_frames` is larger than `max_frames`
+ * or the minimums of all processes would reserve every frame,
+ * returns -1 and sets `errno` to EINVAL. */
+int uvm_limit(size_t min_frames, size_t max_frames);
+
+/* `uvm_stat` fills `st` with the limits set by `uvm_limit` and the
+ * process's paging counters.  Returns 0. */
+struct uvm_stat {
+	size_t resident;            /* frames holding the process's pages */
+	size_t min_frames;
+	size_t max_frames;          /* 0 if unlimited */
+	unsigned long faults;       /* faults serviced by the pager */
+	unsigned long pageins;      /* pages zero-filled or read from disk */
+	unsigned long evictions;    /* pages paged out */
+	unsigned long writes;       /* dirty pages written to disk */
+	unsigned long writes_skipped; /* dirty pages left unwritten, as
+	                               * they held only '0' or what
+	                               * their disk block had */
+};
+int uvm_stat(struct uvm_stat *st);
+
+/* `uvm_hibernate` pages out all the process's resident pages at
+ * once, freeing their frames for other processes.  Processes expected
+ * to stay idle for a while may call it instead of having their pages
+ * taken one at a time.  On the process's next page fault, the pages
+ * that were resident are brought back together.  Returns the number
+ * of pages paged out. */
+int uvm_hibernate(void);
+
+/* Asynchronous requests.  `uvm_extend_async`, `uvm_extend_n_async`,
+ * `uvm_syslog_async`, and `uvm_advise_async` send a request and
+ * return a handle without waiting for the memory infrastructure.
+ * Several requests may be outstanding at once, from one or more
+ * threads.  `uvm_poll` returns nonzero if the request has completed.
+ * `uvm_extend_wait`, `uvm_syslog_wait`, and `uvm_advise_wait` wait
+ * for the request to complete, release the handle, and return what
+ * `uvm_extend` (or `uvm_extend_n`), `uvm_syslog`, and `uvm_advise`
+ * would have returned (setting `errno` the same way).  Each handle
+ * must be waited on exactly once. */
+typedef struct uvm_request *uvm_request_t;
+uvm_request_t uvm_extend_async(void);
+uvm_request_t uvm_extend_n_async(size_t npages, int flags);
+uvm_request_t uvm_syslog_async(void *addr, size_t len);
+uvm_request_t uvm_advise_async(void *addr, size_t len, int advice);
+int uvm_poll(uvm_request_t req);
+void * uvm_extend_wait(uvm_request_t req);
+int uvm_syslog_wait(uvm_request_t req);
+int uvm_advise_wait(uvm_request_t req);
+
 #endif
@@ -0,0 +1,117 @@
+/* UNIVERSIDADE FEDERAL DE MINAS GERAIS     *
+ * DEPARTAMENTO DE CIENCIA DA COMPUTACAO    *
+ * Copyright (c) Italo Fernando Scota Cunha */
+
+/* `uvmbench` measures the cost of page faults as address spaces
+ * grow.  For each size, a fresh process allocates NPAGES pages with
+ * `uvm_extend_n` and reads SAMPLES pages spread evenly over them,
+ * twice: the first pass measures first-touch faults, the second
+ * measures faults on pages evicted during the first pass.  Pages are
+ * only read, so evictions do not need disk blocks; start the MMU with
+ * few frames, `-o unlimited`, and `-r` covering the largest size,
+ * e.g., `mmu -q -o unlimited -r 4194304 64 4`. */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "uvm.h"
+
+#define UVMBENCH_SAMPLES 2048
+
+static const size_t defsizes[] = { 256, 4096, 65536, 1048576, 4194304 };
+
+static double now_ns(void)/*{{{*/
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}/*}}}*/
+
+/* Reads `nsamples` pages spread over `npages` pages at `base` and
+ * returns the average time per page in nanoseconds. */
+static double touch(volatile char *base, size_t npages, size_t nsamples)/*{{{*/
+{
+	size_t pagesz = UVM_PAGESIZE;
+	size_t stride = npages / nsamples;
+	size_t bad = 0;
+	double start = now_ns();
+	for(size_t i = 0; i < nsamples; i++) {
+		/* fresh pages are zero-filled with '0' characters */
+		if(base[i * stride * pagesz] != '0') bad++;
+	}
+	double end = now_ns();
+	if(bad) fprintf(stderr, "%zu pages with bad contents\n", bad);
+	return (end - start) / (double)nsamples;
+}/*}}}*/
+
+static void run(size_t npages, size_t nsamples)/*{{{*/
+{
+	uvm_create();
+	double start = now_ns();
+	char *base = uvm_extend_n(npages, 0);
+	double extend = now_ns() - start;
+	if(!base) {
+		fprintf(stderr, "uvm_extend_n %zu: %s\n", npages, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	if(nsamples > npages) nsamples = npages;
+	double first = touch(base, npages, nsamples);
+	double again = touch(base, npages, nsamples);
+	printf("%10zu %8zu %12.0f %12.0f %12.0f\n", npages, nsamples,
+			extend / 1e3, first, again);
+	fflush(stdout);
+	exit(EXIT_SUCCESS);
+}/*}}}*/
+
+int main(int argc, char **argv) {/*{{{*/
+	size_t nsamples = UVMBENCH_SAMPLES;
+	int opt;
+	while((opt = getopt(argc, argv, "s:")) != -1) {
+		switch(opt) {
+		case 's':
+			nsamples = strtoul(optarg, NULL, 10);
+			if(nsamples > 0) break;
+			/* fall through */
+		default:
+			printf("usage: %s [-s SAMPLES] [NPAGES ...]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	const size_t *sizes = defsizes;
+	size_t nsizes = sizeof(defsizes) / sizeof(defsizes[0]);
+	size_t *argsizes = NULL;
+	if(optind < argc) {
+		nsizes = argc - optind;
+		argsizes = malloc(nsizes * sizeof(argsizes[0]));
+		if(!argsizes) exit(EXIT_FAILURE);
+		for(size_t i = 0; i < nsizes; i++) {
+			argsizes[i] = strtoul(argv[optind + i], NULL, 10);
+			if(argsizes[i] == 0) exit(EXIT_FAILURE);
+		}
+		sizes = argsizes;
+	}
+
+	printf("%10s %8s %12s %12s %12s\n", "npages", "samples",
+			"extend(us)", "fault(ns)", "refault(ns)");
+	for(size_t i = 0; i < nsizes; i++) {
+		fflush(stdout);
+		pid_t pid = fork();
+		if(pid == -1) exit(EXIT_FAILURE);
+		if(pid == 0) run(sizes[i], nsamples);
+		int status;
+		if(waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+				WEXITSTATUS(status) != EXIT_SUCCESS) {
+			fprintf(stderr, "npages %zu: benchmark failed\n", sizes[i]);
+		}
+	}
+	free(argsizes);
+	exit(EXIT_SUCCESS);
+}/*}}}*/